@@ -0,0 +1,248 @@
+#include "adioengine.hpp"
+#include "string_format.hpp"
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// keep spinning this long after the last activity before blocking
+#define ADIO_SPIN_NS 200000
+// spin instead of blocking once a pulse deadline is this close; the futex wake-up is not that precise
+#define ADIO_SPIN_AHEAD_NS 100000
+
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, uint64_t timeout_ns)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000ULL;
+    ts.tv_nsec = timeout_ns % 1000000000ULL;
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, expected, timeout_ns == UINT64_MAX ? NULL : &ts, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+ADIOEngine::ADIOEngine(DIOPort *port)
+{
+    this->port = port;
+    enq = 0;
+    events = 0;
+    writes = 0;
+    errors = 0;
+    overflow = 0;
+    state = 0;
+    sleeping = 0;
+    memset(pulse_end, 0, sizeof(pulse_end));
+    running = false;
+    if (port == nullptr)
+        return;
+    slots = new Slot[queue_slots];
+    for (uint32_t i = 0; i < queue_slots; i++)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    running = true;
+    thr = std::thread(&ADIOEngine::run, this);
+}
+
+ADIOEngine::~ADIOEngine()
+{
+    running = false;
+    wake();
+    if (thr.joinable())
+        thr.join();
+    delete[] slots;
+}
+
+bool ADIOEngine::post(int bit, EventKind kind, uint32_t pulse_us, uint64_t t_ns)
+{
+    if (port == nullptr || bit < 0 || bit > 7)
+        return false;
+    uint64_t pos = enq.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Slot &s = slots[pos & (queue_slots - 1)];
+        uint64_t seq = s.seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)(seq - pos);
+        if (dif == 0)
+        {
+            if (enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                s.ev.t_ns = t_ns;
+                s.ev.pulse_us = pulse_us;
+                s.ev.bit = bit;
+                s.ev.kind = kind;
+                s.seq.store(pos + 1, std::memory_order_release);
+                events.fetch_add(1, std::memory_order_relaxed);
+                // pairs with the fence in run(): either the engine sees this event or we see it asleep
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (sleeping.load(std::memory_order_relaxed) != 0)
+                    wake();
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            overflow.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enq.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void ADIOEngine::wake()
+{
+    if (sleeping.exchange(0, std::memory_order_relaxed) != 0)
+        futex_wake(&sleeping);
+}
+
+bool ADIOEngine::peek(Event &ev)
+{
+    Slot &s = slots[deq & (queue_slots - 1)];
+    if (s.seq.load(std::memory_order_acquire) != deq + 1)
+        return false;
+    ev = s.ev;
+    return true;
+}
+
+void ADIOEngine::consume()
+{
+    slots[deq & (queue_slots - 1)].seq.store(deq + queue_slots, std::memory_order_release);
+    deq++;
+}
+
+bool ADIOEngine::write(uint8_t value)
+{
+    int ret = port->write_port(value);
+    writes.fetch_add(1, std::memory_order_relaxed);
+    if (ret < 0)
+    {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    shadow = value;
+    state.store(value, std::memory_order_relaxed);
+    return true;
+}
+
+void ADIOEngine::run()
+{
+    uint64_t stamps[queue_slots]; // post times of the events in the pending write
+    uint32_t pulse_width[8] = {0};
+    uint64_t last_active = mono_ns();
+    while (running)
+    {
+        uint8_t next = shadow;
+        uint8_t touched = 0;   // bits changed by events in this write
+        uint8_t pulse_rise = 0; // bits whose pulse starts with this write
+        uint32_t nstamps = 0;
+        bool more = false;
+        Event ev;
+        while (peek(ev))
+        {
+            uint8_t mask = 1 << ev.bit;
+            if (touched & mask)
+            {
+                // second edge on the same bit: write what we have first, then pick this one up
+                more = true;
+                break;
+            }
+            consume();
+            switch (ev.kind)
+            {
+            case ADIO_TOGGLE:
+                next ^= mask;
+                pulse_end[ev.bit] = 0;
+                break;
+            case ADIO_PULSE:
+                // a pulse posted while the previous one is still high extends it
+                next |= mask;
+                pulse_rise |= mask;
+                pulse_width[ev.bit] = ev.pulse_us;
+                break;
+            default:
+                next &= ~mask;
+                pulse_end[ev.bit] = 0;
+                break;
+            }
+            touched |= mask;
+            stamps[nstamps++] = ev.t_ns;
+        }
+        uint64_t now = mono_ns();
+        // falling edges of pulses that are due go out with the same write
+        for (int bit = 0; bit < 8; bit++)
+        {
+            uint8_t mask = 1 << bit;
+            if (pulse_end[bit] != 0 && pulse_end[bit] <= now && !(touched & mask))
+            {
+                next &= ~mask;
+                pulse_end[bit] = 0;
+            }
+        }
+        if (next != shadow || pulse_rise != 0)
+        {
+            if (write(next))
+            {
+                uint64_t done = mono_ns();
+                for (uint32_t i = 0; i < nstamps; i++)
+                    latency.record(done - stamps[i]);
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    if (pulse_rise & (1 << bit))
+                        pulse_end[bit] = done + (uint64_t)pulse_width[bit] * 1000;
+                }
+            }
+            last_active = now;
+        }
+        if (more || nstamps > 0)
+            continue;
+        // idle: wait for the next event or pulse deadline
+        uint64_t deadline = UINT64_MAX;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (pulse_end[bit] != 0 && pulse_end[bit] < deadline)
+                deadline = pulse_end[bit];
+        }
+        if (now - last_active < ADIO_SPIN_NS || deadline <= now + ADIO_SPIN_AHEAD_NS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        // nothing due soon: block until post() wakes us or the next pulse comes close
+        sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (running && !peek(ev))
+            futex_wait(&sleeping, 1, deadline == UINT64_MAX ? UINT64_MAX : deadline - now - ADIO_SPIN_AHEAD_NS);
+        sleeping.store(0, std::memory_order_relaxed);
+    }
+    // leave every output low
+    if (shadow != 0)
+        write(0);
+}
+
+void ADIOEngine::reset_stats()
+{
+    events = 0;
+    writes = 0;
+    errors = 0;
+    overflow = 0;
+    latency.reset();
+}
+
+std::string ADIOEngine::to_string() const
+{
+    uint64_t nev = events.load(std::memory_order_relaxed);
+    uint64_t nwr = writes.load(std::memory_order_relaxed);
+    return string_format("{\"active\": %s, \"port\": \"%s\", \"events\": %llu, \"writes\": %llu, \"errors\": %llu, \"overflow\": %llu, "
+                         "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f}}",
+                         active() ? "true" : "false", active() ? port->kind() : "none",
+                         (unsigned long long)nev, (unsigned long long)nwr,
+                         (unsigned long long)errors.load(std::memory_order_relaxed),
+                         (unsigned long long)overflow.load(std::memory_order_relaxed),
+                         latency.percentile(0.5) / 1e3, latency.percentile(0.99) / 1e3, latency.percentile(0.999) / 1e3);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file adioengine.hpp
+ * @brief Single owner of aDIO port 0: drives camera trigger outputs from a dedicated thread.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Frame callbacks post timestamped edge events into a bounded lock-free
+ * queue and return immediately. The engine thread keeps a shadow of port 0,
+ * applies every event queued at that moment and writes the port once, so
+ * edges from several cameras arriving together cost one port write.
+ * Two events for the same bit are never merged into one write, so no edge is
+ * lost. Outputs either toggle once per frame or emit a pulse of fixed width.
+ * The engine spins while frames are arriving or a pulse is about to end and
+ * otherwise sleeps on a futex that post() wakes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "camerabackend.hpp"
+#include "capturestats.hpp"
+
+class ADIOEngine
+{
+public:
+    enum EventKind : uint8_t
+    {
+        ADIO_TOGGLE, // invert the bit
+        ADIO_PULSE,  // drive the bit high for pulse_us, then low
+        ADIO_LOW,    // drive the bit low, cancelling a pulse in progress
+    };
+
+private:
+    struct Event
+    {
+        uint64_t t_ns; // mono_ns() when posted
+        uint32_t pulse_us;
+        uint8_t bit;
+        uint8_t kind;
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> seq;
+        Event ev;
+    };
+
+    static const uint32_t queue_slots = 1024; // power of two
+
+    DIOPort *port = nullptr;
+    Slot *slots = nullptr;
+    alignas(64) std::atomic<uint64_t> enq; // next slot producers claim
+    alignas(64) uint64_t deq = 0;          // next slot the engine reads
+    uint8_t shadow = 0;                    // port 0 as last written
+    uint64_t pulse_end[8];                 // falling edge deadline per bit, 0 if none
+    std::atomic<bool> running;
+    std::atomic<uint32_t> sleeping; // futex word: 1 while the engine is blocked or about to block
+    std::thread thr;
+
+    void wake();
+    bool peek(Event &ev);
+    void consume();
+    bool write(uint8_t value);
+    void run();
+
+public:
+    std::atomic<uint64_t> events;   // events posted
+    std::atomic<uint64_t> writes;   // port writes issued
+    std::atomic<uint64_t> errors;   // port writes that failed
+    std::atomic<uint64_t> overflow; // events dropped because the queue was full
+    std::atomic<uint8_t> state;     // port 0 as last written, for any thread to read
+    LatencyHistogram latency;       // post to completed port write, per event that changed the port
+
+    /**
+     * @brief Take over port 0 and start the engine thread.
+     *
+     * @param port Output port, configured as output; must outlive the engine. nullptr disables the engine: post() does nothing.
+     */
+    ADIOEngine(DIOPort *port);
+    ~ADIOEngine();
+
+    ADIOEngine(const ADIOEngine &) = delete;
+    ADIOEngine &operator=(const ADIOEngine &) = delete;
+
+    bool active() const
+    {
+        return port != nullptr;
+    }
+
+    /**
+     * @brief Queue an edge. Lock-free, safe to call from any number of threads, including frame callbacks.
+     *
+     * @param bit Port 0 bit, 0-7.
+     * @param kind What to do with the bit.
+     * @param pulse_us Pulse width for ADIO_PULSE.
+     * @param t_ns mono_ns() of the triggering event, for the latency report.
+     * @return false if the engine is disabled, the bit is invalid or the queue is full.
+     */
+    bool post(int bit, EventKind kind, uint32_t pulse_us, uint64_t t_ns);
+
+    void reset_stats();
+
+    /**
+     * @brief Render the engine statistics as a JSON object.
+     *
+     */
+    std::string to_string() const;
+};
@@ -0,0 +1,241 @@
+#include "alliedbackend.hpp"
+#include "meb_print.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+class CharContainer
+{
+private:
+    char *strdup(const char *str)
+    {
+        int len = strlen(str);
+        char *out = new char[len + 1];
+        strcpy(out, str);
+        return out;
+    }
+
+public:
+    char **arr = nullptr;
+    int narr = 0;
+    int selected;
+    size_t maxlen = 0;
+
+    ~CharContainer()
+    {
+        if (arr)
+        {
+            for (int i = 0; i < narr; i++)
+            {
+                delete[] arr[i];
+            }
+            delete[] arr;
+        }
+    }
+
+    CharContainer()
+    {
+        arr = nullptr;
+        narr = 0;
+        selected = -1;
+    }
+
+    CharContainer(const char **arr, int narr)
+    {
+        this->arr = new char *[narr];
+        this->narr = narr;
+        this->selected = -1;
+        for (int i = 0; i < narr; i++)
+        {
+            this->arr[i] = strdup(arr[i]);
+            if (strlen(arr[i]) > maxlen)
+            {
+                maxlen = strlen(arr[i]);
+            }
+        }
+    }
+
+    CharContainer(const char **arr, int narr, const char *key)
+    {
+        this->arr = new char *[narr];
+        this->narr = narr;
+        for (int i = 0; i < narr; i++)
+        {
+            this->arr[i] = strdup(arr[i]);
+            if (strlen(arr[i]) > maxlen)
+            {
+                maxlen = strlen(arr[i]);
+            }
+        }
+        this->selected = find_idx(key);
+    }
+
+    int find_idx(const char *str)
+    {
+        int res = -1;
+        for (int i = 0; i < narr; i++)
+        {
+            if (strcmp(arr[i], str) == 0)
+                res = i;
+        }
+        return res;
+    }
+};
+
+typedef CommandDesc<AlliedBackend> AlliedFeature;
+
+#define ALLIED_STR(NAME) {CommandNames::NAME, #NAME, ValueType::Str, 0, &get_str<allied_get_##NAME, AlliedBackend>, &set_str<allied_set_##NAME, AlliedBackend>, {}}
+#define ALLIED_DBL(NAME) {CommandNames::NAME, #NAME, ValueType::Dbl, 0, &get_dbl<allied_get_##NAME, AlliedBackend>, &set_dbl<allied_set_##NAME, AlliedBackend>, {}}
+#define ALLIED_INT(NAME) {CommandNames::NAME, #NAME, ValueType::Int, 0, &get_int<allied_get_##NAME, AlliedBackend>, &set_int<allied_set_##NAME, AlliedBackend>, {}}
+#define ALLIED_BOOL(NAME) {CommandNames::NAME, #NAME, ValueType::Bool, 0, &get_bool<allied_get_##NAME, AlliedBackend>, &set_bool<allied_set_##NAME, AlliedBackend>, {}}
+#define ALLIED_SIZE(NAME) {CommandNames::NAME, #NAME, ValueType::Size, 0, &get_size<allied_get_##NAME, AlliedBackend>, &set_size<allied_set_##NAME, AlliedBackend>, {}}
+
+/**
+ * @brief SDK call behind each camera feature. Flags and dependencies live in the command table in main.cpp.
+ *
+ */
+static constexpr AlliedFeature allied_features[] = {
+    ALLIED_STR(image_format),
+    ALLIED_STR(sensor_bit_depth),
+    ALLIED_STR(trigline),
+    ALLIED_STR(trigline_src),
+    ALLIED_DBL(exposure_us),
+    ALLIED_DBL(acq_framerate),
+    ALLIED_BOOL(acq_framerate_auto),
+    ALLIED_SIZE(image_size),
+    ALLIED_SIZE(image_ofst),
+    {CommandNames::sensor_size, "sensor_size", ValueType::Size, 0, &get_size<allied_get_sensor_size, AlliedBackend>, nullptr, {}},
+    ALLIED_INT(throughput_limit),
+    {CommandNames::throughput_limit_range, "throughput_limit_range", ValueType::Range, 0, &get_range<allied_get_throughput_limit_range, AlliedBackend>, nullptr, {}},
+};
+
+static_assert(command_ids_unique(allied_features), "Duplicate command number in allied_features.");
+
+AlliedBackend::AlliedBackend(const std::string &idstr)
+{
+    VmbError_t err = allied_open_camera(&handle, idstr.c_str(), 5);
+    if (err != VmbErrorSuccess)
+    {
+        dbprintlf(FATAL "Failed to open camera %s: %s", idstr.c_str(), allied_strerr(err));
+        throw std::runtime_error("Failed to open camera.");
+    }
+}
+
+AlliedBackend::~AlliedBackend()
+{
+    allied_stop_capture(handle);  // just stop capture...
+    allied_close_camera(&handle); // close the camera
+}
+
+VmbError_t AlliedBackend::get_feature(long id, FeatureValue &value)
+{
+    const AlliedFeature *desc = find_command(allied_features, id);
+    if (desc == nullptr || desc->get == nullptr)
+        return VmbErrorNotSupported;
+    return desc->get(*this, value);
+}
+
+VmbError_t AlliedBackend::set_feature(long id, const FeatureValue &value)
+{
+    const AlliedFeature *desc = find_command(allied_features, id);
+    if (desc == nullptr || desc->set == nullptr)
+        return VmbErrorNotSupported;
+    return desc->set(*this, value);
+}
+
+VmbError_t AlliedBackend::geometry(FrameGeometry &geom)
+{
+    VmbInt64_t width = 0, height = 0;
+    VmbError_t err = allied_get_image_size(handle, &width, &height);
+    if (err != VmbErrorSuccess)
+        return err;
+    const char *fmt = nullptr;
+    const char *depth = nullptr;
+    if (allied_get_image_format(handle, &fmt) != VmbErrorSuccess)
+        fmt = nullptr;
+    if (allied_get_sensor_bit_depth(handle, &depth) != VmbErrorSuccess)
+        depth = nullptr;
+    geom.width = width;
+    geom.height = height;
+    geom.bits_per_pixel = FrameGeometry::pixel_bits(fmt, depth);
+    return VmbErrorSuccess;
+}
+
+VmbError_t AlliedBackend::start_capture(AlliedCaptureCallback callback, void *user_data)
+{
+    return allied_start_capture(handle, callback, user_data);
+}
+
+VmbError_t AlliedBackend::stop_capture()
+{
+    return allied_stop_capture(handle);
+}
+
+void AlliedBackend::setup_trigger_lines()
+{
+    CharContainer *triglines = nullptr;
+    CharContainer *trigsrcs = nullptr;
+    char *key = nullptr;
+    char **arr = nullptr;
+    VmbUint32_t narr = 0;
+    VmbError_t err = allied_get_trigline(handle, (const char **)&key);
+    if (err == VmbErrorSuccess)
+    {
+        err = allied_get_triglines_list(handle, &arr, NULL, &narr);
+        if (err == VmbErrorSuccess)
+        {
+            triglines = new CharContainer((const char **)arr, narr, (const char *)key);
+            free(arr);
+            narr = 0;
+        }
+        else
+        {
+            dbprintlf("Could not get trigger lines list: %s", allied_strerr(err));
+        }
+    }
+    else
+    {
+        dbprintlf("Could not get selected trigger line: %s", allied_strerr(err));
+    }
+    if (triglines != nullptr)
+    {
+        // set all trigger lines to output
+        for (int i = 0; i < triglines->narr; i++)
+        {
+            char *line = triglines->arr[i];
+            err = allied_set_trigline(handle, line);
+            if (err != VmbErrorSuccess)
+            {
+                dbprintlf("Could not select line %s: %s", line, allied_strerr(err));
+            }
+            else
+            {
+                err = allied_set_trigline_mode(handle, "Output");
+                if (err != VmbErrorSuccess)
+                    dbprintlf("Could not set line %s to output: %s", line, allied_strerr(err));
+            }
+        }
+        err = allied_set_trigline(handle, key);
+        if (err != VmbErrorSuccess)
+            dbprintlf("Could not select line %s: %s", key, allied_strerr(err));
+        // get trigger source
+        err = allied_get_trigline_src(handle, (const char **)&key);
+        if (err == VmbErrorSuccess)
+        {
+            err = allied_get_trigline_src_list(handle, &arr, NULL, &narr);
+            if (err == VmbErrorSuccess)
+            {
+                trigsrcs = new CharContainer((const char **)arr, narr, (const char *)key);
+                free(arr);
+                narr = 0;
+            }
+            else
+            {
+                dbprintlf("Could not get trigger sources list: %s", allied_strerr(err));
+            }
+        }
+    }
+    delete triglines;
+    delete trigsrcs;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file alliedbackend.hpp
+ * @brief CameraBackend for an Allied Vision camera, through the Vimba X SDK.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <alliedcam.h>
+#include <string>
+
+#include "camerabackend.hpp"
+
+class AlliedBackend : public CameraBackend
+{
+public:
+    AlliedCameraHandle_t handle = nullptr; // used by the feature table, see alliedbackend.cpp
+
+    /**
+     * @brief Open a camera.
+     *
+     * @param idstr Camera ID string from allied_list_cameras().
+     * @throws std::runtime_error if the camera cannot be opened.
+     */
+    AlliedBackend(const std::string &idstr);
+
+    /**
+     * @brief Stops capture and closes the camera.
+     *
+     */
+    ~AlliedBackend();
+
+    AlliedBackend(const AlliedBackend &) = delete;
+    AlliedBackend &operator=(const AlliedBackend &) = delete;
+
+    /**
+     * @brief Set every trigger line to output, leaving the selected line selected.
+     *
+     */
+    void setup_trigger_lines();
+
+    const char *kind() const
+    {
+        return "allied";
+    }
+
+    VmbError_t get_feature(long id, FeatureValue &value);
+    VmbError_t set_feature(long id, const FeatureValue &value);
+    VmbError_t geometry(FrameGeometry &geom);
+    VmbError_t start_capture(AlliedCaptureCallback callback, void *user_data);
+    VmbError_t stop_capture();
+};
@@ -0,0 +1,331 @@
+#include "asynclog.hpp"
+#include "capturestats.hpp"
+#include "string_format.hpp"
+
+#include <stdarg.h>
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define LOG_POLL_US 2000 // writer sleep when every ring is empty
+
+std::atomic<int> log_threshold(MEB_LOG_INFO);
+
+static std::atomic<uint64_t> log_written(0);
+static std::atomic<uint64_t> log_dropped(0);
+static std::atomic<uint64_t> log_suppressed(0);
+static std::atomic<bool> log_shutdown(false); // the writer is gone: write synchronously
+
+struct LogRecord
+{
+    uint64_t t_ns;
+    const LogSite *site;
+    uint32_t suppressed; // lines of this site rate limited just before this one
+    uint16_t len;
+    bool truncated;
+    char text[LOG_LINE_MAX];
+};
+
+/**
+ * @brief One thread's lines on their way to the writer.
+ *
+ */
+struct LogRing
+{
+    LogRecord slots[LOG_RING_SLOTS];
+    alignas(64) std::atomic<uint64_t> head; // next slot the owning thread fills
+    alignas(64) std::atomic<uint64_t> tail; // next slot the writer reads
+    std::atomic<bool> retired;              // the owning thread has exited
+};
+
+/**
+ * @brief Wall clock time of mono_ns() zero, taken once: lines are stamped with mono_ns() and converted only when written.
+ *
+ */
+static int64_t log_wall_offset_ns()
+{
+    static const int64_t offset = []()
+    {
+        struct timespec rt;
+        clock_gettime(CLOCK_REALTIME, &rt);
+        return (int64_t)rt.tv_sec * 1000000000LL + rt.tv_nsec - (int64_t)mono_ns();
+    }();
+    return offset;
+}
+
+/**
+ * @brief Render one line: [time] [file:line | func] (suppressed) text.
+ *
+ */
+static void format_line(std::string &out, uint64_t t_ns, const LogSite &site, uint32_t suppressed, const char *text, size_t len, bool truncated)
+{
+    static thread_local time_t last_sec = -1; // localtime_r() once per second
+    static thread_local char hms[16];
+    int64_t wall_ns = log_wall_offset_ns() + (int64_t)t_ns;
+    time_t sec = wall_ns / 1000000000LL;
+    if (sec != last_sec)
+    {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        snprintf(hms, sizeof(hms), "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+        last_sec = sec;
+    }
+    out += string_format(YELLOW_FG "[%s.%06u] " TERMINATOR, hms, (unsigned)(wall_ns % 1000000000LL / 1000));
+    if (site.located)
+        out += string_format("[%s:%d | %s] ", site.file, site.line, site.func);
+    if (suppressed > 0)
+        out += string_format("(%u similar lines suppressed) ", suppressed);
+    out.append(text, len);
+    if (truncated)
+        out += "..." TERMINATOR "\n";
+}
+
+class LogWriter
+{
+    std::mutex rings_lock; // the rings list
+    std::vector<LogRing *> rings;
+    std::mutex write_lock; // one drain at a time
+    std::vector<LogRecord> batch;
+    uint64_t dropped_seen = 0; // log_dropped as of the last drain
+    std::atomic<bool> running;
+    std::thread thr;
+
+    /**
+     * @brief Write out every queued line, oldest first. Caller holds write_lock.
+     *
+     * @return Number of lines written.
+     */
+    size_t drain()
+    {
+        std::vector<LogRing *> snapshot;
+        {
+            std::lock_guard<std::mutex> guard(rings_lock);
+            snapshot = rings;
+        }
+        batch.clear();
+        std::vector<LogRing *> gone;
+        for (LogRing *ring : snapshot)
+        {
+            bool retired = ring->retired.load(std::memory_order_acquire); // before head: the last line is then seen
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            for (; tail < head; tail++)
+                batch.push_back(ring->slots[tail & (LOG_RING_SLOTS - 1)]);
+            ring->tail.store(tail, std::memory_order_release);
+            if (retired)
+                gone.push_back(ring);
+        }
+        if (!gone.empty())
+        {
+            std::lock_guard<std::mutex> guard(rings_lock);
+            for (LogRing *ring : gone)
+            {
+                rings.erase(std::find(rings.begin(), rings.end(), ring));
+                delete ring;
+            }
+        }
+        uint64_t dropped = log_dropped.load(std::memory_order_relaxed);
+        if (batch.empty() && dropped == dropped_seen)
+            return 0;
+        std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b)
+                         { return a.t_ns < b.t_ns; });
+        std::string out, err;
+        for (const LogRecord &r : batch)
+            format_line(r.site->to_stdout ? out : err, r.t_ns, *r.site, r.suppressed, r.text, r.len, r.truncated);
+        if (dropped != dropped_seen)
+        {
+            err += string_format(YELLOW_FG "%llu log lines dropped, the log could not keep up." TERMINATOR "\n", (unsigned long long)(dropped - dropped_seen));
+            dropped_seen = dropped;
+        }
+        // one write per stream; this is where a slow console stalls, away from the callers
+        if (!out.empty())
+        {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+        if (!err.empty())
+        {
+            fwrite(err.data(), 1, err.size(), stderr);
+            fflush(stderr);
+        }
+        log_written.fetch_add(batch.size(), std::memory_order_relaxed);
+        return batch.size();
+    }
+
+    void run()
+    {
+        while (running.load(std::memory_order_acquire))
+        {
+            size_t n;
+            {
+                std::lock_guard<std::mutex> guard(write_lock);
+                n = drain();
+            }
+            if (n == 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(LOG_POLL_US));
+        }
+    }
+
+public:
+    LogWriter()
+    {
+        log_wall_offset_ns();
+        running = true;
+        thr = std::thread(&LogWriter::run, this);
+    }
+
+    ~LogWriter()
+    {
+        running = false;
+        thr.join();
+        std::lock_guard<std::mutex> guard(write_lock);
+        drain();
+        log_shutdown = true;
+        // rings of threads still running are left to them: they may write once more
+    }
+
+    LogRing *add_ring()
+    {
+        LogRing *ring = new LogRing;
+        ring->head = 0;
+        ring->tail = 0;
+        ring->retired = false;
+        std::lock_guard<std::mutex> guard(rings_lock);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    size_t threads()
+    {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        return rings.size();
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> guard(write_lock);
+        drain();
+    }
+};
+
+static LogWriter &log_writer()
+{
+    static LogWriter writer; // started at the first line
+    return writer;
+}
+
+/**
+ * @brief This thread's ring, registered at its first line and handed back to the writer when the thread exits.
+ *
+ */
+struct LogRingHandle
+{
+    LogRing *ring = nullptr;
+
+    ~LogRingHandle()
+    {
+        if (ring != nullptr)
+            ring->retired.store(true, std::memory_order_release);
+    }
+};
+
+static thread_local LogRingHandle this_ring;
+
+int log_write(LogSite &site, const char *format, ...)
+{
+    uint64_t now = mono_ns();
+    uint64_t window = site.window.load(std::memory_order_relaxed);
+    if (now - window >= LOG_SITE_WINDOW_NS && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+        site.count.store(0, std::memory_order_relaxed);
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_BURST && site.level < MEB_LOG_FATAL)
+    {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        log_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    va_list ap;
+    if (site.level >= MEB_LOG_FATAL || log_shutdown.load(std::memory_order_acquire))
+    {
+        // synchronous, behind everything already queued
+        if (!log_shutdown.load(std::memory_order_acquire))
+            log_writer().flush();
+        char text[LOG_LINE_MAX];
+        va_start(ap, format);
+        int n = vsnprintf(text, sizeof(text), format, ap);
+        va_end(ap);
+        if (n < 0)
+            return 0;
+        std::string line;
+        format_line(line, now, site, site.suppressed.exchange(0, std::memory_order_relaxed), text,
+                    n < LOG_LINE_MAX ? n : LOG_LINE_MAX - 1, n >= LOG_LINE_MAX);
+        FILE *stream = site.to_stdout ? stdout : stderr;
+        fwrite(line.data(), 1, line.size(), stream);
+        fflush(stream);
+        log_written.fetch_add(1, std::memory_order_relaxed);
+        return n;
+    }
+
+    LogRing *ring = this_ring.ring;
+    if (ring == nullptr)
+        ring = this_ring.ring = log_writer().add_ring();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SLOTS)
+    {
+        log_dropped.fetch_add(1, std::memory_order_relaxed);
+        return 0; // never wait for the console
+    }
+    LogRecord &r = ring->slots[head & (LOG_RING_SLOTS - 1)];
+    va_start(ap, format);
+    int n = vsnprintf(r.text, sizeof(r.text), format, ap);
+    va_end(ap);
+    if (n < 0)
+        return 0;
+    r.t_ns = now;
+    r.site = &site;
+    r.suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    r.len = n < LOG_LINE_MAX ? n : LOG_LINE_MAX - 1;
+    r.truncated = n >= LOG_LINE_MAX;
+    ring->head.store(head + 1, std::memory_order_release);
+    return n;
+}
+
+void log_flush()
+{
+    if (!log_shutdown.load(std::memory_order_acquire))
+        log_writer().flush();
+}
+
+static const char *const log_level_names[] = {"info", "warn", "error", "fatal", "off"};
+
+const char *log_level_name(int level)
+{
+    return level >= MEB_LOG_INFO && level <= MEB_LOG_OFF ? log_level_names[level] : "unknown";
+}
+
+bool log_level_from_name(const char *name, int &level)
+{
+    for (int i = MEB_LOG_INFO; i <= MEB_LOG_OFF; i++)
+    {
+        if (strcasecmp(name, log_level_names[i]) == 0)
+        {
+            level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string log_stats()
+{
+    return string_format("{\"level\": \"%s\", \"written\": %llu, \"dropped\": %llu, \"suppressed\": %llu, \"threads\": %zu}",
+                         log_level_name(log_threshold.load(std::memory_order_relaxed)),
+                         (unsigned long long)log_written.load(std::memory_order_relaxed),
+                         (unsigned long long)log_dropped.load(std::memory_order_relaxed),
+                         (unsigned long long)log_suppressed.load(std::memory_order_relaxed),
+                         log_shutdown.load(std::memory_order_acquire) ? (size_t)0 : log_writer().threads());
+}
@@ -0,0 +1,127 @@
+/**
+ * @file asynclog.hpp
+ * @brief Asynchronous backend for the meb_print.h macros: per-thread lock-free buffers drained by a background thread.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Built in with -DMEB_ASYNC_LOG. The calling thread formats its message into
+ * a slot of its own single-producer ring and returns; it never takes a lock
+ * or touches the console. The writer thread collects every ring, orders the
+ * lines by their CLOCK_MONOTONIC stamp and writes each stream in one call,
+ * so a slow console delays the log and not the caller. A full ring drops
+ * the line and counts it.
+ *
+ * Every call site keeps its own state: its level (from the colour or code
+ * the format starts with) and a rate limit of LOG_SITE_BURST lines per
+ * LOG_SITE_WINDOW_NS. Lines over the limit are counted and the next line
+ * that gets through says how many were suppressed. Fatal lines are written
+ * at once, after everything queued before them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+#include "meb_print.h"
+
+#define LOG_SITE_BURST 20               // lines per call site per window
+#define LOG_SITE_WINDOW_NS 1000000000ULL // rate limit window
+#define LOG_RING_SLOTS 64               // per thread, power of two
+#define LOG_LINE_MAX 448                // longer lines are cut
+
+enum LogLevel : int
+{
+    MEB_LOG_INFO = 0,
+    MEB_LOG_WARN = 1,  // YELLOW_FG
+    MEB_LOG_ERROR = 2, // RED_FG
+    MEB_LOG_FATAL = 3, // FATAL
+    MEB_LOG_OFF = 4,
+};
+
+/**
+ * @brief One logging call site; a static in the macro, constant-initialised.
+ *
+ */
+struct LogSite
+{
+    const char *file;
+    int line;
+    const char *func;
+    LogLevel level;
+    bool located;    // prefix the line with [file:line | func]
+    bool to_stdout;  // stdout instead of stderr
+    std::atomic<uint64_t> window; // start of the current rate limit window
+    std::atomic<uint32_t> count;  // lines in the window
+    std::atomic<uint32_t> suppressed; // lines dropped by the rate limit since the last one written
+
+    constexpr LogSite(const char *file, int line, const char *func, LogLevel level, bool located, bool to_stdout)
+        : file(file), line(line), func(func), level(level), located(located), to_stdout(to_stdout), window(0), count(0), suppressed(0)
+    {
+    }
+};
+
+constexpr bool log_prefix(const char *str, const char *prefix)
+{
+    while (*prefix != '\0')
+    {
+        if (*str++ != *prefix++)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Level of a message from the colour or code its format starts with.
+ *
+ */
+constexpr LogLevel log_level_of(const char *format)
+{
+    return log_prefix(format, FATAL) ? MEB_LOG_FATAL : log_prefix(format, RED_FG) ? MEB_LOG_ERROR
+                                                   : log_prefix(format, YELLOW_FG) ? MEB_LOG_WARN
+                                                                                   : MEB_LOG_INFO;
+}
+
+extern std::atomic<int> log_threshold;
+
+/**
+ * @brief Whether a site's level passes the runtime filter. Inline so filtered lines cost one load.
+ *
+ */
+static inline bool log_enabled(const LogSite &site)
+{
+    return site.level >= log_threshold.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Queue one line. Never blocks, except for fatal lines.
+ *
+ * @return Length of the formatted text, 0 if rate limited or dropped.
+ */
+int log_write(LogSite &site, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Write everything queued so far before returning.
+ *
+ */
+void log_flush();
+
+const char *log_level_name(int level);
+
+/**
+ * @brief Level by name ("info", "warn", "error", "fatal", "off").
+ *
+ * @return false if unknown.
+ */
+bool log_level_from_name(const char *name, int &level);
+
+/**
+ * @brief Level and counters as JSON.
+ *
+ */
+std::string log_stats();
@@ -0,0 +1,198 @@
+#include "bandwidth.hpp"
+#include "meb_print.h"
+#include "string_format.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+/**
+ * @brief Frame rate a camera sustains within limit.
+ *
+ */
+static double expected_fps(const LinkDemand &d, int64_t limit)
+{
+    if (d.frame_bytes <= 0)
+        return 0;
+    double fps = limit / (d.frame_bytes * LINK_OVERHEAD);
+    return d.framerate > 0 && d.framerate < fps ? d.framerate : fps;
+}
+
+bool share_link(int64_t budget, const std::vector<LinkDemand> &demands, std::vector<LinkShare> &shares)
+{
+    size_t n = demands.size();
+    shares.assign(n, LinkShare());
+    std::vector<double> need(n, 0), give(n, 0);
+    std::vector<size_t> order;
+    double left = (double)budget;
+    for (size_t i = 0; i < n; i++)
+    {
+        const LinkDemand &d = demands[i];
+        if (d.manual)
+        {
+            left -= d.limit;
+            continue;
+        }
+        double want = d.framerate > 0 ? d.frame_bytes * d.framerate * LINK_OVERHEAD : (double)d.limit_max;
+        need[i] = std::min(std::max(want, (double)d.limit_min), (double)d.limit_max);
+        order.push_back(i);
+    }
+    if (left < 0)
+        left = 0;
+    // max-min fair: the smallest demands are met first, each at most an equal share of what is left
+    std::sort(order.begin(), order.end(), [&need](size_t a, size_t b)
+              { return need[a] < need[b]; });
+    double wanted = 0;
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        size_t i = order[k];
+        give[i] = std::min(need[i], left / (order.size() - k));
+        left -= give[i];
+        wanted += need[i];
+    }
+    // whatever is left over becomes headroom, in proportion to the demand
+    double spare = left;
+    if (spare > 0 && wanted > 0)
+    {
+        for (size_t i : order)
+            give[i] = std::min(give[i] + spare * need[i] / wanted, (double)demands[i].limit_max);
+    }
+    int64_t total = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const LinkDemand &d = demands[i];
+        int64_t limit = d.manual ? d.limit : (int64_t)give[i];
+        if (!d.manual)
+            limit = std::min(std::max(limit, d.limit_min), d.limit_max);
+        shares[i].limit = limit;
+        shares[i].expected_fps = expected_fps(d, limit);
+        total += limit;
+    }
+    return total <= budget;
+}
+
+bool BandwidthScheduler::parse_budget(const char *spec)
+{
+    const char *eq = strchr(spec, '=');
+    const char *num = eq != nullptr ? eq + 1 : spec;
+    char *end = nullptr;
+    double mbps = strtod(num, &end);
+    if (end == num || *end != '\0' || !(mbps >= 0) || (eq != nullptr && eq == spec))
+        return false;
+    std::lock_guard<std::mutex> guard(lock);
+    if (eq == nullptr)
+        default_budget = (int64_t)(mbps * 1e6);
+    else
+        links[std::string(spec, eq - spec)].budget = (int64_t)(mbps * 1e6);
+    return true;
+}
+
+void BandwidthScheduler::add(const std::string &link, uint32_t camera, LinkMember *member)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Member m;
+    m.camera = camera;
+    m.member = member;
+    links[link].members.push_back(m);
+}
+
+VmbError_t BandwidthScheduler::set_budget(const std::string &link, int64_t bytes_per_s)
+{
+    if (bytes_per_s < 0)
+        return VmbErrorInvalidValue;
+    std::lock_guard<std::mutex> guard(lock);
+    if (link == "all")
+    {
+        default_budget = bytes_per_s;
+        for (auto &it : links)
+        {
+            if (it.second.budget < 0)
+                rebalance_link(it.first, it.second);
+        }
+        return VmbErrorSuccess;
+    }
+    auto it = links.find(link);
+    if (it == links.end())
+        return VmbErrorNotFound;
+    it->second.budget = bytes_per_s;
+    rebalance_link(it->first, it->second);
+    return VmbErrorSuccess;
+}
+
+void BandwidthScheduler::rebalance(const std::string &link)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = links.find(link);
+    if (it != links.end())
+        rebalance_link(it->first, it->second);
+}
+
+void BandwidthScheduler::rebalance_all()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &it : links)
+        rebalance_link(it.first, it.second);
+}
+
+void BandwidthScheduler::rebalance_link(const std::string &name, Link &link)
+{
+    int64_t budget = budget_of(link);
+    if (budget <= 0)
+    {
+        link.report = "null"; // not managed: limits stay where they are
+        return;
+    }
+    std::vector<LinkDemand> demands;
+    std::vector<LinkMember *> members;
+    for (const Member &m : link.members)
+    {
+        LinkDemand d;
+        d.camera = m.camera;
+        if (m.member->link_demand(d) != VmbErrorSuccess)
+            continue; // closed, or no throughput_limit (playback)
+        demands.push_back(d);
+        members.push_back(m.member);
+    }
+    std::vector<LinkShare> shares;
+    bool fits = share_link(budget, demands, shares);
+    if (!fits)
+        dbprintlf(YELLOW_FG "Link %s: the cameras' minimum throughput exceeds the budget of %lld bytes/s.", name.c_str(), (long long)budget);
+
+    int64_t total = 0;
+    std::string cams;
+    for (size_t i = 0; i < demands.size(); i++)
+    {
+        const LinkDemand &d = demands[i];
+        LinkShare &s = shares[i];
+        VmbError_t err = VmbErrorSuccess;
+        if (!d.manual && s.limit != d.limit)
+        {
+            int64_t limit = s.limit;
+            err = members[i]->set_link_limit(limit);
+            s.limit = err == VmbErrorSuccess ? limit : d.limit;
+            s.expected_fps = expected_fps(d, s.limit);
+        }
+        total += s.limit;
+        cams += string_format("%s\"%u\": {\"limit\": %lld, \"manual\": %s, \"target_fps\": %.3f, \"expected_fps\": %.3f, \"err\": %d}",
+                              i > 0 ? ", " : "", d.camera, (long long)s.limit, d.manual ? "true" : "false",
+                              d.framerate, s.expected_fps, err);
+    }
+    link.report = string_format("{\"allocated\": %lld, \"fits\": %s, \"cameras\": {%s}}",
+                                (long long)total, fits ? "true" : "false", cams.c_str());
+}
+
+std::string BandwidthScheduler::to_string()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::string reply = string_format("{\"default_budget\": %lld, \"links\": {", (long long)default_budget);
+    bool first = true;
+    for (const auto &it : links)
+    {
+        reply += string_format("%s\"%s\": {\"budget\": %lld, \"cameras\": %zu, \"shares\": %s}",
+                               first ? "" : ", ", it.first.c_str(), (long long)budget_of(it.second),
+                               it.second.members.size(), it.second.report.c_str());
+        first = false;
+    }
+    reply += "}}";
+    return reply;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file bandwidth.hpp
+ * @brief Shares a link budget between the cameras behind one interface by setting their throughput_limit.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Cameras on the same NIC or uplink form a link. Given the link's budget in
+ * bytes per second, each camera asks for frame size x target frame rate plus
+ * protocol overhead. The budget is shared max-min fairly: cameras asking for
+ * less than an equal share get what they ask for, the rest split what is
+ * left, and anything still unused is handed out in proportion to the demand
+ * as headroom. Limits are clamped to throughput_limit_range. A camera whose
+ * throughput_limit was set by hand keeps it, and it counts against the
+ * budget. Links without a budget are left alone.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "camerabackend.hpp"
+
+// Ethernet, IP, UDP and GVSP headers on 1500-byte packets, plus leader and trailer packets
+#define LINK_OVERHEAD 1.06
+
+/**
+ * @brief What one camera needs from its link.
+ *
+ */
+struct LinkDemand
+{
+    uint32_t camera = 0;     // camera ID, for the report
+    double frame_bytes = 0;  // bytes per frame at the current settings
+    double framerate = 0;    // frames per second wanted, 0 for as many as the link allows
+    int64_t limit_min = 0;   // throughput_limit_range, lower end
+    int64_t limit_max = 0;   // throughput_limit_range, upper end
+    int64_t limit = 0;       // current throughput_limit
+    bool manual = false;     // throughput_limit set by hand: not moved, counts against the budget
+};
+
+/**
+ * @brief What one camera gets.
+ *
+ */
+struct LinkShare
+{
+    int64_t limit = 0;       // throughput_limit to apply, bytes per second
+    double expected_fps = 0; // frame rate the camera can sustain within it
+};
+
+/**
+ * @brief Share budget between demands.
+ *
+ * @return false if the cameras' minimum limits alone exceed the budget; shares are still filled in.
+ */
+bool share_link(int64_t budget, const std::vector<LinkDemand> &demands, std::vector<LinkShare> &shares);
+
+/**
+ * @brief A camera on a link, as seen by the scheduler.
+ *
+ */
+class LinkMember
+{
+public:
+    virtual ~LinkMember()
+    {
+    }
+
+    /**
+     * @brief Current demand. Takes the camera's own lock.
+     *
+     */
+    virtual VmbError_t link_demand(LinkDemand &demand) = 0;
+
+    /**
+     * @brief Apply a throughput_limit chosen by the scheduler. Takes the camera's own lock.
+     *
+     * @param limit Limit to set; receives the limit read back.
+     */
+    virtual VmbError_t set_link_limit(int64_t &limit) = 0;
+};
+
+class BandwidthScheduler
+{
+    struct Member
+    {
+        uint32_t camera;
+        LinkMember *member;
+    };
+
+    struct Link
+    {
+        int64_t budget = -1; // bytes per second, 0 for none, -1 for the default
+        std::vector<Member> members;
+        std::string report = "null"; // outcome of the last rebalance, JSON
+    };
+
+    // taken before any camera lock, never while holding one
+    std::mutex lock;
+    std::map<std::string, Link> links;
+    int64_t default_budget = 0;
+
+    int64_t budget_of(const Link &link) const
+    {
+        return link.budget >= 0 ? link.budget : default_budget;
+    }
+
+    void rebalance_link(const std::string &name, Link &link);
+
+public:
+    /**
+     * @brief Budget from the command line: "MBPS" for every link or "LINK=MBPS" for one, in 10^6 bytes per second.
+     *
+     * @return false if malformed.
+     */
+    bool parse_budget(const char *spec);
+
+    /**
+     * @brief Put a camera on a link. Does not rebalance.
+     *
+     */
+    void add(const std::string &link, uint32_t camera, LinkMember *member);
+
+    /**
+     * @brief Set a link's budget and rebalance it.
+     *
+     * @param link Link name, or "all" for the default of every link without its own budget.
+     * @param bytes_per_s Budget, 0 to stop managing the link.
+     * @return VmbErrorNotFound if there is no such link.
+     */
+    VmbError_t set_budget(const std::string &link, int64_t bytes_per_s);
+
+    /**
+     * @brief Recompute and apply the limits of one link. Must not be called with a camera lock held.
+     *
+     */
+    void rebalance(const std::string &link);
+
+    /**
+     * @brief Rebalance every link.
+     *
+     */
+    void rebalance_all();
+
+    /**
+     * @brief Budgets and the outcome of the last rebalance of every link, as JSON.
+     *
+     */
+    std::string to_string();
+};
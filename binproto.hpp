@@ -0,0 +1,129 @@
+/**
+ * @file binproto.hpp
+ * @brief Fixed-layout binary request/reply encoding for single-camera commands.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A client may send, instead of the string frames [cmd_type][cam_id][command][args...],
+ * a single frame holding a BinRequest. The server answers a binary request
+ * with a single frame holding a BinReply and a string request with strings,
+ * so the encoding is chosen per message. Binary requests travel through the
+ * same ROUTER envelope and per-camera worker as string ones.
+ *
+ * Fields are in host byte order; client and server are expected to share
+ * endianness (little-endian on every platform we deploy to).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <czmq.h>
+
+#include "commandtable.hpp"
+
+// first byte 0x7f never starts a string command
+#define BIN_REQUEST_MAGIC 0x444d437fu // "\x7f" "CMD"
+#define BIN_REPLY_MAGIC 0x5045527fu   // "\x7f" "REP"
+
+enum BinOp : uint16_t
+{
+    BIN_GET = 1,
+    BIN_SET = 2,
+    BIN_START_CAPTURE = 3,
+    BIN_STOP_CAPTURE = 4,
+};
+
+enum BinFlags : uint16_t
+{
+    BIN_REFRESH = 1, // get: bypass the feature cache
+};
+
+/**
+ * @brief A typed feature value on the wire.
+ *
+ */
+struct BinValue
+{
+    uint8_t type;        // ValueType
+    uint8_t reserved[7]; // zero
+    int64_t i[2];        // Int, Bool (0/1), Size and Range
+    double d;            // Dbl
+    char s[FEATURE_STR_LEN]; // Str, NUL-terminated
+};
+
+struct BinRequest
+{
+    uint32_t magic;   // BIN_REQUEST_MAGIC
+    uint32_t camera;  // camera ID, as in `list`
+    uint16_t op;      // BinOp
+    uint16_t flags;   // BinFlags
+    int32_t command;  // CommandNames, for get/set
+    uint64_t tag;     // echoed in the reply, free for the client to use
+    BinValue value;   // set argument
+};
+
+struct BinReply
+{
+    uint32_t magic;   // BIN_REPLY_MAGIC
+    uint32_t camera;
+    uint16_t op;
+    uint16_t reserved;
+    int32_t command;
+    uint64_t tag;
+    int32_t err;      // VmbError_t
+    uint32_t reserved2;
+    BinValue value;   // get result, or the value in effect after a set
+};
+
+static_assert(sizeof(BinValue) == 96, "BinValue layout changed.");
+static_assert(sizeof(BinRequest) == 120, "BinRequest layout changed.");
+static_assert(sizeof(BinReply) == 128, "BinReply layout changed.");
+
+/**
+ * @brief Whether a frame holds a binary request.
+ *
+ */
+static inline bool is_bin_request(zframe_t *frame)
+{
+    if (frame == NULL || zframe_size(frame) != sizeof(BinRequest))
+        return false;
+    uint32_t magic;
+    memcpy(&magic, zframe_data(frame), sizeof(magic));
+    return magic == BIN_REQUEST_MAGIC;
+}
+
+/**
+ * @brief Camera ID of a frame for which is_bin_request() holds.
+ *
+ */
+static inline uint32_t bin_request_camera(zframe_t *frame)
+{
+    uint32_t camera;
+    memcpy(&camera, zframe_data(frame) + offsetof(BinRequest, camera), sizeof(camera));
+    return camera;
+}
+
+static inline void bin_to_value(const BinValue &in, FeatureValue &out)
+{
+    out.type = (ValueType)in.type;
+    out.i[0] = in.i[0];
+    out.i[1] = in.i[1];
+    out.b = in.i[0] != 0;
+    out.d = in.d;
+    memcpy(out.s, in.s, sizeof(out.s));
+    out.s[sizeof(out.s) - 1] = '\0';
+}
+
+static inline void value_to_bin(const FeatureValue &in, BinValue &out)
+{
+    memset(&out, 0, sizeof(out));
+    out.type = (uint8_t)in.type;
+    out.i[0] = in.type == ValueType::Bool ? in.b : in.i[0];
+    out.i[1] = in.i[1];
+    out.d = in.d;
+    memcpy(out.s, in.s, sizeof(out.s));
+}
@@ -0,0 +1,112 @@
+/**
+ * @file camerabackend.hpp
+ * @brief What ImageCam needs from a camera, and what the aDIO engine needs from a digital output port.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * ImageCam owns one CameraBackend and talks to it in feature numbers
+ * (CommandNames) and typed values. Implementations: AlliedBackend (a Vimba X
+ * camera), PlaybackFile (a recording replayed from disk) and SyntheticBackend
+ * (generated frames, no hardware). Frames are delivered through the SDK's
+ * callback signature whatever the backend, so everything downstream of
+ * ImageCam::Callback is shared.
+ *
+ * Backend calls are serialised by the owning camera's command lock, except
+ * that the frame callback runs on the backend's delivery thread.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <alliedcam.h>
+
+#include "commandtable.hpp"
+#include "framepool.hpp"
+
+enum CommandNames
+{
+    image_format = 100,       // string
+    sensor_bit_depth = 101,   // string
+    trigline = 102,           // string
+    trigline_src = 103,       // string
+    exposure_us = 104,        // double
+    acq_framerate = 105,      // double
+    acq_framerate_auto = 106, // bool
+    image_size = 200,         // special, two arguments, ints
+    image_ofst = 201,         // special, two arguments, ints
+    sensor_size = 202,
+    throughput_limit = 300,       // int
+    throughput_limit_range = 301, // special
+    adio_bit = 10,                // special
+    adio_pulse_us = 11,           // int, 0 toggles the bit every frame
+    preview_binning = 12,         // int, preview is 1/N of the frame each way: 1, 2, 4 or 8
+    preview_mode = 13,            // string, bin or decimate
+    preview_framerate = 14,       // double, previews per second at most, 0 for none
+    compression = 15,             // string, none or rice: encoding of frames published and recorded
+    throughput_auto = 16,         // bool, throughput_limit set by the bandwidth scheduler; setting throughput_limit clears it
+};
+
+class CameraBackend
+{
+public:
+    virtual ~CameraBackend()
+    {
+    }
+
+    /**
+     * @brief Short name of the implementation, e.g. "allied".
+     *
+     */
+    virtual const char *kind() const = 0;
+
+    /**
+     * @brief Read a feature from the camera.
+     *
+     * @return VmbErrorNotSupported if this backend does not have the feature.
+     */
+    virtual VmbError_t get_feature(long id, FeatureValue &value) = 0;
+
+    /**
+     * @brief Write a feature. value.type is the type listed in the command table.
+     *
+     * @return VmbErrorNotSupported if this backend does not have the feature.
+     */
+    virtual VmbError_t set_feature(long id, const FeatureValue &value) = 0;
+
+    /**
+     * @brief Size of the frames the camera delivers at its current settings.
+     *
+     */
+    virtual VmbError_t geometry(FrameGeometry &geom) = 0;
+
+    /**
+     * @brief Start delivering frames to callback, from a thread owned by the backend.
+     *
+     */
+    virtual VmbError_t start_capture(AlliedCaptureCallback callback, void *user_data) = 0;
+
+    /**
+     * @brief Stop delivering frames; once this returns the callback is not running and will not be called again.
+     *
+     */
+    virtual VmbError_t stop_capture() = 0;
+};
+
+class DIOPort
+{
+public:
+    virtual ~DIOPort()
+    {
+    }
+
+    virtual const char *kind() const = 0;
+
+    /**
+     * @brief Drive all eight bits of the output port.
+     *
+     * @return int Negative on failure.
+     */
+    virtual int write_port(uint8_t value) = 0;
+};
@@ -0,0 +1,257 @@
+/**
+ * @file cameraregistry.hpp
+ * @brief Flat, open-addressed table mapping camera IDs to cameras.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Camera IDs are StringHasher hashes of the camera ID string, so a camera
+ * keeps its ID across restarts and hosts. Two ID strings that hash to the
+ * same value are told apart by re-hashing the one claimed later with a
+ * salt, instead of silently sharing an ID. Which one that is must not depend
+ * on timing: cameras that come up in parallel claim their IDs up front with
+ * reserve(), in a fixed order, and are inserted whenever they are ready.
+ *
+ * Lookups are lock-free and may run concurrently with reserve() and
+ * insert(). Those must be serialised by the caller. A reserved camera is
+ * invisible to lookups until it is inserted. Entries are never removed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include "stringhasher.hpp"
+
+template <typename T>
+class CameraRegistry
+{
+    struct Entry
+    {
+        std::atomic<uint32_t> id; // 0 while the slot is empty
+        std::atomic<bool> ready;  // value is set; until then only the ID is claimed
+        std::string key;          // camera ID string
+        T value;
+    };
+
+    StringHasher hasher;
+    Entry *table = nullptr;
+    uint32_t mask = 0;
+    uint32_t *order = nullptr;     // slot indices in insertion order
+    std::atomic<uint32_t> count;   // inserted
+    uint32_t claimed = 0;          // reserved or inserted; writer side only
+
+    uint32_t hash(const std::string &key, int salt) const
+    {
+        uint32_t h = salt == 0 ? hasher.get_hash(key) : hasher.get_hash(key + "#" + std::to_string(salt));
+        return h == 0 ? 1 : h; // 0 marks an empty slot
+    }
+
+    /**
+     * @brief Slot holding id, inserted or only reserved.
+     *
+     */
+    const Entry *find_entry(uint32_t id) const
+    {
+        if (id == 0)
+            return nullptr;
+        for (uint32_t i = id & mask, n = 0; n <= mask; i = (i + 1) & mask, n++)
+        {
+            uint32_t cur = table[i].id.load(std::memory_order_acquire);
+            if (cur == id)
+                return &table[i];
+            if (cur == 0)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Slot of a camera ID string, inserted or only reserved.
+     *
+     */
+    Entry *find_key(const std::string &key)
+    {
+        for (int salt = 0; salt <= (int)mask; salt++)
+        {
+            const Entry *e = find_entry(hash(key, salt));
+            if (e == nullptr)
+                return nullptr;
+            if (e->key == key)
+                return const_cast<Entry *>(e);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Claim an ID for key in an empty slot.
+     *
+     */
+    Entry *claim(const std::string &key)
+    {
+        if (claimed >= (mask + 1) / 2)
+            throw std::length_error("Camera registry is full.");
+        for (int salt = 0;; salt++)
+        {
+            uint32_t id = hash(key, salt);
+            if (find_entry(id) != nullptr)
+                continue; // collision with a different camera: try the next salt
+            uint32_t i = id & mask;
+            while (table[i].id.load(std::memory_order_relaxed) != 0)
+                i = (i + 1) & mask;
+            table[i].key = key;
+            table[i].id.store(id, std::memory_order_release);
+            claimed++;
+            return &table[i];
+        }
+    }
+
+public:
+    /**
+     * @brief Create a registry for up to capacity cameras.
+     *
+     */
+    CameraRegistry(uint32_t capacity)
+    {
+        uint32_t slots = 16;
+        while (slots < 2 * capacity) // keep the load factor at or below one half
+            slots <<= 1;
+        table = new Entry[slots];
+        for (uint32_t i = 0; i < slots; i++)
+        {
+            table[i].id.store(0, std::memory_order_relaxed);
+            table[i].ready.store(false, std::memory_order_relaxed);
+        }
+        mask = slots - 1;
+        order = new uint32_t[slots / 2];
+        count.store(0, std::memory_order_release);
+    }
+
+    ~CameraRegistry()
+    {
+        delete[] table;
+        delete[] order;
+    }
+
+    CameraRegistry(const CameraRegistry &) = delete;
+    CameraRegistry &operator=(const CameraRegistry &) = delete;
+
+    /**
+     * @brief Claim the ID of a camera that is inserted later. Reserving every camera in the same order makes the IDs independent of when each one is inserted.
+     *
+     * @param key Camera ID string.
+     * @return uint32_t Camera ID that insert() will hand out.
+     * @throws std::length_error when full, std::invalid_argument if key is already reserved or registered.
+     */
+    uint32_t reserve(const std::string &key)
+    {
+        if (find_key(key) != nullptr)
+            throw std::invalid_argument("Camera already registered.");
+        return claim(key)->id.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Register a camera, under its reserved ID if it has one.
+     *
+     * @param key Camera ID string.
+     * @param value Stored alongside; must not change after insertion.
+     * @return uint32_t Camera ID handed to clients.
+     * @throws std::length_error when full, std::invalid_argument if key is already registered.
+     */
+    uint32_t insert(const std::string &key, const T &value)
+    {
+        Entry *e = find_key(key);
+        if (e != nullptr && e->ready.load(std::memory_order_relaxed))
+            throw std::invalid_argument("Camera already registered.");
+        if (e == nullptr)
+            e = claim(key);
+        uint32_t n = count.load(std::memory_order_relaxed);
+        e->value = value;
+        e->ready.store(true, std::memory_order_release);
+        order[n] = (uint32_t)(e - table);
+        count.store(n + 1, std::memory_order_release);
+        return e->id.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Look up a camera by the ID handed to clients.
+     *
+     * @return const T* nullptr if unknown.
+     */
+    const T *find(uint32_t id) const
+    {
+        const Entry *e = find_entry(id);
+        return e != nullptr && e->ready.load(std::memory_order_acquire) ? &e->value : nullptr;
+    }
+
+    /**
+     * @brief Look up a camera by what a client sent: the decimal camera ID or the camera ID string.
+     *
+     * @return const T* nullptr if unknown.
+     */
+    const T *find(const char *cam_id) const
+    {
+        if (cam_id == nullptr || cam_id[0] == '\0')
+            return nullptr;
+        char *end = nullptr;
+        unsigned long id = strtoul(cam_id, &end, 10);
+        if (*end == '\0' && id <= UINT32_MAX)
+        {
+            const T *val = find((uint32_t)id);
+            if (val != nullptr)
+                return val;
+        }
+        // camera ID string: walk the salts the same way insert() did
+        for (int salt = 0; salt <= (int)mask; salt++)
+        {
+            const Entry *e = find_entry(hash(cam_id, salt));
+            if (e == nullptr)
+                return nullptr;
+            if (e->key == cam_id)
+                return e->ready.load(std::memory_order_acquire) ? &e->value : nullptr;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Number of registered cameras. Entries [0, size()) can be read with id_at()/at().
+     *
+     */
+    uint32_t size() const
+    {
+        return count.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief ID of the idx-th camera, in registration order.
+     *
+     */
+    uint32_t id_at(uint32_t idx) const
+    {
+        return table[order[idx]].id.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Value of the idx-th camera, in registration order.
+     *
+     */
+    const T &at(uint32_t idx) const
+    {
+        return table[order[idx]].value;
+    }
+
+    /**
+     * @brief Camera ID string of the idx-th camera, in registration order.
+     *
+     */
+    const std::string &key_at(uint32_t idx) const
+    {
+        return table[order[idx]].key;
+    }
+};
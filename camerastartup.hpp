@@ -0,0 +1,342 @@
+/**
+ * @file camerastartup.hpp
+ * @brief Opens and initialises cameras on a pool of threads while the server is already answering commands.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Opening a camera can take seconds (a GigE camera that does not answer costs
+ * the full open timeout), and reading its features back is one SDK call per
+ * feature. Done one camera after the other this adds up over the whole rig
+ * before the first command is served. Here every camera is a job of two
+ * stages, open and init, run on up to STARTUP_MAX_PARALLEL threads. A camera
+ * that is ready is queued for the command loop, which is woken through an
+ * inproc socket and registers it itself, so the camera registry keeps a
+ * single writer. Every stage is timed for the startup report.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <czmq.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "camerabackend.hpp"
+#include "capturestats.hpp"
+#include "meb_print.h"
+#include "string_format.hpp"
+
+#define STARTUP_MAX_PARALLEL 16 // cameras opened at the same time
+#define STARTUP_ENDPOINT "inproc://camera-startup"
+
+template <typename T>
+class CameraStartup
+{
+public:
+    /**
+     * @brief Open the camera. Throws if it cannot be opened; std::runtime_error is taken as already reported.
+     *
+     */
+    typedef std::function<CameraBackend *()> OpenFn;
+
+    /**
+     * @brief Take over the open camera and bring it up. Must not touch state shared with other cameras, and must free the backend if it throws.
+     *
+     */
+    typedef std::function<T *(CameraBackend *)> InitFn;
+
+private:
+    struct Job
+    {
+        std::string idstr;
+        OpenFn open;
+        InitFn init;
+        // mono_ns() at the end of each stage, 0 until then
+        std::atomic<uint64_t> open_start_ns;
+        std::atomic<uint64_t> open_ns;
+        std::atomic<uint64_t> init_ns;
+        std::atomic<uint64_t> ready_ns; // registered by the command loop
+        std::atomic<bool> failed;
+    };
+
+    std::vector<std::unique_ptr<Job>> jobs;
+    std::atomic<size_t> next_job;
+    std::atomic<size_t> remaining; // jobs not yet registered or failed
+    std::atomic<bool> stopping;
+    std::mutex ready_lock;
+    std::vector<std::pair<size_t, T *>> ready_queue;
+    zsock_t *wakeup = nullptr;         // PULL, readable when a camera is ready
+    std::vector<zsock_t *> notifiers;  // PUSH, one per thread
+    std::vector<std::thread> threads;
+    uint64_t start_ns = 0;
+    uint64_t done_ns = 0;
+
+    void finish_one()
+    {
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            done_ns = mono_ns();
+    }
+
+    void fail(Job &job, zsock_t *notifier)
+    {
+        if (job.open_ns.load(std::memory_order_relaxed) == 0)
+            job.open_ns.store(mono_ns(), std::memory_order_relaxed);
+        job.failed.store(true, std::memory_order_release);
+        zstr_send(notifier, "failed");
+    }
+
+    void run(zsock_t *notifier)
+    {
+        for (;;)
+        {
+            if (stopping.load(std::memory_order_acquire))
+                return;
+            size_t idx = next_job.fetch_add(1, std::memory_order_relaxed);
+            if (idx >= jobs.size())
+                return;
+            Job &job = *jobs[idx];
+            job.open_start_ns.store(mono_ns(), std::memory_order_relaxed);
+            // whatever one camera throws must not take the others down with it
+            CameraBackend *backend = nullptr;
+            try
+            {
+                backend = job.open();
+            }
+            catch (const std::runtime_error &e)
+            {
+                fail(job, notifier); // already reported
+                continue;
+            }
+            catch (const std::exception &e)
+            {
+                dbprintlf(RED_FG "Could not open camera %s: %s", job.idstr.c_str(), e.what());
+                fail(job, notifier);
+                continue;
+            }
+            job.open_ns.store(mono_ns(), std::memory_order_relaxed);
+            T *cam;
+            try
+            {
+                cam = job.init(backend); // owns backend from here on, also when it throws
+            }
+            catch (const std::exception &e)
+            {
+                dbprintlf(RED_FG "Could not initialise camera %s: %s", job.idstr.c_str(), e.what());
+                fail(job, notifier);
+                continue;
+            }
+            job.init_ns.store(mono_ns(), std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> guard(ready_lock);
+                ready_queue.push_back(std::make_pair(idx, cam));
+            }
+            zstr_send(notifier, "ready");
+        }
+    }
+
+public:
+    CameraStartup()
+    {
+        next_job = 0;
+        remaining = 0;
+        stopping = false;
+        wakeup = zsock_new_pull("@" STARTUP_ENDPOINT);
+        if (wakeup == nullptr)
+            throw std::runtime_error("Could not bind " STARTUP_ENDPOINT ".");
+    }
+
+    /**
+     * @brief Stops handing out jobs, waits for the cameras being opened and closes those never taken.
+     *
+     */
+    ~CameraStartup()
+    {
+        stopping = true;
+        for (std::thread &thr : threads)
+            thr.join();
+        for (auto &r : ready_queue)
+            delete r.second;
+        for (zsock_t *sock : notifiers)
+            zsock_destroy(&sock);
+        zsock_destroy(&wakeup);
+    }
+
+    CameraStartup(const CameraStartup &) = delete;
+    CameraStartup &operator=(const CameraStartup &) = delete;
+
+    /**
+     * @brief Queue a camera. Only before start().
+     *
+     */
+    void add(const std::string &idstr, OpenFn open, InitFn init)
+    {
+        std::unique_ptr<Job> job(new Job());
+        job->idstr = idstr;
+        job->open = std::move(open);
+        job->init = std::move(init);
+        job->open_start_ns = 0;
+        job->open_ns = 0;
+        job->init_ns = 0;
+        job->ready_ns = 0;
+        job->failed = false;
+        jobs.push_back(std::move(job));
+    }
+
+    /**
+     * @brief Start the threads; returns at once.
+     *
+     */
+    void start()
+    {
+        start_ns = mono_ns();
+        remaining = jobs.size();
+        if (jobs.empty())
+            done_ns = start_ns;
+        size_t nthreads = jobs.size() < STARTUP_MAX_PARALLEL ? jobs.size() : STARTUP_MAX_PARALLEL;
+        for (size_t i = 0; i < nthreads; i++)
+        {
+            zsock_t *notifier = zsock_new_push(">" STARTUP_ENDPOINT);
+            assert(notifier);
+            notifiers.push_back(notifier);
+            threads.emplace_back(&CameraStartup::run, this, notifier);
+        }
+    }
+
+    /**
+     * @brief Readable whenever a camera is ready or has failed; add it to the command loop's poller.
+     *
+     */
+    zsock_t *socket() const
+    {
+        return wakeup;
+    }
+
+    /**
+     * @brief Cameras that are ready, in the order they got there. The caller registers them and calls registered().
+     *
+     * Consumes one wake-up from socket().
+     */
+    std::vector<std::pair<size_t, T *>> take()
+    {
+        char *note = zstr_recv(wakeup);
+        zstr_free(&note);
+        std::vector<std::pair<size_t, T *>> out;
+        std::lock_guard<std::mutex> guard(ready_lock);
+        out.swap(ready_queue);
+        // failures are only counted here so that finished() is decided by the command loop alone
+        for (size_t idx = 0; idx < jobs.size(); idx++)
+        {
+            Job &job = *jobs[idx];
+            if (job.failed.load(std::memory_order_acquire) && job.ready_ns.load(std::memory_order_relaxed) == 0)
+            {
+                job.ready_ns.store(mono_ns(), std::memory_order_relaxed);
+                finish_one();
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Mark job idx as in the registry.
+     *
+     */
+    void registered(size_t idx)
+    {
+        jobs[idx]->ready_ns.store(mono_ns(), std::memory_order_relaxed);
+        finish_one();
+    }
+
+    /**
+     * @brief Camera ID string of job idx.
+     *
+     */
+    const std::string &idstr(size_t idx) const
+    {
+        return jobs[idx]->idstr;
+    }
+
+    /**
+     * @brief Seconds spent opening and initialising job idx, and since start() when it was registered.
+     *
+     */
+    void timing(size_t idx, double &open_s, double &init_s, double &ready_s) const
+    {
+        const Job &job = *jobs[idx];
+        uint64_t t0 = job.open_start_ns.load(std::memory_order_relaxed);
+        uint64_t t1 = job.open_ns.load(std::memory_order_relaxed);
+        uint64_t t2 = job.init_ns.load(std::memory_order_relaxed);
+        uint64_t t3 = job.ready_ns.load(std::memory_order_relaxed);
+        open_s = t1 > t0 ? (t1 - t0) / 1e9 : 0;
+        init_s = t2 > t1 ? (t2 - t1) / 1e9 : 0;
+        ready_s = t3 > start_ns ? (t3 - start_ns) / 1e9 : 0;
+    }
+
+    /**
+     * @brief Number of cameras queued.
+     *
+     */
+    size_t size() const
+    {
+        return jobs.size();
+    }
+
+    /**
+     * @brief Seconds since start(), up to when the last camera was registered or failed.
+     *
+     */
+    double elapsed() const
+    {
+        return ((finished() ? done_ns : mono_ns()) - start_ns) / 1e9;
+    }
+
+    /**
+     * @brief Every camera is registered or has failed.
+     *
+     */
+    bool finished() const
+    {
+        return remaining.load(std::memory_order_acquire) == 0;
+    }
+
+    /**
+     * @brief Per camera stages and times as JSON; callable at any time from the command loop.
+     *
+     * wait_s is the time a camera was queued behind others, ready_s is counted from start().
+     */
+    std::string to_string() const
+    {
+        uint64_t now = mono_ns();
+        std::string out = string_format("{\"finished\": %s, \"elapsed_s\": %.3f, \"pending\": %zu, \"cameras\": [",
+                                        finished() ? "true" : "false", elapsed(), remaining.load(std::memory_order_relaxed));
+        for (size_t idx = 0; idx < jobs.size(); idx++)
+        {
+            const Job &job = *jobs[idx];
+            uint64_t t0 = job.open_start_ns.load(std::memory_order_relaxed);
+            uint64_t t1 = job.open_ns.load(std::memory_order_relaxed);
+            uint64_t t2 = job.init_ns.load(std::memory_order_relaxed);
+            uint64_t t3 = job.ready_ns.load(std::memory_order_relaxed);
+            const char *state = job.failed.load(std::memory_order_acquire) ? "failed" : t3 != 0 ? "ready"
+                                                                                    : t2 != 0   ? "registering"
+                                                                                    : t1 != 0   ? "initialising"
+                                                                                    : t0 != 0   ? "opening"
+                                                                                                : "queued";
+            double open_s, init_s, ready_s;
+            timing(idx, open_s, init_s, ready_s);
+            out += string_format("%s{\"camera\": \"%s\", \"state\": \"%s\", \"wait_s\": %.3f, \"open_s\": %.3f, \"init_s\": %.3f, \"ready_s\": %.3f}",
+                                 idx > 0 ? ", " : "", job.idstr.c_str(), state, ((t0 != 0 ? t0 : now) - start_ns) / 1e9,
+                                 t0 != 0 && t1 == 0 ? (now - t0) / 1e9 : open_s, t1 != 0 && t2 == 0 && !job.failed.load(std::memory_order_relaxed) ? (now - t1) / 1e9 : init_s, ready_s);
+        }
+        out += "]}";
+        return out;
+    }
+};
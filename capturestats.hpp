@@ -0,0 +1,280 @@
+/**
+ * @file capturestats.hpp
+ * @brief Lock-free per-camera capture statistics, updated from the frame callback.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The callback is the only writer of the running state (last frame ID, last
+ * arrival time); everything readers look at is a relaxed atomic, so reading
+ * the statistics from the command loop never stalls the callback. A reset
+ * from another thread clears the counters and leaves a flag that the
+ * callback consumes before its next frame, so the running state is never
+ * touched by two threads.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+
+#include "string_format.hpp"
+#include "framering.hpp"
+
+/**
+ * @brief Monotonic clock in nanoseconds.
+ *
+ */
+static inline uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Log-linear histogram of nanosecond durations (8 sub-buckets per power of two, ~12% resolution).
+ *
+ */
+class LatencyHistogram
+{
+public:
+    static const int nbuckets = 16 + 48 * 8;
+
+private:
+    std::atomic<uint64_t> buckets[nbuckets];
+
+    static int bucket_of(uint64_t v)
+    {
+        if (v < 16)
+            return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        int idx = 16 + (msb - 4) * 8 + (int)((v >> (msb - 3)) & 7);
+        return idx < nbuckets ? idx : nbuckets - 1;
+    }
+
+    static uint64_t bucket_value(int idx)
+    {
+        if (idx < 16)
+            return idx;
+        int msb = (idx - 16) / 8 + 4;
+        uint64_t sub = (idx - 16) % 8;
+        // middle of the bucket
+        return ((8 + sub) << (msb - 3)) + ((uint64_t)1 << (msb - 4));
+    }
+
+public:
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < nbuckets; i++)
+            buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns)
+    {
+        buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Add another histogram's samples to this one.
+     *
+     */
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < nbuckets; i++)
+            buckets[i].fetch_add(other.buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    uint64_t count() const
+    {
+        uint64_t n = 0;
+        for (int i = 0; i < nbuckets; i++)
+            n += buckets[i].load(std::memory_order_relaxed);
+        return n;
+    }
+
+    /**
+     * @brief Approximate value at quantile q (0 < q <= 1), 0 if empty.
+     *
+     */
+    uint64_t percentile(double q) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+            return 0;
+        uint64_t target = (uint64_t)(q * total);
+        if (target == 0)
+            target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < nbuckets; i++)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+                return bucket_value(i);
+        }
+        return bucket_value(nbuckets - 1);
+    }
+};
+
+class CaptureStats
+{
+    // callback-private running state
+    uint64_t last_id = 0;
+    uint64_t last_arrival = 0;
+    bool have_last = false;
+    std::atomic<bool> reset_requested; // set by reset(), consumed by the callback
+
+    /**
+     * @brief Forget the previous frame if a reset came in since the last one. Callback only.
+     *
+     */
+    void consume_reset()
+    {
+        if (reset_requested.load(std::memory_order_relaxed) && reset_requested.exchange(false, std::memory_order_acquire))
+            have_last = false;
+    }
+
+public:
+    std::atomic<uint64_t> frames;     // frames delivered by the SDK
+    std::atomic<uint64_t> bytes;      // pixel data delivered by the SDK
+    std::atomic<uint64_t> incomplete; // frames delivered with receiveStatus != complete
+    std::atomic<uint64_t> dropped;    // frames missing from the frame ID sequence
+    std::atomic<uint64_t> first_ns;   // arrival of the first frame (CLOCK_MONOTONIC)
+    std::atomic<uint64_t> last_ns;    // arrival of the latest frame (CLOCK_MONOTONIC)
+    std::atomic<uint64_t> interval_sum_us;
+    std::atomic<uint64_t> interval_sumsq_us;
+    LatencyHistogram interval; // inter-arrival time
+    LatencyHistogram callback; // time spent inside the callback
+    // the same counts since the camera was opened; never reset, for monotonic metrics
+    std::atomic<uint64_t> frames_total;
+    std::atomic<uint64_t> bytes_total;
+    std::atomic<uint64_t> incomplete_total;
+    std::atomic<uint64_t> dropped_total;
+
+    CaptureStats()
+    {
+        frames_total = 0;
+        bytes_total = 0;
+        incomplete_total = 0;
+        dropped_total = 0;
+        reset();
+    }
+
+    /**
+     * @brief Clear all counters except the *_total ones. Safe while capturing: a frame being recorded at that moment may still be counted.
+     *
+     */
+    void reset()
+    {
+        frames = 0;
+        bytes = 0;
+        incomplete = 0;
+        dropped = 0;
+        first_ns = 0;
+        last_ns = 0;
+        interval_sum_us = 0;
+        interval_sumsq_us = 0;
+        interval.reset();
+        callback.reset();
+        reset_requested.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief FRAME_FLAG_GAP / FRAME_FLAG_OUT_OF_ORDER for a frame about to be recorded. Called from the capture callback only, before update().
+     *
+     */
+    uint32_t sequence_flags(uint64_t frame_id)
+    {
+        consume_reset();
+        if (!have_last)
+            return 0;
+        if (frame_id <= last_id)
+            return FRAME_FLAG_OUT_OF_ORDER;
+        return frame_id > last_id + 1 ? FRAME_FLAG_GAP : 0;
+    }
+
+    /**
+     * @brief Record one frame. Called from the capture callback only.
+     *
+     * @param frame_id Camera frame ID.
+     * @param complete Whether the frame was received completely.
+     * @param size Bytes of pixel data.
+     * @param entry_ns mono_ns() at callback entry.
+     * @param exit_ns mono_ns() when the callback finished handling the frame.
+     */
+    void update(uint64_t frame_id, bool complete, size_t size, uint64_t entry_ns, uint64_t exit_ns)
+    {
+        consume_reset();
+        frames.fetch_add(1, std::memory_order_relaxed);
+        frames_total.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        bytes_total.fetch_add(size, std::memory_order_relaxed);
+        if (!complete)
+        {
+            incomplete.fetch_add(1, std::memory_order_relaxed);
+            incomplete_total.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (have_last)
+        {
+            if (frame_id > last_id + 1)
+            {
+                dropped.fetch_add(frame_id - last_id - 1, std::memory_order_relaxed);
+                dropped_total.fetch_add(frame_id - last_id - 1, std::memory_order_relaxed);
+            }
+            uint64_t dt = entry_ns - last_arrival;
+            uint64_t dt_us = dt / 1000;
+            interval.record(dt);
+            interval_sum_us.fetch_add(dt_us, std::memory_order_relaxed);
+            interval_sumsq_us.fetch_add(dt_us * dt_us, std::memory_order_relaxed);
+        }
+        else
+        {
+            first_ns.store(entry_ns, std::memory_order_relaxed);
+            have_last = true;
+        }
+        last_id = frame_id;
+        last_arrival = entry_ns;
+        last_ns.store(entry_ns, std::memory_order_relaxed);
+        callback.record(exit_ns - entry_ns);
+    }
+
+    /**
+     * @brief Render the statistics as a JSON object.
+     *
+     */
+    std::string to_string() const
+    {
+        uint64_t n = frames.load(std::memory_order_relaxed);
+        uint64_t t0 = first_ns.load(std::memory_order_relaxed);
+        uint64_t t1 = last_ns.load(std::memory_order_relaxed);
+        uint64_t nint = interval.count();
+        double fps = 0, mean_us = 0, jitter_us = 0;
+        if (n > 1 && t1 > t0)
+            fps = (n - 1) * 1e9 / (t1 - t0);
+        if (nint > 0)
+        {
+            mean_us = (double)interval_sum_us.load(std::memory_order_relaxed) / nint;
+            double var = (double)interval_sumsq_us.load(std::memory_order_relaxed) / nint - mean_us * mean_us;
+            jitter_us = var > 0 ? sqrt(var) : 0;
+        }
+        return string_format("{\"frames\": %llu, \"bytes\": %llu, \"incomplete\": %llu, \"dropped\": %llu, \"fps\": %.3f, "
+                             "\"interval_us\": {\"mean\": %.1f, \"jitter\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f}, "
+                             "\"callback_us\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f}}",
+                             (unsigned long long)n,
+                             (unsigned long long)bytes.load(std::memory_order_relaxed),
+                             (unsigned long long)incomplete.load(std::memory_order_relaxed),
+                             (unsigned long long)dropped.load(std::memory_order_relaxed),
+                             fps, mean_us, jitter_us,
+                             interval.percentile(0.5) / 1e3, interval.percentile(0.99) / 1e3, interval.percentile(0.999) / 1e3,
+                             callback.percentile(0.5) / 1e3, callback.percentile(0.99) / 1e3, callback.percentile(0.999) / 1e3);
+    }
+};
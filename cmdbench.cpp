@@ -0,0 +1,609 @@
+/**
+ * @file cmdbench.cpp
+ * @brief Load generator for the command path: drives a running capture server and reports latency per command.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Each client thread owns a DEALER socket and keeps one request in flight,
+ * so latency is the full round trip through ZMQ, the server's dispatch, the
+ * camera worker and the camera. Commands are drawn from a weighted mix:
+ *
+ *   list   top-level `list`
+ *   get    string `get` of every gettable feature in turn
+ *   set    string `set` of every settable feature, to the value it already has
+ *   bin    binary get (binproto.hpp) of every gettable feature in turn
+ *   batch  one `batch` setting every settable feature, like a rig configuration
+ *
+ * Sets write back the value read at startup, so a run leaves the camera as it
+ * found it. Features come from the server's `commands` reply, so the
+ * benchmark follows the command table without being rebuilt.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <czmq.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "meb_print.h"
+#include "string_format.hpp"
+#include "capturestats.hpp"
+#include "commandtable.hpp"
+#include "binproto.hpp"
+
+enum OpKind
+{
+    OP_LIST,
+    OP_GET,
+    OP_SET,
+    OP_BIN,
+    OP_BATCH,
+    OP_KINDS
+};
+
+static const char *op_kind_names[OP_KINDS] = {"list", "get", "set", "bin", "batch"};
+
+struct Feature
+{
+    long id;
+    std::string name;
+    ValueType type = ValueType::None;
+    bool get = false;
+    bool set = false;
+    std::vector<std::string> set_args; // current value, as set arguments
+};
+
+struct BenchOp
+{
+    OpKind kind;
+    std::string label;
+    const Feature *feature = nullptr;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+
+    BenchOp(OpKind kind, const std::string &label, const Feature *feature = nullptr)
+    {
+        this->kind = kind;
+        this->label = label;
+        this->feature = feature;
+        count = 0;
+        errors = 0;
+    }
+};
+
+struct BenchConfig
+{
+    std::string endpoint = "tcp://localhost:5555";
+    std::string camera;          // decimal camera ID
+    int clients = 1;
+    double duration_s = 10;
+    int weights[OP_KINDS] = {1, 8, 1, 0, 0};
+    bool refresh = false;        // gets bypass the feature cache
+    int timeout_ms = 5000;
+};
+
+static std::atomic<bool> stop_clients{false};
+
+/**
+ * @brief Send one request on a DEALER socket and wait for its reply.
+ *
+ * @return zmsg_t* Reply without the empty delimiter, NULL on timeout.
+ */
+static zmsg_t *round_trip(zsock_t *sock, zmsg_t *request)
+{
+    zmsg_pushmem(request, NULL, 0); // the ROUTER expects [identity][delimiter][...]
+    if (zmsg_send(&request, sock) != 0)
+    {
+        zmsg_destroy(&request);
+        return NULL;
+    }
+    zmsg_t *reply = zmsg_recv(sock);
+    if (reply == NULL)
+        return NULL;
+    zframe_t *delimiter = zmsg_pop(reply);
+    zframe_destroy(&delimiter);
+    return reply;
+}
+
+/**
+ * @brief Whether a string reply ends in ACK.
+ *
+ */
+static bool reply_ok(zmsg_t *reply)
+{
+    zframe_t *last = zmsg_last(reply);
+    return last != NULL && zframe_streq(last, "ACK");
+}
+
+/**
+ * @brief Reply frame of a string reply ([command][camera ID][command type][reply][error code][ACK/NAC]).
+ *
+ */
+static std::string reply_value(zmsg_t *reply)
+{
+    size_t n = zmsg_size(reply);
+    if (n < 3)
+        return "";
+    zframe_t *frame = zmsg_first(reply);
+    for (size_t i = 0; i < n - 3; i++)
+        frame = zmsg_next(reply);
+    char *str = zframe_strdup(frame);
+    std::string out = str;
+    free(str);
+    return out;
+}
+
+static zmsg_t *simple_request(zsock_t *sock, const char *cmd_type)
+{
+    zmsg_t *request = zmsg_new();
+    zmsg_addstr(request, cmd_type);
+    return round_trip(sock, request);
+}
+
+/**
+ * @brief Camera IDs from a `list` reply ("[id, id, ").
+ *
+ */
+static std::vector<std::string> parse_list(const std::string &reply)
+{
+    std::vector<std::string> ids;
+    const char *p = reply.c_str();
+    while (*p)
+    {
+        if (*p >= '0' && *p <= '9')
+        {
+            char *end;
+            unsigned long id = strtoul(p, &end, 10);
+            ids.push_back(std::to_string(id));
+            p = end;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return ids;
+}
+
+static ValueType value_type_from_name(const std::string &name)
+{
+    for (int t = (int)ValueType::None; t <= (int)ValueType::Range; t++)
+    {
+        if (name == value_type_name((ValueType)t))
+            return (ValueType)t;
+    }
+    return ValueType::None;
+}
+
+/**
+ * @brief Features from a `commands` reply, a JSON array of flat objects.
+ *
+ */
+static std::vector<Feature> parse_commands(const std::string &reply)
+{
+    std::vector<Feature> features;
+    size_t pos = 0;
+    while ((pos = reply.find('{', pos)) != std::string::npos)
+    {
+        size_t end = reply.find('}', pos);
+        if (end == std::string::npos)
+            break;
+        std::string obj = reply.substr(pos, end - pos);
+        pos = end;
+        Feature f;
+        size_t at = obj.find("\"id\": ");
+        if (at == std::string::npos)
+            continue;
+        f.id = atol(obj.c_str() + at + 6);
+        at = obj.find("\"name\": \"");
+        if (at != std::string::npos)
+            f.name = obj.substr(at + 9, obj.find('"', at + 9) - at - 9);
+        at = obj.find("\"type\": \"");
+        if (at != std::string::npos)
+            f.type = value_type_from_name(obj.substr(at + 9, obj.find('"', at + 9) - at - 9));
+        f.get = obj.find("\"get\": true") != std::string::npos;
+        f.set = obj.find("\"set\": true") != std::string::npos;
+        features.push_back(f);
+    }
+    return features;
+}
+
+/**
+ * @brief Read a feature's current value and turn it into set arguments.
+ *
+ */
+static bool current_value(zsock_t *sock, const std::string &camera, Feature &f)
+{
+    BinRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = BIN_REQUEST_MAGIC;
+    req.camera = strtoul(camera.c_str(), NULL, 10);
+    req.op = BIN_GET;
+    req.flags = BIN_REFRESH;
+    req.command = f.id;
+    zmsg_t *request = zmsg_new();
+    zmsg_addmem(request, &req, sizeof(req));
+    zmsg_t *reply = round_trip(sock, request);
+    if (reply == NULL)
+        return false;
+    zframe_t *frame = zmsg_first(reply);
+    BinReply rep;
+    bool ok = frame != NULL && zframe_size(frame) == sizeof(rep);
+    if (ok)
+    {
+        memcpy(&rep, zframe_data(frame), sizeof(rep));
+        ok = rep.magic == BIN_REPLY_MAGIC && rep.err == VmbErrorSuccess;
+    }
+    zmsg_destroy(&reply);
+    if (!ok)
+        return false;
+    FeatureValue val;
+    bin_to_value(rep.value, val);
+    f.set_args.clear();
+    switch (f.type)
+    {
+    case ValueType::Str:
+        f.set_args.push_back(val.s);
+        break;
+    case ValueType::Int:
+        f.set_args.push_back(std::to_string(val.i[0]));
+        break;
+    case ValueType::Dbl:
+        f.set_args.push_back(string_format("%.17g", val.d));
+        break;
+    case ValueType::Bool:
+        f.set_args.push_back(val.b ? "True" : "False");
+        break;
+    case ValueType::Size:
+    case ValueType::Range:
+        f.set_args.push_back(std::to_string(val.i[0]));
+        f.set_args.push_back(std::to_string(val.i[1]));
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+static void add_set_frames(zmsg_t *msg, const std::string &camera, const Feature &f)
+{
+    zmsg_addstr(msg, "set");
+    zmsg_addstr(msg, camera.c_str());
+    zmsg_addstrf(msg, "%ld", f.id);
+    for (const std::string &arg : f.set_args)
+        zmsg_addstr(msg, arg.c_str());
+}
+
+/**
+ * @brief Build, send and check one request.
+ *
+ * @return int 1 on success, 0 on an error reply, -1 on timeout.
+ */
+static int run_op(zsock_t *sock, const BenchConfig &cfg, const std::vector<Feature> &features, const BenchOp &op)
+{
+    zmsg_t *request = zmsg_new();
+    switch (op.kind)
+    {
+    case OP_LIST:
+        zmsg_addstr(request, "list");
+        break;
+    case OP_GET:
+        zmsg_addstr(request, "get");
+        zmsg_addstr(request, cfg.camera.c_str());
+        zmsg_addstrf(request, "%ld", op.feature->id);
+        if (cfg.refresh)
+            zmsg_addstr(request, "refresh");
+        break;
+    case OP_SET:
+        add_set_frames(request, cfg.camera, *op.feature);
+        break;
+    case OP_BIN:
+    {
+        BinRequest req;
+        memset(&req, 0, sizeof(req));
+        req.magic = BIN_REQUEST_MAGIC;
+        req.camera = strtoul(cfg.camera.c_str(), NULL, 10);
+        req.op = BIN_GET;
+        req.flags = cfg.refresh ? BIN_REFRESH : 0;
+        req.command = op.feature->id;
+        zmsg_addmem(request, &req, sizeof(req));
+        break;
+    }
+    case OP_BATCH:
+        zmsg_addstr(request, "batch");
+        for (const Feature &f : features)
+        {
+            if (!f.set_args.empty())
+            {
+                add_set_frames(request, cfg.camera, f);
+                zmsg_addmem(request, NULL, 0);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    zmsg_t *reply = round_trip(sock, request);
+    if (reply == NULL)
+        return -1;
+    bool ok;
+    if (op.kind == OP_BIN)
+    {
+        zframe_t *frame = zmsg_first(reply);
+        BinReply rep;
+        ok = frame != NULL && zframe_size(frame) == sizeof(rep);
+        if (ok)
+        {
+            memcpy(&rep, zframe_data(frame), sizeof(rep));
+            ok = rep.err == VmbErrorSuccess;
+        }
+    }
+    else if (op.kind == OP_BATCH)
+    {
+        // [batch][number of items][error code][ACK/NAC] followed by the items
+        zmsg_first(reply);
+        zmsg_next(reply);
+        zmsg_next(reply);
+        zframe_t *ack = zmsg_next(reply);
+        ok = ack != NULL && zframe_streq(ack, "ACK");
+    }
+    else
+    {
+        ok = reply_ok(reply);
+    }
+    zmsg_destroy(&reply);
+    return ok ? 1 : 0;
+}
+
+static void client(const BenchConfig &cfg, const std::vector<Feature> &features, std::vector<std::unique_ptr<BenchOp>> &ops, int seed)
+{
+    zsock_t *sock = zsock_new_dealer(cfg.endpoint.c_str());
+    if (sock == NULL)
+    {
+        dbprintlf(RED_FG "Could not connect to %s.", cfg.endpoint.c_str());
+        return;
+    }
+    zsock_set_rcvtimeo(sock, cfg.timeout_ms);
+
+    // weighted round robin over kinds, round robin over each kind's ops
+    std::vector<int> wheel;
+    for (int k = 0; k < OP_KINDS; k++)
+    {
+        for (int w = 0; w < cfg.weights[k]; w++)
+            wheel.push_back(k);
+    }
+    std::vector<std::vector<BenchOp *>> by_kind(OP_KINDS);
+    for (std::unique_ptr<BenchOp> &op : ops)
+        by_kind[op->kind].push_back(op.get());
+    std::vector<size_t> cursor(OP_KINDS, seed); // clients start on different features
+    size_t turn = seed;
+
+    while (!stop_clients.load(std::memory_order_relaxed))
+    {
+        int kind = wheel[turn++ % wheel.size()];
+        if (by_kind[kind].empty())
+            continue;
+        BenchOp *op = by_kind[kind][cursor[kind]++ % by_kind[kind].size()];
+        uint64_t t0 = mono_ns();
+        int ret = run_op(sock, cfg, features, *op);
+        uint64_t t1 = mono_ns();
+        if (ret < 0)
+        {
+            // a late reply would pair with the next request: give up on this client
+            dbprintlf(RED_FG "Client %d: no reply to %s within %d ms, stopping.", seed, op->label.c_str(), cfg.timeout_ms);
+            op->errors.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        op->latency.record(t1 - t0);
+        op->count.fetch_add(1, std::memory_order_relaxed);
+        if (ret == 0)
+            op->errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    zsock_destroy(&sock);
+}
+
+/**
+ * @brief Parse a mix such as "get=8,set=1,list=1".
+ *
+ */
+static bool parse_mix(const char *spec, int weights[OP_KINDS])
+{
+    for (int k = 0; k < OP_KINDS; k++)
+        weights[k] = 0;
+    std::string s = spec;
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t comma = s.find(',', pos);
+        std::string item = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t eq = item.find('=');
+        std::string name = item.substr(0, eq);
+        int w = eq == std::string::npos ? 1 : atoi(item.c_str() + eq + 1);
+        int k;
+        for (k = 0; k < OP_KINDS; k++)
+        {
+            if (name == op_kind_names[k])
+                break;
+        }
+        if (k == OP_KINDS || w < 0)
+            return false;
+        weights[k] = w;
+        if (comma == std::string::npos)
+            break;
+        pos = comma + 1;
+    }
+    for (int k = 0; k < OP_KINDS; k++)
+    {
+        if (weights[k] > 0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig cfg;
+    bool json = false;
+    int c;
+    while ((c = getopt(argc, argv, "e:C:c:t:m:T:rjh")) != -1)
+    {
+        switch (c)
+        {
+        case 'e':
+            cfg.endpoint = optarg;
+            break;
+        case 'C':
+            cfg.camera = optarg;
+            break;
+        case 'c':
+            cfg.clients = atoi(optarg);
+            if (cfg.clients < 1)
+            {
+                dbprintlf(RED_FG "Invalid number of clients: %s", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            cfg.duration_s = atof(optarg);
+            break;
+        case 'm':
+            if (!parse_mix(optarg, cfg.weights))
+            {
+                dbprintlf(RED_FG "Invalid command mix: %s", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'T':
+            cfg.timeout_ms = atoi(optarg);
+            break;
+        case 'r':
+            cfg.refresh = true;
+            break;
+        case 'j':
+            json = true;
+            break;
+        case 'h':
+        default:
+            printf("\nUsage: %s [-e Server endpoint, default tcp://localhost:5555] [-C Camera ID, default the first listed] [-c Concurrent clients, default 1] [-t Seconds, default 10] [-m Mix, default get=8,set=1,list=1; kinds list, get, set, bin, batch] [-T Reply timeout ms, default 5000] [-r Gets bypass the feature cache] [-j JSON output] [-h Show this message]\n\n", argv[0]);
+            exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    zsys_init();
+    zsys_handler_set(NULL);
+
+    // discover cameras and features, and the values sets will write back
+    zsock_t *ctl = zsock_new_dealer(cfg.endpoint.c_str());
+    if (ctl == NULL)
+    {
+        dbprintlf(FATAL "Could not connect to %s.", cfg.endpoint.c_str());
+        return 1;
+    }
+    zsock_set_rcvtimeo(ctl, cfg.timeout_ms);
+    zmsg_t *reply = simple_request(ctl, "list");
+    if (reply == NULL)
+    {
+        dbprintlf(FATAL "No reply from %s.", cfg.endpoint.c_str());
+        zsock_destroy(&ctl);
+        return 1;
+    }
+    std::vector<std::string> ids = parse_list(reply_value(reply));
+    zmsg_destroy(&reply);
+    if (cfg.camera.empty())
+    {
+        if (ids.empty())
+        {
+            dbprintlf(FATAL "The server has no cameras.");
+            zsock_destroy(&ctl);
+            return 1;
+        }
+        cfg.camera = ids[0];
+    }
+    reply = simple_request(ctl, "commands");
+    std::vector<Feature> features = reply != NULL ? parse_commands(reply_value(reply)) : std::vector<Feature>();
+    zmsg_destroy(&reply);
+    for (Feature &f : features)
+    {
+        if (f.set && !current_value(ctl, cfg.camera, f))
+            dbprintlf(YELLOW_FG "Could not read %s, not setting it.", f.name.c_str());
+    }
+    zsock_destroy(&ctl);
+
+    std::vector<std::unique_ptr<BenchOp>> ops;
+    ops.emplace_back(new BenchOp(OP_LIST, "list"));
+    for (const Feature &f : features)
+    {
+        if (f.get)
+        {
+            ops.emplace_back(new BenchOp(OP_GET, "get " + f.name, &f));
+            ops.emplace_back(new BenchOp(OP_BIN, "bin get " + f.name, &f));
+        }
+        if (!f.set_args.empty())
+            ops.emplace_back(new BenchOp(OP_SET, "set " + f.name, &f));
+    }
+    ops.emplace_back(new BenchOp(OP_BATCH, "batch"));
+
+    std::vector<std::thread> threads;
+    uint64_t t0 = mono_ns();
+    for (int i = 0; i < cfg.clients; i++)
+        threads.emplace_back(client, std::cref(cfg), std::cref(features), std::ref(ops), i);
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.duration_s));
+    stop_clients = true;
+    for (std::thread &t : threads)
+        t.join();
+    double elapsed = (mono_ns() - t0) / 1e9;
+
+    LatencyHistogram all;
+    uint64_t total = 0, total_errors = 0;
+    if (json)
+    {
+        printf("{\"endpoint\": \"%s\", \"camera\": %s, \"clients\": %d, \"duration_s\": %.3f, \"refresh\": %s, \"commands\": [",
+               cfg.endpoint.c_str(), cfg.camera.c_str(), cfg.clients, elapsed, cfg.refresh ? "true" : "false");
+    }
+    else
+    {
+        printf("%-32s %10s %8s %10s %10s %10s %10s\n", "command", "count", "errors", "ops/s", "p50 us", "p99 us", "p999 us");
+    }
+    bool first = true;
+    for (std::unique_ptr<BenchOp> &op : ops)
+    {
+        uint64_t n = op->count.load();
+        if (n == 0)
+            continue;
+        total += n;
+        total_errors += op->errors.load();
+        if (json)
+        {
+            printf("%s{\"command\": \"%s\", \"count\": %llu, \"errors\": %llu, \"ops_per_s\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f}",
+                   first ? "" : ", ", op->label.c_str(), (unsigned long long)n, (unsigned long long)op->errors.load(), n / elapsed,
+                   op->latency.percentile(0.5) / 1e3, op->latency.percentile(0.99) / 1e3, op->latency.percentile(0.999) / 1e3);
+        }
+        else
+        {
+            printf("%-32s %10llu %8llu %10.1f %10.1f %10.1f %10.1f\n", op->label.c_str(), (unsigned long long)n, (unsigned long long)op->errors.load(), n / elapsed,
+                   op->latency.percentile(0.5) / 1e3, op->latency.percentile(0.99) / 1e3, op->latency.percentile(0.999) / 1e3);
+        }
+        first = false;
+        all.merge(op->latency);
+    }
+    if (json)
+    {
+        printf("], \"total\": {\"count\": %llu, \"errors\": %llu, \"ops_per_s\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f}}\n",
+               (unsigned long long)total, (unsigned long long)total_errors, total / elapsed,
+               all.percentile(0.5) / 1e3, all.percentile(0.99) / 1e3, all.percentile(0.999) / 1e3);
+    }
+    else
+    {
+        printf("%-32s %10llu %8llu %10.1f %10.1f %10.1f %10.1f\n", "total", (unsigned long long)total, (unsigned long long)total_errors, total / elapsed,
+               all.percentile(0.5) / 1e3, all.percentile(0.99) / 1e3, all.percentile(0.999) / 1e3);
+    }
+    return total_errors == 0 ? 0 : 2;
+}
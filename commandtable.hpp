@@ -0,0 +1,360 @@
+/**
+ * @file commandtable.hpp
+ * @brief Typed feature values and the descriptor type behind the get/set command table.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A feature is described by one CommandDesc row: its command number, name,
+ * value type, flags and getter/setter. Arguments are parsed and replies are
+ * formatted with std::from_chars/std::to_chars into fixed buffers, so neither
+ * direction touches the heap. The getter/setter templates below wrap the
+ * allied_get_<feature>/allied_set_<feature> functions for any camera type
+ * that exposes a `handle` member.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <charconv>
+#include <alliedcam.h>
+
+enum class ValueType : uint8_t
+{
+    None,  // no value
+    Str,   // enumeration entry or other string
+    Int,   // 64-bit integer
+    Dbl,   // double, replied with 6 decimals
+    Bool,  // replied as True/False
+    Size,  // two integers, replied as WxH
+    Range, // two integers, replied as [min, max]
+};
+
+#define FEATURE_STR_LEN 64
+
+struct FeatureValue
+{
+    ValueType type = ValueType::None;
+    bool b = false;
+    int64_t i[2] = {0, 0};
+    double d = 0;
+    char s[FEATURE_STR_LEN] = {0};
+};
+
+enum CommandFlags : uint8_t
+{
+    CMD_IMMUTABLE = 1, // cannot change while the camera is open, cached forever
+    CMD_NOCACHE = 2,   // never cached (lives on our side)
+    CMD_GEOMETRY = 4,  // changes the frame size, frame buffers follow
+};
+
+static inline const char *value_type_name(ValueType type)
+{
+    switch (type)
+    {
+    case ValueType::Str:
+        return "str";
+    case ValueType::Int:
+        return "int";
+    case ValueType::Dbl:
+        return "double";
+    case ValueType::Bool:
+        return "bool";
+    case ValueType::Size:
+        return "size";
+    case ValueType::Range:
+        return "range";
+    default:
+        return "none";
+    }
+}
+
+/**
+ * @brief Number of arguments a set of this type takes.
+ *
+ */
+static inline int value_type_arity(ValueType type)
+{
+    switch (type)
+    {
+    case ValueType::None:
+        return 0;
+    case ValueType::Size:
+    case ValueType::Range:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static inline bool parse_int(const char *arg, int64_t &out)
+{
+    if (arg == nullptr)
+        return false;
+    const char *end = arg + strlen(arg);
+    std::from_chars_result res = std::from_chars(arg, end, out);
+    return res.ec == std::errc() && res.ptr == end;
+}
+
+/**
+ * @brief Parse set arguments into a value of the given type.
+ *
+ * @param type Expected type.
+ * @param args value_type_arity(type) argument strings.
+ * @param out Parsed value.
+ * @return true on success, false if an argument is missing or malformed.
+ */
+static inline bool parse_value(ValueType type, const char *const *args, FeatureValue &out)
+{
+    out.type = type;
+    switch (type)
+    {
+    case ValueType::Str:
+    {
+        if (args[0] == nullptr)
+            return false;
+        size_t len = strlen(args[0]);
+        if (len >= sizeof(out.s))
+            return false;
+        memcpy(out.s, args[0], len + 1);
+        return true;
+    }
+    case ValueType::Int:
+        return parse_int(args[0], out.i[0]);
+    case ValueType::Dbl:
+    {
+        if (args[0] == nullptr)
+            return false;
+        const char *end = args[0] + strlen(args[0]);
+        std::from_chars_result res = std::from_chars(args[0], end, out.d);
+        return res.ec == std::errc() && res.ptr == end;
+    }
+    case ValueType::Bool:
+        if (args[0] == nullptr)
+            return false;
+        out.b = strcasecmp(args[0], "true") == 0;
+        return true;
+    case ValueType::Size:
+    case ValueType::Range:
+        return parse_int(args[0], out.i[0]) && parse_int(args[1], out.i[1]);
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Format a value the way replies have always looked.
+ *
+ * @return size_t Number of characters written, excluding the terminating NUL.
+ */
+static inline size_t format_value(const FeatureValue &val, char *buf, size_t len)
+{
+    char *p = buf;
+    char *end = buf + len - 1; // leave room for NUL
+    switch (val.type)
+    {
+    case ValueType::Str:
+    {
+        size_t n = strnlen(val.s, sizeof(val.s));
+        n = n < (size_t)(end - p) ? n : end - p;
+        memcpy(p, val.s, n);
+        p += n;
+        break;
+    }
+    case ValueType::Int:
+        p = std::to_chars(p, end, val.i[0]).ptr;
+        break;
+    case ValueType::Dbl:
+        p = std::to_chars(p, end, val.d, std::chars_format::fixed, 6).ptr;
+        break;
+    case ValueType::Bool:
+    {
+        const char *s = val.b ? "True" : "False";
+        size_t n = strlen(s);
+        n = n < (size_t)(end - p) ? n : end - p;
+        memcpy(p, s, n);
+        p += n;
+        break;
+    }
+    case ValueType::Size:
+        p = std::to_chars(p, end, val.i[0]).ptr;
+        if (p < end)
+            *p++ = 'x';
+        p = std::to_chars(p, end, val.i[1]).ptr;
+        break;
+    case ValueType::Range:
+        if (p < end)
+            *p++ = '[';
+        p = std::to_chars(p, end, val.i[0]).ptr;
+        if (end - p >= 2)
+        {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+        p = std::to_chars(p, end, val.i[1]).ptr;
+        if (p < end)
+            *p++ = ']';
+        break;
+    default:
+    {
+        const char *s = "None";
+        size_t n = strlen(s) < (size_t)(end - p) ? strlen(s) : end - p;
+        memcpy(p, s, n);
+        p += n;
+        break;
+    }
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+/**
+ * @brief One row of the command table.
+ *
+ */
+template <typename Cam>
+struct CommandDesc
+{
+    long id;
+    const char *name;
+    ValueType type;
+    uint8_t flags;                                   // CommandFlags
+    VmbError_t (*get)(Cam &, FeatureValue &);        // nullptr if write-only
+    VmbError_t (*set)(Cam &, const FeatureValue &); // nullptr if read-only
+    long deps[4];                                    // features whose cached value a set makes stale, 0-terminated
+};
+
+/**
+ * @brief Find a row by command number.
+ *
+ */
+template <typename Cam, size_t N>
+constexpr const CommandDesc<Cam> *find_command(const CommandDesc<Cam> (&table)[N], long id)
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        if (table[i].id == id)
+            return &table[i];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Compile-time check that no command number appears twice.
+ *
+ */
+template <typename Cam, size_t N>
+constexpr bool command_ids_unique(const CommandDesc<Cam> (&table)[N])
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        for (size_t j = i + 1; j < N; j++)
+        {
+            if (table[i].id == table[j].id)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Getters and setters wrapping allied_get_<feature>/allied_set_<feature>.
+
+template <auto F, typename Cam>
+VmbError_t get_str(Cam &cam, FeatureValue &val)
+{
+    const char *str = nullptr;
+    VmbError_t err = F(cam.handle, &str);
+    val.type = ValueType::Str;
+    val.s[0] = '\0';
+    if (err == VmbErrorSuccess && str != nullptr)
+    {
+        strncpy(val.s, str, sizeof(val.s) - 1);
+        val.s[sizeof(val.s) - 1] = '\0';
+    }
+    return err;
+}
+
+template <auto F, typename Cam>
+VmbError_t set_str(Cam &cam, const FeatureValue &val)
+{
+    return F(cam.handle, val.s);
+}
+
+template <auto F, typename Cam>
+VmbError_t get_int(Cam &cam, FeatureValue &val)
+{
+    VmbInt64_t v = 0;
+    VmbError_t err = F(cam.handle, &v);
+    val.type = ValueType::Int;
+    val.i[0] = v;
+    return err;
+}
+
+template <auto F, typename Cam>
+VmbError_t set_int(Cam &cam, const FeatureValue &val)
+{
+    return F(cam.handle, val.i[0]);
+}
+
+template <auto F, typename Cam>
+VmbError_t get_dbl(Cam &cam, FeatureValue &val)
+{
+    double v = 0;
+    VmbError_t err = F(cam.handle, &v);
+    val.type = ValueType::Dbl;
+    val.d = v;
+    return err;
+}
+
+template <auto F, typename Cam>
+VmbError_t set_dbl(Cam &cam, const FeatureValue &val)
+{
+    return F(cam.handle, val.d);
+}
+
+template <auto F, typename Cam>
+VmbError_t get_bool(Cam &cam, FeatureValue &val)
+{
+    VmbBool_t v = VmbBoolFalse;
+    VmbError_t err = F(cam.handle, &v);
+    val.type = ValueType::Bool;
+    val.b = v == VmbBoolTrue;
+    return err;
+}
+
+template <auto F, typename Cam>
+VmbError_t set_bool(Cam &cam, const FeatureValue &val)
+{
+    return F(cam.handle, val.b);
+}
+
+template <auto F, typename Cam>
+VmbError_t get_size(Cam &cam, FeatureValue &val)
+{
+    VmbInt64_t a = 0, b = 0;
+    VmbError_t err = F(cam.handle, &a, &b);
+    val.type = ValueType::Size;
+    val.i[0] = a;
+    val.i[1] = b;
+    return err;
+}
+
+template <auto F, typename Cam>
+VmbError_t set_size(Cam &cam, const FeatureValue &val)
+{
+    return F(cam.handle, val.i[0], val.i[1]);
+}
+
+template <auto F, typename Cam>
+VmbError_t get_range(Cam &cam, FeatureValue &val)
+{
+    VmbInt64_t a = 0, b = 0;
+    VmbError_t err = F(cam.handle, &a, &b, nullptr);
+    val.type = ValueType::Range;
+    val.i[0] = a;
+    val.i[1] = b;
+    return err;
+}
@@ -0,0 +1,56 @@
+#include "dioport.hpp"
+#include "capturestats.hpp"
+#include "meb_print.h"
+
+#include <string.h>
+#include <stdexcept>
+
+ADIOPort::ADIOPort(int minor)
+{
+    if (OpenDIO_aDIO(&hdl, minor) != 0)
+    {
+        dbprintlf(RED_FG "Could not initialize ADIO API. Check if /dev/rtd-aDIO* exists.");
+        throw std::runtime_error("Could not open aDIO board.");
+    }
+    // set up port A as output and set all bits to low
+    int ret = LoadPort0BitDir_aDIO(hdl, 1, 1, 1, 1, 1, 1, 1, 1);
+    if (ret == -1)
+    {
+        dbprintlf(RED_FG "Could not set PORT0 to output.");
+    }
+    else
+    {
+        ret = WritePort_aDIO(hdl, 0, 0); // set all to low
+        if (ret < 0)
+        {
+            dbprintlf(RED_FG "Could not set all PORT0 bits to LOW: %s [%d]", strerror(ret), ret);
+        }
+    }
+}
+
+ADIOPort::~ADIOPort()
+{
+    CloseDIO_aDIO(hdl);
+}
+
+int ADIOPort::write_port(uint8_t value)
+{
+    return WritePort_aDIO(hdl, 0, value);
+}
+
+SyntheticDIOPort::SyntheticDIOPort(uint32_t latency_ns)
+{
+    this->latency_ns = latency_ns;
+    value = 0;
+    writes = 0;
+}
+
+int SyntheticDIOPort::write_port(uint8_t value)
+{
+    uint64_t until = mono_ns() + latency_ns;
+    while (mono_ns() < until)
+        ;
+    this->value.store(value, std::memory_order_relaxed);
+    writes.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file dioport.hpp
+ * @brief Digital output ports the aDIO engine can drive: the RTD aDIO board, or a simulated one.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <aDIO_library.h>
+#include <atomic>
+
+#include "camerabackend.hpp"
+
+/**
+ * @brief Port 0 of an RTD aDIO board.
+ *
+ */
+class ADIOPort : public DIOPort
+{
+    DeviceHandle hdl = nullptr;
+
+public:
+    /**
+     * @brief Open the board, set port 0 to output and drive it low.
+     *
+     * @param minor Minor number of /dev/rtd-aDIO*.
+     * @throws std::runtime_error if the board cannot be opened.
+     */
+    ADIOPort(int minor);
+    ~ADIOPort();
+
+    ADIOPort(const ADIOPort &) = delete;
+    ADIOPort &operator=(const ADIOPort &) = delete;
+
+    const char *kind() const
+    {
+        return "aDIO";
+    }
+
+    int write_port(uint8_t value);
+};
+
+/**
+ * @brief Stands in for the aDIO board when there is none: remembers the port value and takes as long as a real write.
+ *
+ */
+class SyntheticDIOPort : public DIOPort
+{
+    uint32_t latency_ns;
+
+public:
+    std::atomic<uint8_t> value;   // last value written
+    std::atomic<uint64_t> writes; // port writes
+
+    /**
+     * @param latency_ns Time each write takes, busy-waited like the driver's ioctl.
+     */
+    SyntheticDIOPort(uint32_t latency_ns = 5000);
+
+    const char *kind() const
+    {
+        return "synthetic";
+    }
+
+    int write_port(uint8_t value);
+};
@@ -0,0 +1,76 @@
+/**
+ * @file featurecache.hpp
+ * @brief Per-camera cache of typed feature values, so repeated gets do not hit the camera.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Not thread safe; the owning camera's command lock protects it.
+ */
+
+#pragma once
+
+#include <map>
+#include <set>
+
+#include "commandtable.hpp"
+
+class FeatureCache
+{
+    std::map<long, FeatureValue> values;
+    std::set<long> immutable; // never invalidated, only refreshed on request
+
+public:
+    /**
+     * @brief Mark a feature as one that cannot change while the camera is open (e.g. sensor size).
+     *
+     */
+    void set_immutable(long id)
+    {
+        immutable.insert(id);
+    }
+
+    bool is_immutable(long id) const
+    {
+        return immutable.count(id) > 0;
+    }
+
+    /**
+     * @brief Look up a cached value.
+     *
+     * @return true if the value was cached.
+     */
+    bool lookup(long id, FeatureValue &value) const
+    {
+        std::map<long, FeatureValue>::const_iterator it = values.find(id);
+        if (it == values.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    void store(long id, const FeatureValue &value)
+    {
+        values[id] = value;
+    }
+
+    /**
+     * @brief Drop a cached value so the next get reads it from the camera. Immutable values are kept.
+     *
+     */
+    void invalidate(long id)
+    {
+        if (!is_immutable(id))
+            values.erase(id);
+    }
+
+    /**
+     * @brief Drop every cached value, including immutable ones.
+     *
+     */
+    void clear()
+    {
+        values.clear();
+    }
+};
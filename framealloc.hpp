@@ -0,0 +1,71 @@
+/**
+ * @file framealloc.hpp
+ * @brief Page-aligned, huge-page backed (where available) memory for frame buffers.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Frame memory is allocated once, up front, and pre-faulted so nothing on the
+ * capture path ever takes a page fault. Explicit huge pages (MAP_HUGETLB) are
+ * tried first, then transparent huge pages, then plain pages.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <new>
+
+#define FRAME_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+struct FrameArena
+{
+    uint8_t *base = nullptr;
+    size_t len = 0;
+    bool huge = false; // backed by explicit huge pages
+
+    /**
+     * @brief Allocate len bytes, page aligned and pre-faulted.
+     *
+     * @throws std::bad_alloc
+     */
+    static FrameArena allocate(size_t len)
+    {
+        FrameArena a;
+        a.len = (len + 4095) & ~((size_t)4095);
+        void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        size_t hlen = (len + FRAME_HUGE_PAGE_SIZE - 1) & ~(FRAME_HUGE_PAGE_SIZE - 1);
+        ptr = mmap(NULL, hlen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            a.len = hlen;
+            a.huge = true;
+        }
+#endif // MAP_HUGETLB
+        if (ptr == MAP_FAILED)
+        {
+            ptr = mmap(NULL, a.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+            madvise(ptr, a.len, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+        }
+        a.base = (uint8_t *)ptr;
+        // touch every page now so the callback never takes a page fault
+        memset(a.base, 0, a.len);
+        return a;
+    }
+
+    void release()
+    {
+        if (base != nullptr)
+            munmap(base, len);
+        base = nullptr;
+        len = 0;
+    }
+};
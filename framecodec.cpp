@@ -0,0 +1,533 @@
+#include "framecodec.hpp"
+#include "pixelformat.hpp"
+
+#include <string.h>
+
+#define RICE_BLOCK 32
+#define RICE_ESCAPE 24 // unary quotients this long are followed by the sample's residual as is
+#define MIN_TILE_ROWS 16
+
+// ---------------------------------------------------------------- bit I/O
+
+struct BitWriter
+{
+    uint8_t *p;
+    uint8_t *end;
+    uint64_t acc = 0;
+    int n = 0;
+    bool overflow = false;
+
+    BitWriter(uint8_t *p, uint8_t *end)
+    {
+        this->p = p;
+        this->end = end;
+    }
+
+    /**
+     * @brief Append the low `bits` bits of v, most significant first (bits <= 32).
+     *
+     */
+    inline void put(uint32_t v, int bits)
+    {
+        acc = acc << bits | v;
+        n += bits;
+        if (n >= 32)
+        {
+            n -= 32;
+            uint32_t word = (uint32_t)(acc >> n);
+            if (end - p >= 4)
+            {
+                p[0] = word >> 24;
+                p[1] = word >> 16;
+                p[2] = word >> 8;
+                p[3] = word;
+                p += 4;
+            }
+            else
+            {
+                overflow = true;
+            }
+        }
+    }
+
+    void flush()
+    {
+        while (n > 0)
+        {
+            int bits = n < 8 ? n : 8;
+            uint8_t byte = (uint8_t)(acc >> (n - bits) << (8 - bits));
+            n -= bits;
+            if (p < end)
+                *p++ = byte;
+            else
+                overflow = true;
+        }
+    }
+};
+
+struct BitReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc = 0;
+    int n = 0;
+
+    BitReader(const uint8_t *p, const uint8_t *end)
+    {
+        this->p = p;
+        this->end = end;
+    }
+
+    inline void refill()
+    {
+        // past the end reads zeros; a malformed band decodes to garbage, never out of bounds
+        while (n <= 56)
+        {
+            acc = acc << 8 | (p < end ? *p++ : 0);
+            n += 8;
+        }
+    }
+
+    inline uint32_t get(int bits)
+    {
+        if (n < bits)
+            refill();
+        n -= bits;
+        return (uint32_t)(acc >> n) & (uint32_t)((1ULL << bits) - 1);
+    }
+
+    /**
+     * @brief Zeros before the next one bit, consuming the one; RICE_ESCAPE (and no one bit) if there are that many.
+     *
+     */
+    inline uint32_t unary()
+    {
+        if (n < RICE_ESCAPE)
+            refill();
+        uint32_t top = (uint32_t)(acc >> (n - RICE_ESCAPE)) & ((1u << RICE_ESCAPE) - 1);
+        if (top == 0)
+        {
+            n -= RICE_ESCAPE;
+            return RICE_ESCAPE;
+        }
+        uint32_t q = __builtin_clz(top) - (32 - RICE_ESCAPE);
+        n -= q + 1;
+        return q;
+    }
+};
+
+// ---------------------------------------------------------------- prediction
+
+/**
+ * @brief LOCO-I median edge detector.
+ *
+ */
+static inline uint32_t med(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t lo = a < b ? a : b;
+    uint32_t hi = a < b ? b : a;
+    if (c >= hi)
+        return lo;
+    if (c <= lo)
+        return hi;
+    return a + b - c;
+}
+
+/**
+ * @brief Prediction for sample x of row `row`; `up` is the same-colour row above, nullptr at the top of a band.
+ *
+ */
+template <typename T>
+static inline uint32_t predict(const T *row, const T *up, uint32_t x, uint32_t step)
+{
+    uint32_t a = x >= step ? row[x - step] : (up != nullptr ? up[x] : 0);
+    uint32_t b = up != nullptr ? up[x] : a;
+    uint32_t c = up != nullptr && x >= step ? up[x - step] : b;
+    return med(a, b, c);
+}
+
+struct Layout
+{
+    uint32_t sample_bits;
+    uint32_t step;
+    uint32_t rowdist;
+    uint32_t row_samples;
+    uint32_t rows;
+};
+
+static bool is_bayer(uint32_t code)
+{
+    uint32_t id = code & 0xffff;
+    return (id >= 0x08 && id <= 0x13) || (id >= 0x2e && id <= 0x31);
+}
+
+static Layout layout_of(const FrameHeader &hdr)
+{
+    Layout l = {8, 1, 1, 0, 0};
+    uint32_t bits = pixel_format_bits(hdr.pixel_format);
+    size_t row_bytes = 0;
+    if (!hdr.truncated && hdr.width > 0 && hdr.height > 0)
+    {
+        if (bits == 8 || bits == 16)
+        {
+            l.sample_bits = bits;
+            l.row_samples = hdr.width;
+            if (is_bayer(hdr.pixel_format))
+                l.step = l.rowdist = 2;
+        }
+        else if (bits == 24 || bits == 32 || bits == 48)
+        {
+            // interleaved colour: the same channel sits one pixel to the left
+            l.sample_bits = bits == 48 ? 16 : 8;
+            l.step = bits / l.sample_bits;
+            l.row_samples = hdr.width * l.step;
+        }
+        else if ((uint64_t)hdr.width * bits % 8 == 0)
+        {
+            l.row_samples = (uint64_t)hdr.width * bits / 8; // packed: bytes, aligned rows still predict from above
+        }
+        row_bytes = (size_t)l.row_samples * l.sample_bits / 8;
+    }
+    if (row_bytes == 0)
+    {
+        // nothing known about the layout: one long row of bytes
+        l = {8, 1, 1, hdr.size, hdr.size > 0 ? 1u : 0u};
+        return l;
+    }
+    l.rows = hdr.height;
+    if ((size_t)l.rows * row_bytes > hdr.size)
+        l.rows = hdr.size / row_bytes;
+    return l;
+}
+
+// ---------------------------------------------------------------- bands
+
+static inline void put_residual(BitWriter &bw, uint32_t u, uint32_t k, uint32_t bits)
+{
+    uint32_t q = u >> k;
+    if (q < RICE_ESCAPE)
+    {
+        // q zeros, a one, then the low k bits
+        uint32_t low = u & ((1u << k) - 1);
+        if (q + 1 + k <= 32)
+        {
+            bw.put(1u << k | low, q + 1 + k);
+        }
+        else
+        {
+            bw.put(1, q + 1);
+            bw.put(low, k);
+        }
+    }
+    else
+    {
+        bw.put(0, RICE_ESCAPE);
+        bw.put(u, bits);
+    }
+}
+
+template <typename T>
+static size_t encode_band(const T *src, const Layout &l, uint32_t nrows, uint8_t *dst, size_t cap)
+{
+    BitWriter bw(dst, dst + cap);
+    const uint32_t bits = l.sample_bits;
+    const uint32_t mask = (1u << bits) - 1;
+    const uint32_t half = 1u << (bits - 1);
+    uint32_t block[RICE_BLOCK];
+    uint32_t nblock = 0;
+    uint64_t sum = 0;
+    auto flush = [&]()
+    {
+        uint32_t k = 0;
+        while (k < bits && ((uint64_t)nblock << k) < sum)
+            k++;
+        bw.put(k, 5);
+        for (uint32_t i = 0; i < nblock; i++)
+            put_residual(bw, block[i], k, bits);
+        nblock = 0;
+        sum = 0;
+    };
+    for (uint32_t r = 0; r < nrows && !bw.overflow; r++)
+    {
+        const T *row = src + (size_t)r * l.row_samples;
+        const T *up = r >= l.rowdist ? row - (size_t)l.rowdist * l.row_samples : nullptr;
+        auto code = [&](uint32_t x, uint32_t pred)
+        {
+            uint32_t d = (row[x] - pred) & mask;
+            // fold to signed, then zigzag: small magnitudes become small codes
+            uint32_t u = d < half ? d << 1 : ((mask - d) << 1) | 1;
+            block[nblock++] = u;
+            sum += u;
+            if (nblock == RICE_BLOCK)
+                flush();
+        };
+        uint32_t x = 0;
+        uint32_t edge = up != nullptr ? l.step : l.row_samples;
+        for (; x < edge && x < l.row_samples; x++)
+            code(x, predict(row, up, x, l.step));
+        for (; x < l.row_samples; x++)
+            code(x, med(row[x - l.step], up[x], up[x - l.step]));
+    }
+    if (nblock > 0)
+        flush();
+    bw.flush();
+    return bw.overflow ? 0 : bw.p - dst;
+}
+
+template <typename T>
+static void decode_band(const uint8_t *src, size_t len, const Layout &l, uint32_t nrows, T *dst)
+{
+    BitReader br(src, src + len);
+    const uint32_t bits = l.sample_bits;
+    const uint32_t mask = (1u << bits) - 1;
+    uint32_t left = 0; // residuals left in the current block
+    uint32_t k = 0;
+    for (uint32_t r = 0; r < nrows; r++)
+    {
+        T *row = dst + (size_t)r * l.row_samples;
+        const T *up = r >= l.rowdist ? row - (size_t)l.rowdist * l.row_samples : nullptr;
+        auto residual = [&]()
+        {
+            if (left == 0)
+            {
+                k = br.get(5);
+                if (k > bits)
+                    k = bits;
+                left = RICE_BLOCK;
+            }
+            left--;
+            uint32_t q = br.unary();
+            uint32_t u = q < RICE_ESCAPE ? (q << k | br.get(k)) : br.get(bits);
+            return u & 1 ? mask - (u >> 1) : u >> 1;
+        };
+        uint32_t x = 0;
+        uint32_t edge = up != nullptr ? l.step : l.row_samples;
+        for (; x < edge && x < l.row_samples; x++)
+            row[x] = (T)((predict(row, up, x, l.step) + residual()) & mask);
+        for (; x < l.row_samples; x++)
+            row[x] = (T)((med(row[x - l.step], up[x], up[x - l.step]) + residual()) & mask);
+    }
+}
+
+// ---------------------------------------------------------------- thread pool
+
+FrameCodec::FrameCodec(unsigned nthreads)
+{
+    next_job = 0;
+    for (unsigned i = 1; i < nthreads; i++)
+        workers.emplace_back(&FrameCodec::worker, this);
+}
+
+FrameCodec::~FrameCodec()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers)
+        t.join();
+}
+
+void FrameCodec::worker()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        cv.wait(guard, [&]
+                { return quit || generation != seen; });
+        if (quit)
+            return;
+        seen = generation;
+        const std::function<void(uint32_t)> *fn = job;
+        uint32_t n = njobs;
+        active++;
+        guard.unlock();
+        uint32_t done = 0;
+        for (uint32_t i; (i = next_job.fetch_add(1)) < n;)
+        {
+            (*fn)(i);
+            done++;
+        }
+        guard.lock();
+        finished += done;
+        active--;
+        done_cv.notify_all();
+    }
+}
+
+void FrameCodec::parallel_for(uint32_t n, const std::function<void(uint32_t)> &fn)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    // a worker that woke up late for the previous job must leave it before the counter is reset
+    done_cv.wait(guard, [&]
+                 { return active == 0; });
+    job = &fn;
+    njobs = n;
+    next_job = 0;
+    finished = 0;
+    generation++;
+    guard.unlock();
+    cv.notify_all();
+    uint32_t done = 0;
+    for (uint32_t i; (i = next_job.fetch_add(1)) < n;)
+    {
+        fn(i);
+        done++;
+    }
+    guard.lock();
+    finished += done;
+    // workers that picked the job up must be out of it before fn goes away
+    done_cv.wait(guard, [&]
+                 { return finished == n && active == 0; });
+    job = nullptr;
+}
+
+// ---------------------------------------------------------------- frames
+
+size_t FrameCodec::encode(const FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap, CodecStats *stats)
+{
+    uint64_t t0 = mono_ns();
+    Layout l = layout_of(hdr);
+    size_t sample_bytes = l.sample_bits / 8;
+    size_t row_bytes = (size_t)l.row_samples * sample_bytes;
+    // a few bands per thread, so one slow band does not hold up the frame
+    uint32_t tile_rows = l.rows / (4 * threads());
+    if (tile_rows < MIN_TILE_ROWS)
+        tile_rows = MIN_TILE_ROWS;
+    if (l.rows > 0 && (l.rows + tile_rows - 1) / tile_rows > CODEC_MAX_TILES)
+        tile_rows = (l.rows + CODEC_MAX_TILES - 1) / CODEC_MAX_TILES;
+    tile_rows = (tile_rows + 1) & ~1u; // whole Bayer tiles
+    uint32_t ntiles = l.rows > 0 ? (l.rows + tile_rows - 1) / tile_rows : 0;
+
+    CodecHeader ch;
+    memset(&ch, 0, sizeof(ch));
+    ch.magic = FRAME_CODEC_MAGIC;
+    ch.raw_size = hdr.size;
+    ch.row_samples = l.row_samples;
+    ch.rows = l.rows;
+    ch.sample_bits = l.sample_bits;
+    ch.step = l.step;
+    ch.rowdist = l.rowdist;
+    ch.tile_rows = tile_rows;
+    ch.ntiles = ntiles;
+    size_t head = sizeof(ch) + ntiles * sizeof(uint32_t);
+    if (cap < head)
+        return 0;
+
+    std::lock_guard<std::mutex> guard(job_lock);
+    // every band gets a slot as large as its raw bytes; one that does not fit is stored instead
+    size_t slot = (size_t)tile_rows * row_bytes;
+    bands.resize(slot * ntiles);
+    std::vector<uint32_t> sizes(ntiles);
+    parallel_for(ntiles, [&](uint32_t t)
+                 {
+        uint32_t r0 = t * tile_rows;
+        uint32_t nrows = r0 + tile_rows <= l.rows ? tile_rows : l.rows - r0;
+        const uint8_t *in = src + (size_t)r0 * row_bytes;
+        uint8_t *out = bands.data() + t * slot;
+        size_t n;
+        if (l.sample_bits == 16)
+            n = encode_band((const uint16_t *)in, l, nrows, out, (size_t)nrows * row_bytes);
+        else
+            n = encode_band(in, l, nrows, out, (size_t)nrows * row_bytes);
+        sizes[t] = n > 0 ? (uint32_t)n : CODEC_TILE_STORED | (uint32_t)(nrows * row_bytes); });
+
+    size_t coded = head;
+    for (uint32_t t = 0; t < ntiles; t++)
+        coded += sizes[t] & ~CODEC_TILE_STORED;
+    size_t tail = hdr.size - (size_t)l.rows * row_bytes;
+    coded += tail;
+    if (coded > cap)
+        return 0;
+    memcpy(dst, &ch, sizeof(ch));
+    if (ntiles > 0)
+        memcpy(dst + sizeof(ch), sizes.data(), ntiles * sizeof(uint32_t));
+    uint8_t *out = dst + head;
+    for (uint32_t t = 0; t < ntiles; t++)
+    {
+        size_t n = sizes[t] & ~CODEC_TILE_STORED;
+        memcpy(out, sizes[t] & CODEC_TILE_STORED ? src + (size_t)t * tile_rows * row_bytes : bands.data() + t * slot, n);
+        out += n;
+    }
+    if (tail > 0)
+        memcpy(out, src + (size_t)l.rows * row_bytes, tail);
+    if (stats != nullptr)
+        stats->update(hdr.size, coded, mono_ns() - t0);
+    return coded;
+}
+
+size_t FrameCodec::decoded_size(const uint8_t *src, size_t len)
+{
+    CodecHeader ch;
+    if (len < sizeof(ch))
+        return 0;
+    memcpy(&ch, src, sizeof(ch));
+    return ch.magic == FRAME_CODEC_MAGIC ? ch.raw_size : 0;
+}
+
+bool FrameCodec::decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    CodecHeader ch;
+    if (len < sizeof(ch))
+        return false;
+    memcpy(&ch, src, sizeof(ch));
+    if (ch.magic != FRAME_CODEC_MAGIC || ch.raw_size > cap || (ch.sample_bits != 8 && ch.sample_bits != 16) ||
+        ch.step == 0 || ch.rowdist == 0 || ch.ntiles > CODEC_MAX_TILES || ch.tile_rows == 0)
+        return false;
+    Layout l = {ch.sample_bits, ch.step, ch.rowdist, ch.row_samples, ch.rows};
+    size_t row_bytes = (size_t)l.row_samples * (l.sample_bits / 8);
+    size_t raw_rows = (size_t)l.rows * row_bytes;
+    if (raw_rows > ch.raw_size || (uint64_t)ch.ntiles * ch.tile_rows < l.rows || (ch.ntiles > 0 && (uint64_t)(ch.ntiles - 1) * ch.tile_rows >= l.rows))
+        return false;
+    size_t head = sizeof(ch) + ch.ntiles * sizeof(uint32_t);
+    if (len < head)
+        return false;
+    std::vector<uint32_t> sizes(ch.ntiles);
+    std::vector<size_t> offsets(ch.ntiles);
+    if (ch.ntiles > 0)
+        memcpy(sizes.data(), src + sizeof(ch), ch.ntiles * sizeof(uint32_t));
+    size_t off = head;
+    for (uint32_t t = 0; t < ch.ntiles; t++)
+    {
+        offsets[t] = off;
+        off += sizes[t] & ~CODEC_TILE_STORED;
+    }
+    size_t tail = ch.raw_size - raw_rows;
+    if (off + tail != len)
+        return false;
+    for (uint32_t t = 0; t < ch.ntiles; t++)
+    {
+        uint32_t nrows = (t + 1) * ch.tile_rows <= l.rows ? ch.tile_rows : l.rows - t * ch.tile_rows;
+        if ((sizes[t] & CODEC_TILE_STORED) && (sizes[t] & ~CODEC_TILE_STORED) != nrows * row_bytes)
+            return false;
+    }
+
+    std::lock_guard<std::mutex> guard(job_lock);
+    parallel_for(ch.ntiles, [&](uint32_t t)
+                 {
+        uint32_t r0 = t * ch.tile_rows;
+        uint32_t nrows = r0 + ch.tile_rows <= l.rows ? ch.tile_rows : l.rows - r0;
+        const uint8_t *in = src + offsets[t];
+        size_t n = sizes[t] & ~CODEC_TILE_STORED;
+        uint8_t *out = dst + (size_t)r0 * row_bytes;
+        if (sizes[t] & CODEC_TILE_STORED)
+            memcpy(out, in, n);
+        else if (l.sample_bits == 16)
+            decode_band(in, n, l, nrows, (uint16_t *)out);
+        else
+            decode_band(in, n, l, nrows, out); });
+    if (tail > 0)
+        memcpy(dst + raw_rows, src + off, tail);
+    return true;
+}
+
+FrameCodec &frame_codec()
+{
+    static FrameCodec codec([]()
+                            {
+        unsigned n = std::thread::hardware_concurrency();
+        return n == 0 ? 1u : n > 8 ? 8u : n; }());
+    return codec;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file framecodec.hpp
+ * @brief Lossless frame compression (prediction + adaptive Rice coding), tiled over a thread pool.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Each sample is predicted from its same-colour neighbours to the left, above
+ * and above left (the LOCO-I median predictor; Bayer frames look two samples
+ * away, RGB frames three) and the residual is Rice coded, with the Rice
+ * parameter chosen per block of 32 residuals. The frame is cut into bands of
+ * rows that are coded independently, so encoding and decoding run on every
+ * thread of the pool, and a band that would not shrink is stored as is.
+ * Samples are 16 bits for formats stored in 16-bit words and bytes otherwise
+ * (packed formats therefore compress less well). Decoding is bit-exact.
+ *
+ * Coded frame, all fields little-endian:
+ *
+ *   [CodecHeader][uint32_t band size x ntiles][bands ...][tail bytes]
+ *
+ * A band size with CODEC_TILE_STORED set is a band stored uncoded.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capturestats.hpp"
+#include "framering.hpp"
+#include "string_format.hpp"
+
+/**
+ * @brief How a frame's pixel data is encoded, in FramePubHeader and RecFrameEntry.
+ *
+ */
+enum FrameEncoding : uint32_t
+{
+    FRAME_ENC_RAW = 0,  // as the camera delivered it
+    FRAME_ENC_RICE = 1, // FrameCodec
+};
+
+#define FRAME_CODEC_MAGIC 0x31434346 // "FCC1"
+#define CODEC_TILE_STORED 0x80000000u
+#define CODEC_MAX_TILES 1024
+
+struct CodecHeader
+{
+    uint32_t magic;       // FRAME_CODEC_MAGIC
+    uint32_t raw_size;    // bytes after decoding
+    uint32_t row_samples; // samples per row
+    uint32_t rows;        // rows coded; bytes past them are stored at the end as is
+    uint8_t sample_bits;  // 8 or 16
+    uint8_t step;         // distance to the same-colour sample on the left
+    uint8_t rowdist;      // distance to the same-colour row above
+    uint8_t reserved;
+    uint32_t tile_rows; // rows per band, the last band may be shorter
+    uint32_t ntiles;
+};
+
+static_assert(sizeof(CodecHeader) == 28, "CodecHeader layout changed.");
+
+// decoded bytes per coded byte at most: every sample costs at least one bit, and samples are 8 or 16 bits
+#define CODEC_MAX_RATIO 16
+
+/**
+ * @brief Largest coded size of a raw_size byte frame.
+ *
+ */
+static inline size_t frame_codec_bound(size_t raw_size)
+{
+    return raw_size + sizeof(CodecHeader) + CODEC_MAX_TILES * sizeof(uint32_t);
+}
+
+/**
+ * @brief Compression counters of one camera, from every place its frames are encoded (publisher and recorder).
+ *
+ */
+class CodecStats
+{
+public:
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> raw_bytes;
+    std::atomic<uint64_t> coded_bytes;
+    std::atomic<uint64_t> encode_ns;
+    LatencyHistogram encode; // time to encode one frame
+
+    CodecStats()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        frames = 0;
+        raw_bytes = 0;
+        coded_bytes = 0;
+        encode_ns = 0;
+        encode.reset();
+    }
+
+    void update(size_t raw, size_t coded, uint64_t ns)
+    {
+        frames.fetch_add(1, std::memory_order_relaxed);
+        raw_bytes.fetch_add(raw, std::memory_order_relaxed);
+        coded_bytes.fetch_add(coded, std::memory_order_relaxed);
+        encode_ns.fetch_add(ns, std::memory_order_relaxed);
+        encode.record(ns);
+    }
+
+    /**
+     * @brief Render the counters as a JSON object.
+     *
+     */
+    std::string to_string() const
+    {
+        uint64_t raw = raw_bytes.load(std::memory_order_relaxed);
+        uint64_t coded = coded_bytes.load(std::memory_order_relaxed);
+        uint64_t ns = encode_ns.load(std::memory_order_relaxed);
+        return string_format("{\"frames\": %llu, \"raw_bytes\": %llu, \"coded_bytes\": %llu, \"ratio\": %.3f, \"encode_mbps\": %.1f, "
+                             "\"encode_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f}}",
+                             (unsigned long long)frames.load(std::memory_order_relaxed),
+                             (unsigned long long)raw, (unsigned long long)coded,
+                             coded > 0 ? (double)raw / coded : 0.0,
+                             ns > 0 ? raw * 1e3 / ns : 0.0,
+                             encode.percentile(0.5) / 1e3, encode.percentile(0.99) / 1e3, encode.percentile(0.999) / 1e3);
+    }
+};
+
+class FrameCodec
+{
+    std::vector<std::thread> workers;
+    std::mutex job_lock; // one frame at a time; the job uses every thread
+
+    std::mutex lock; // protects the job below
+    std::condition_variable cv;
+    std::condition_variable done_cv;
+    const std::function<void(uint32_t)> *job = nullptr;
+    uint32_t njobs = 0;
+    std::atomic<uint32_t> next_job;
+    uint32_t finished = 0;
+    uint32_t active = 0; // workers inside the current job
+    uint64_t generation = 0;
+    bool quit = false;
+
+    std::vector<uint8_t> bands; // coded bands before they are packed together
+
+    void worker();
+    void parallel_for(uint32_t n, const std::function<void(uint32_t)> &fn);
+
+public:
+    /**
+     * @brief Start nthreads - 1 workers; the calling thread is the last one.
+     *
+     */
+    FrameCodec(unsigned nthreads);
+    ~FrameCodec();
+
+    FrameCodec(const FrameCodec &) = delete;
+    FrameCodec &operator=(const FrameCodec &) = delete;
+
+    unsigned threads() const
+    {
+        return workers.size() + 1;
+    }
+
+    /**
+     * @brief Compress one frame.
+     *
+     * @param hdr Describes src (size, geometry and pixel format).
+     * @param cap Size of dst; frame_codec_bound(hdr.size) always suffices.
+     * @param stats Counters to update; may be nullptr.
+     * @return Coded size, 0 if it does not fit in cap.
+     */
+    size_t encode(const FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap, CodecStats *stats);
+
+    /**
+     * @brief Decoded size of a coded frame, 0 if src is not one.
+     *
+     */
+    static size_t decoded_size(const uint8_t *src, size_t len);
+
+    /**
+     * @brief Decompress one frame into dst, which holds at least decoded_size() bytes.
+     *
+     * @return false if src is malformed.
+     */
+    bool decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+};
+
+/**
+ * @brief The process-wide codec, one thread per core up to 8, started at first use.
+ *
+ */
+FrameCodec &frame_codec();
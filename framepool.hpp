@@ -0,0 +1,292 @@
+/**
+ * @file framepool.hpp
+ * @brief Fixed pool of equally sized, reference counted frame buffers with lock-free acquire/release.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Buffers handed out by the pool may be returned from any thread (e.g. by the
+ * ZMQ I/O thread once the last subscriber has been served). Each buffer counts
+ * its holders: acquire() hands it out with one, hold() adds one while the
+ * buffer is still out, and it goes back to the pool when release() drops the
+ * last. The pool is reference counted as well: every outstanding buffer holds
+ * a reference, and the owner's reference is dropped with retire(), so a pool
+ * replaced while frames are still in flight is freed only when the last of
+ * them comes back.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "framealloc.hpp"
+#include "string_format.hpp"
+
+/**
+ * @brief Size of the frames a camera produces at its current settings.
+ *
+ */
+struct FrameGeometry
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bits_per_pixel = 0;
+
+    size_t frame_bytes() const
+    {
+        return ((size_t)width * height * bits_per_pixel + 7) / 8;
+    }
+
+    bool operator==(const FrameGeometry &other) const
+    {
+        return width == other.width && height == other.height && bits_per_pixel == other.bits_per_pixel;
+    }
+
+    bool operator!=(const FrameGeometry &other) const
+    {
+        return !(*this == other);
+    }
+
+    /**
+     * @brief Storage bits per pixel for a GenICam pixel format name.
+     *
+     * @param format image_format, e.g. Mono8, Mono12p, BayerRG8, RGB8.
+     * @param bit_depth sensor_bit_depth (e.g. Bpp12), used when the format does not say; may be nullptr.
+     * @return uint32_t Bits per pixel, 16 if unknown.
+     */
+    static uint32_t pixel_bits(const char *format, const char *bit_depth)
+    {
+        if (format != nullptr)
+        {
+            if (strstr(format, "RGBa") || strstr(format, "BGRa") || strstr(format, "RGBA") || strstr(format, "BGRA"))
+                return 32;
+            if (strstr(format, "RGB") || strstr(format, "BGR"))
+                return strstr(format, "16") ? 48 : 24;
+            if (strstr(format, "YUV422") || strstr(format, "YCbCr422"))
+                return 16;
+            if (strstr(format, "10p") || strstr(format, "10Packed"))
+                return 10;
+            if (strstr(format, "12p") || strstr(format, "12Packed"))
+                return 12;
+            if (strstr(format, "8"))
+                return 8;
+            if (strstr(format, "10") || strstr(format, "12") || strstr(format, "14") || strstr(format, "16"))
+                return 16;
+        }
+        if (bit_depth != nullptr)
+        {
+            int bits = atoi(bit_depth + strcspn(bit_depth, "0123456789"));
+            if (bits > 0)
+                return bits <= 8 ? 8 : 16;
+        }
+        return 16;
+    }
+};
+
+class FramePool
+{
+    static const uint32_t nil = 0xffffffff;
+
+    FrameArena arena;
+    size_t buf_size = 0;
+    uint32_t nbufs = 0;
+    std::atomic<uint32_t> *next = nullptr;
+    std::atomic<uint32_t> *holders = nullptr; // per buffer, 0 while it is free
+    std::atomic<uint64_t> top; // (ABA tag << 32) | index of first free buffer
+    std::atomic<int64_t> refs;
+    std::atomic<uint32_t> used;
+    std::atomic<uint32_t> peak;
+    std::atomic<uint64_t> misses;
+
+    FramePool(uint32_t nbufs, size_t buf_size)
+    {
+        this->nbufs = nbufs;
+        this->buf_size = (buf_size + 4095) & ~((size_t)4095);
+        arena = FrameArena::allocate(this->nbufs * this->buf_size);
+        next = new std::atomic<uint32_t>[nbufs];
+        holders = new std::atomic<uint32_t>[nbufs];
+        for (uint32_t i = 0; i < nbufs; i++)
+        {
+            next[i].store(i + 1 < nbufs ? i + 1 : nil, std::memory_order_relaxed);
+            holders[i].store(0, std::memory_order_relaxed);
+        }
+        top.store(nbufs > 0 ? 0 : nil, std::memory_order_relaxed);
+        used.store(0, std::memory_order_relaxed);
+        peak.store(0, std::memory_order_relaxed);
+        misses.store(0, std::memory_order_relaxed);
+        refs.store(1, std::memory_order_release);
+    }
+
+    ~FramePool()
+    {
+        delete[] next;
+        delete[] holders;
+        arena.release();
+    }
+
+    void unref()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    uint32_t index_of(const void *buf) const
+    {
+        return (uint32_t)(((const uint8_t *)buf - arena.base) / buf_size);
+    }
+
+public:
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    /**
+     * @brief Allocate a pool of nbufs buffers of at least buf_size bytes each.
+     *
+     * @return FramePool* Owned by the caller until retire() is called.
+     */
+    static FramePool *create(uint32_t nbufs, size_t buf_size)
+    {
+        return new FramePool(nbufs, buf_size);
+    }
+
+    size_t buffer_size() const
+    {
+        return buf_size;
+    }
+
+    uint32_t count() const
+    {
+        return nbufs;
+    }
+
+    uint32_t in_use() const
+    {
+        return used.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Most buffers ever in use at once.
+     *
+     */
+    uint32_t high_water() const
+    {
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of acquire() calls that found the pool empty.
+     *
+     */
+    uint64_t exhausted() const
+    {
+        return misses.load(std::memory_order_relaxed);
+    }
+
+    bool huge_pages() const
+    {
+        return arena.huge;
+    }
+
+    /**
+     * @brief Render the pool state as a JSON object.
+     *
+     */
+    std::string to_string() const
+    {
+        return string_format("{\"buffers\": %u, \"buffer_bytes\": %zu, \"hugepages\": %s, \"in_use\": %u, \"high_water\": %u, \"exhausted\": %llu}",
+                             nbufs, buf_size, arena.huge ? "true" : "false", in_use(), high_water(), (unsigned long long)exhausted());
+    }
+
+    /**
+     * @brief Take a free buffer, with one holder.
+     *
+     * @return void* nullptr if every buffer is in use.
+     */
+    void *acquire()
+    {
+        uint64_t old = top.load(std::memory_order_acquire);
+        while (true)
+        {
+            uint32_t idx = (uint32_t)old;
+            if (idx == nil)
+            {
+                misses.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            uint64_t desired = ((old >> 32) + 1) << 32 | next[idx].load(std::memory_order_relaxed);
+            if (top.compare_exchange_weak(old, desired, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                // release: whoever hold()s the buffer next also sees what its previous holder did before giving it back
+                holders[idx].store(1, std::memory_order_release);
+                refs.fetch_add(1, std::memory_order_relaxed);
+                uint32_t n = used.fetch_add(1, std::memory_order_relaxed) + 1;
+                uint32_t p = peak.load(std::memory_order_relaxed);
+                while (n > p && !peak.compare_exchange_weak(p, n, std::memory_order_relaxed))
+                    ;
+                return arena.base + idx * buf_size;
+            }
+        }
+    }
+
+    /**
+     * @brief Add a holder to a buffer that is still out. Safe to call from any thread.
+     *
+     * @return false if the buffer went back to the pool in the meantime; it was not touched.
+     */
+    bool hold(const void *buf)
+    {
+        std::atomic<uint32_t> &n = holders[index_of(buf)];
+        uint32_t old = n.load(std::memory_order_relaxed);
+        while (old != 0)
+        {
+            if (n.compare_exchange_weak(old, old + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Drop a holder of a buffer obtained from acquire() or hold(); the last one returns it. Safe to call from any thread.
+     *
+     */
+    void release(void *buf)
+    {
+        uint32_t idx = index_of(buf);
+        if (holders[idx].fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        used.fetch_sub(1, std::memory_order_relaxed);
+        uint64_t old = top.load(std::memory_order_relaxed);
+        while (true)
+        {
+            next[idx].store((uint32_t)old, std::memory_order_relaxed);
+            uint64_t desired = ((old >> 32) + 1) << 32 | idx;
+            if (top.compare_exchange_weak(old, desired, std::memory_order_acq_rel, std::memory_order_relaxed))
+                break;
+        }
+        unref();
+    }
+
+    /**
+     * @brief Drop the owner's reference. The pool is freed once every buffer is back.
+     *
+     */
+    void retire()
+    {
+        unref();
+    }
+
+    /**
+     * @brief Free function for zmq_msg_init_data(); hint is the owning FramePool.
+     *
+     */
+    static void zmq_free(void *data, void *hint)
+    {
+        ((FramePool *)hint)->release(data);
+    }
+};
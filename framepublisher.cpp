@@ -0,0 +1,351 @@
+#include "framepublisher.hpp"
+#include "capturestats.hpp"
+#include "meb_print.h"
+
+#include <zmq.h>
+#include <stdexcept>
+
+FramePublisher::FramePublisher(const char *endpoint)
+{
+    running = false;
+    sent = 0;
+    starved = 0;
+    converted = 0;
+    refused = 0;
+    sock = zsock_new_xpub(endpoint);
+    if (sock == nullptr)
+    {
+        dbprintlf(FATAL "Could not bind frame publisher to %s.", endpoint);
+        throw std::runtime_error("Could not bind frame publisher.");
+    }
+    dbprintlf(BLUE_FG "Pixel conversion kernels: %s", pixel_kernels().isa);
+    running = true;
+    thr = std::thread(&FramePublisher::run, this);
+    preview_thr = std::thread(&FramePublisher::run_previews, this);
+}
+
+FramePublisher::~FramePublisher()
+{
+    running = false;
+    if (preview_thr.joinable())
+        preview_thr.join();
+    if (thr.joinable())
+        thr.join();
+    for (auto &r : ready)
+        r.pool->release(r.buf);
+    zsock_destroy(&sock); // frames still queued return their buffers as ZMQ lets go of them
+}
+
+void FramePublisher::add_source(uint32_t hash, const FrameSource *src)
+{
+    std::unique_ptr<Preview> p(new Preview());
+    p->hash = hash;
+    p->src = src;
+    Source s;
+    s.hash = hash;
+    s.src = src;
+    s.preview = p.get();
+    {
+        std::lock_guard<std::mutex> guard(preview_lock);
+        previews.push_back(std::move(p));
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    sources.push_back(s);
+}
+
+void FramePublisher::poll_subscriptions()
+{
+    // XPUB delivers one message per first subscribe / last unsubscribe of a prefix
+    uint8_t buf[256];
+    int len;
+    while ((len = zmq_recv(zsock_resolve(sock), buf, sizeof(buf), ZMQ_DONTWAIT)) > 0)
+    {
+        if (len > (int)sizeof(buf))
+            len = sizeof(buf);
+        std::string prefix((const char *)buf + 1, len - 1);
+        if (buf[0] == 1)
+            subscriptions.insert(prefix);
+        else if (buf[0] == 0)
+            subscriptions.erase(prefix);
+    }
+}
+
+uint32_t FramePublisher::subscribed(uint32_t hash) const
+{
+    // bit n set: somebody wants PixelOutput n
+    static const uint32_t version = FRAME_PUB_VERSION;
+    const size_t full = 3 * sizeof(uint32_t);
+    uint32_t wanted = 0;
+    for (auto &prefix : subscriptions)
+    {
+        size_t n = prefix.size() < sizeof(hash) ? prefix.size() : sizeof(hash);
+        if (memcmp(prefix.data(), &hash, n) != 0)
+            continue;
+        if (prefix.size() < full)
+        {
+            wanted |= 1u << PIXOUT_RAW;
+            continue;
+        }
+        uint32_t out;
+        memcpy(&out, prefix.data() + 2 * sizeof(uint32_t), sizeof(out));
+        if (memcmp(prefix.data() + sizeof(hash), &version, sizeof(version)) == 0 && out < PIXOUT_COUNT)
+            wanted |= 1u << out;
+    }
+    return wanted;
+}
+
+void FramePublisher::send_converted(Source &s, PixelOutput out, const FramePubHeader &raw, const uint8_t *data)
+{
+    size_t need = pixel_output_max_size(raw.frame.width, raw.frame.height);
+    if (need < raw.frame.size)
+        need = raw.frame.size; // room for the raw fallback
+    if (!s.converted || s.converted->buffer_size() < need)
+    {
+        s.converted = std::shared_ptr<FramePool>(FramePool::create(8, need), [](FramePool *p)
+                                                 { p->retire(); });
+    }
+    void *buf = s.converted->acquire();
+    if (buf == nullptr)
+    {
+        starved++;
+        return;
+    }
+    FramePubHeader hdr = raw;
+    hdr.output = out;
+    if (!pixel_convert(out, hdr.frame, data, (uint8_t *)buf, s.converted->buffer_size()))
+    {
+        refused++;
+        memcpy(buf, data, raw.frame.size);
+    }
+    void *zsock = zsock_resolve(sock);
+    if (zmq_send(zsock, &hdr, sizeof(hdr), ZMQ_SNDMORE | ZMQ_DONTWAIT) < 0)
+    {
+        s.converted->release(buf);
+        return;
+    }
+    zmq_msg_t msg;
+    zmq_msg_init_data(&msg, buf, hdr.frame.size, &FramePool::zmq_free, s.converted.get());
+    if (zmq_msg_send(&msg, zsock, ZMQ_DONTWAIT) < 0)
+    {
+        zmq_msg_close(&msg);
+        return;
+    }
+    converted++;
+}
+
+bool FramePublisher::service(Source &s)
+{
+    std::shared_ptr<const FrameRing> ring = s.src->frames();
+    if (!ring)
+        return false;
+    if (ring != s.ring)
+    {
+        // camera (re)started capture with a new ring
+        s.ring = ring;
+        s.reader = FrameReader(ring.get());
+        s.pool = ring->pool();
+    }
+    uint32_t wanted = subscribed(s.hash);
+    s.preview->wanted = (wanted & (1u << PIXOUT_PREVIEW)) != 0;
+    wanted &= ~(1u << PIXOUT_PREVIEW); // made by the preview thread
+    if (wanted == 0)
+    {
+        s.reader.skip();
+        return false;
+    }
+    bool raw = wanted & (1u << PIXOUT_RAW);
+    CodecStats *codec = raw ? s.src->compression() : nullptr;
+    bool work = false;
+    void *zsock = zsock_resolve(sock);
+    while (s.reader.pending())
+    {
+        if (s.pool->in_use() + PUB_POOL_RESERVE > s.pool->count())
+        {
+            // everything else is still queued in ZMQ; let the reader lap rather than take the camera's last buffers
+            starved++;
+            s.reader.skip();
+            break;
+        }
+        FramePubHeader hdr;
+        hdr.camera = s.hash;
+        hdr.version = FRAME_PUB_VERSION;
+        hdr.output = PIXOUT_RAW;
+        hdr.encoding = FRAME_ENC_RAW;
+        // the ring's own buffer: converted and compressed from, or sent as is
+        uint8_t *frame;
+        if (s.reader.next(&hdr.frame, &frame) != FrameRing::READ_OK)
+            break;
+        work = true;
+        if (frame == nullptr)
+        {
+            starved++; // the camera had no buffer for this frame
+            continue;
+        }
+        for (uint32_t out = PIXOUT_RAW + 1; out < PIXOUT_PREVIEW; out++)
+        {
+            if (wanted & (1u << out))
+                send_converted(s, (PixelOutput)out, hdr, frame);
+        }
+        if (!raw)
+        {
+            s.pool->release(frame);
+            continue;
+        }
+        void *buf = frame;
+        if (codec != nullptr)
+        {
+            void *coded = s.pool->acquire();
+            if (coded == nullptr)
+            {
+                starved++; // sent raw
+            }
+            else
+            {
+                size_t n = frame_codec().encode(hdr.frame, frame, (uint8_t *)coded, s.pool->buffer_size(), codec);
+                if (n > 0)
+                {
+                    hdr.encoding = FRAME_ENC_RICE;
+                    hdr.frame.size = n;
+                    s.pool->release(frame);
+                    buf = coded;
+                }
+                else
+                {
+                    s.pool->release(coded); // did not shrink enough to fit: send the frame as is
+                }
+            }
+        }
+        if (zmq_send(zsock, &hdr, sizeof(hdr), ZMQ_SNDMORE | ZMQ_DONTWAIT) < 0)
+        {
+            s.pool->release(buf);
+            continue;
+        }
+        zmq_msg_t msg;
+        zmq_msg_init_data(&msg, buf, hdr.frame.size, &FramePool::zmq_free, s.pool.get());
+        if (zmq_msg_send(&msg, zsock, ZMQ_DONTWAIT) < 0)
+        {
+            zmq_msg_close(&msg); // runs zmq_free
+            continue;
+        }
+        sent++;
+    }
+    return work;
+}
+
+bool FramePublisher::make_preview(Preview &p, const PreviewSettings &settings)
+{
+    std::shared_ptr<const FrameRing> ring = p.src->frames();
+    if (!ring)
+        return false;
+    if (ring != p.ring)
+    {
+        p.ring = ring;
+        p.reader = FrameReader(ring.get());
+    }
+    FramePubHeader hdr;
+    hdr.camera = p.hash;
+    hdr.version = FRAME_PUB_VERSION;
+    hdr.output = PIXOUT_PREVIEW;
+    hdr.encoding = FRAME_ENC_RAW;
+    // only the newest frame matters; everything older is skipped, and the newest is reduced where it lies in the ring
+    uint8_t *frame;
+    if (p.reader.latest(&hdr.frame, &frame) != FrameRing::READ_OK)
+        return false;
+    if (frame == nullptr)
+    {
+        starved++;
+        return true;
+    }
+    size_t need = (size_t)hdr.frame.width * hdr.frame.height; // factor 1
+    if (!p.pool || p.pool->buffer_size() < need)
+    {
+        p.pool = std::shared_ptr<FramePool>(FramePool::create(4, need), [](FramePool *pool)
+                                            { pool->retire(); });
+    }
+    void *buf = p.pool->acquire();
+    if (buf == nullptr)
+    {
+        starved++;
+        ring->pool()->release(frame);
+        return true;
+    }
+    bool made = pixel_preview(settings, hdr.frame, frame, (uint8_t *)buf, p.pool->buffer_size());
+    ring->pool()->release(frame);
+    if (!made)
+    {
+        refused++;
+        p.pool->release(buf);
+        return true;
+    }
+    std::lock_guard<std::mutex> guard(ready_lock);
+    ready.push_back({hdr, buf, p.pool});
+    return true;
+}
+
+void FramePublisher::run_previews()
+{
+    while (running)
+    {
+        {
+            std::lock_guard<std::mutex> guard(preview_lock);
+            for (auto &p : previews)
+            {
+                if (!p->wanted)
+                    continue;
+                PreviewSettings settings = p->src->preview();
+                uint64_t now = mono_ns();
+                if (settings.framerate <= 0 || now < p->due_ns)
+                    continue;
+                if (make_preview(*p, settings))
+                    p->due_ns = now + (uint64_t)(1e9 / settings.framerate);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool FramePublisher::send_ready()
+{
+    std::vector<ReadyFrame> batch;
+    {
+        std::lock_guard<std::mutex> guard(ready_lock);
+        batch.swap(ready);
+    }
+    void *zsock = zsock_resolve(sock);
+    for (auto &r : batch)
+    {
+        if (zmq_send(zsock, &r.hdr, sizeof(r.hdr), ZMQ_SNDMORE | ZMQ_DONTWAIT) < 0)
+        {
+            r.pool->release(r.buf);
+            continue;
+        }
+        zmq_msg_t msg;
+        zmq_msg_init_data(&msg, r.buf, r.hdr.frame.size, &FramePool::zmq_free, r.pool.get());
+        if (zmq_msg_send(&msg, zsock, ZMQ_DONTWAIT) < 0)
+        {
+            zmq_msg_close(&msg);
+            continue;
+        }
+        converted++;
+    }
+    return !batch.empty();
+}
+
+void FramePublisher::run()
+{
+    while (running)
+    {
+        poll_subscriptions();
+        bool work = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto &s : sources)
+            {
+                work |= service(s);
+            }
+        }
+        work |= send_ready();
+        if (!work)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * @file framepublisher.hpp
+ * @brief Publishes captured frames on a ZMQ (X)PUB socket, sending the frame ring's buffers in place.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Every published frame is a two part message: a FramePubHeader followed by
+ * the pixel data. The header starts with the camera hash (little endian), so
+ * clients subscribe to a single camera with that 4-byte prefix, or to "" for
+ * every camera. A published frame is copied once: the capture callback copies
+ * it out of the SDK buffer (which the SDK wants back) into a buffer from the
+ * frame ring's pool. The publishing thread holds that buffer rather than
+ * copying it out of the ring, and hands it to ZMQ, which sends it in place and
+ * gives it back to the pool when the last subscriber has been served; the
+ * recorder and the previews read the same buffer. The publisher leaves
+ * PUB_POOL_RESERVE of the pool's buffers free, so a slow subscriber makes it
+ * skip frames rather than take the capture callback's last buffer.
+ *
+ * A client that wants the frames converted (see pixelconvert.hpp) subscribes
+ * to the full 12-byte prefix [camera][FRAME_PUB_VERSION][PixelOutput]; each
+ * output somebody asked for is produced once per frame, into a separate pool,
+ * however many clients share it. Shorter prefixes ask for raw frames, but as
+ * ZMQ matches prefixes they also receive every converted copy of the camera's
+ * frames, so filter on FramePubHeader::output. If a conversion does not apply
+ * to the camera's pixel format, the raw frame is sent under the requested
+ * output instead; frame.pixel_format always describes the payload.
+ *
+ * Raw frames of a camera with compression enabled are sent FRAME_ENC_RICE
+ * coded (see framecodec.hpp), or raw if coding would not make them smaller
+ * than the pool buffer; converted outputs and previews are never compressed.
+ *
+ * PIXOUT_PREVIEW is made on a thread of its own, from the newest frame at
+ * no more than the camera's preview framerate, so a full resolution reduction
+ * never holds up the frames of other cameras; the publishing thread only
+ * sends the finished previews.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <czmq.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framering.hpp"
+#include "framepool.hpp"
+#include "pixelconvert.hpp"
+#include "framecodec.hpp"
+
+struct FramePubHeader
+{
+    uint32_t camera;  // camera hash, as returned by "list"
+    uint32_t version; // FRAME_PUB_VERSION
+    uint32_t output;   // PixelOutput this message was produced for
+    uint32_t encoding; // FrameEncoding of the pixel data; frame.size is the encoded size
+    FrameHeader frame;
+};
+
+#define FRAME_PUB_VERSION 3
+// ring buffers the publisher leaves free: the frames the recorder and the preview thread hold, and one to compress into
+#define PUB_POOL_RESERVE 3
+
+class FramePublisher
+{
+    struct Preview
+    {
+        uint32_t hash;
+        const FrameSource *src;
+        std::shared_ptr<const FrameRing> ring;
+        FrameReader reader;
+        std::shared_ptr<FramePool> pool; // previews, sized on first use
+        uint64_t due_ns = 0;             // earliest time for the next preview
+        std::atomic<bool> wanted;        // somebody subscribes to this camera's previews
+
+        Preview()
+        {
+            wanted = false;
+        }
+    };
+
+    struct ReadyFrame
+    {
+        FramePubHeader hdr;
+        void *buf;
+        std::shared_ptr<FramePool> pool;
+    };
+
+    struct Source
+    {
+        uint32_t hash;
+        const FrameSource *src;
+        std::shared_ptr<const FrameRing> ring;
+        FrameReader reader;
+        std::shared_ptr<FramePool> pool;      // the ring's buffers; raw frames are sent straight out of them
+        std::shared_ptr<FramePool> converted; // converted frames, sized on first use
+        Preview *preview;                     // owned by previews
+    };
+
+    zsock_t *sock = nullptr;
+    std::thread thr;
+    std::atomic<bool> running;
+    std::mutex lock; // protects sources
+    std::vector<Source> sources;
+    std::set<std::string> subscriptions;
+    std::thread preview_thr;
+    std::mutex preview_lock; // protects previews
+    std::vector<std::unique_ptr<Preview>> previews;
+    std::mutex ready_lock; // protects ready
+    std::vector<ReadyFrame> ready; // previews waiting for the publishing thread
+
+    void run();
+    void run_previews();
+    bool make_preview(Preview &p, const PreviewSettings &settings);
+    bool send_ready();
+    void poll_subscriptions();
+    uint32_t subscribed(uint32_t hash) const;
+    bool service(Source &s);
+    void send_converted(Source &s, PixelOutput out, const FramePubHeader &raw, const uint8_t *data);
+
+public:
+    std::atomic<uint64_t> sent;    // frames handed to ZMQ
+    std::atomic<uint64_t> starved; // times the camera's frame pool had no buffer for the next frame
+    std::atomic<uint64_t> converted; // converted frames and previews handed to ZMQ
+    std::atomic<uint64_t> refused;   // conversions that did not apply, sent raw instead
+
+    /**
+     * @brief Bind the publisher socket and start the publishing and preview threads.
+     *
+     * @param endpoint ZMQ endpoint to bind, e.g. "tcp://0.0.0.0:5556"
+     */
+    FramePublisher(const char *endpoint);
+    ~FramePublisher();
+
+    FramePublisher(const FramePublisher &) = delete;
+    FramePublisher &operator=(const FramePublisher &) = delete;
+
+    /**
+     * @brief Start publishing frames from a camera.
+     *
+     * @param hash Camera hash placed in every header.
+     * @param src Frame source; must outlive the publisher.
+     */
+    void add_source(uint32_t hash, const FrameSource *src);
+};
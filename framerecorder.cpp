@@ -0,0 +1,344 @@
+#include "framerecorder.hpp"
+#include "capturestats.hpp"
+#include "framecodec.hpp"
+#include "meb_print.h"
+#include "string_format.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+#define REC_MIN_CHUNK (16UL * 1024 * 1024)
+
+static inline uint64_t round_up(uint64_t v, uint64_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+FrameRecorder::FrameRecorder(const FrameSource *src, const std::string &idstr, const std::string &path, int nchunks)
+{
+    this->src = src;
+    this->path = path;
+    frames = 0;
+    bytes = 0;
+    lost = 0;
+    stalls = 0;
+    written = 0;
+    write_ns = 0;
+    write_errors = 0;
+    queue_max = 0;
+    if (nchunks < 2)
+        nchunks = 2;
+
+    // a chunk holds at least a few of the largest frames the ring can deliver, compressed or not
+    std::shared_ptr<const FrameRing> ring = src->frames();
+    size_t max_record = sizeof(RecFrameEntry) + round_up(frame_codec_bound(ring ? ring->max_frame_size() : 0), REC_ALIGN);
+    chunk_size = round_up(4 * max_record, FRAME_HUGE_PAGE_SIZE);
+    if (chunk_size < REC_MIN_CHUNK)
+        chunk_size = REC_MIN_CHUNK;
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_DIRECT, 0644);
+    if (fd >= 0)
+    {
+        direct = true;
+    }
+    else if (errno == EINVAL)
+    {
+        // file system without O_DIRECT (e.g. tmpfs): the same aligned writes, through the page cache
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0)
+    {
+        dbprintlf(RED_FG "Could not create recording %s: %s", path.c_str(), strerror(errno));
+        throw std::runtime_error("Could not create recording.");
+    }
+
+    try
+    {
+        arena = FrameArena::allocate(chunk_size * nchunks);
+    }
+    catch (const std::bad_alloc &e)
+    {
+        close(fd);
+        throw;
+    }
+    for (int i = 0; i < nchunks; i++)
+    {
+        Chunk c;
+        c.buf = arena.base + i * chunk_size;
+        c.used = 0;
+        c.file_off = 0;
+        chunks.push_back(c);
+        free_chunks.push_back(i);
+    }
+    index.reserve(4096);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REC_MAGIC, sizeof(header.magic));
+    header.version = REC_VERSION;
+    header.header_size = REC_BLOCK;
+    strncpy(header.camera_idstr, idstr.c_str(), sizeof(header.camera_idstr) - 1);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    // header goes out now, so even an unfinished recording is recognisable
+    memcpy(chunks[0].buf, &header, sizeof(header));
+    if (!write_at(chunks[0].buf, REC_BLOCK, 0))
+    {
+        close(fd);
+        arena.release();
+        throw std::runtime_error("Could not write recording header.");
+    }
+
+    running = true;
+    write_thr = std::thread(&FrameRecorder::write, this);
+    drain_thr = std::thread(&FrameRecorder::drain, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+    arena.release();
+}
+
+bool FrameRecorder::write_at(const uint8_t *buf, size_t len, uint64_t off)
+{
+    uint64_t t0 = mono_ns();
+    while (len > 0)
+    {
+        ssize_t ret = pwrite(fd, buf, len, off);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (write_errors.fetch_add(1, std::memory_order_relaxed) == 0)
+                dbprintlf(RED_FG "Could not write to recording %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        buf += ret;
+        len -= ret;
+        off += ret;
+        written.fetch_add(ret, std::memory_order_relaxed);
+    }
+    write_ns.fetch_add(mono_ns() - t0, std::memory_order_relaxed);
+    return true;
+}
+
+int FrameRecorder::acquire_chunk()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if (free_chunks.empty())
+    {
+        stalls.fetch_add(1, std::memory_order_relaxed);
+        cv.wait(guard, [this]
+                { return !free_chunks.empty(); });
+    }
+    int idx = free_chunks.back();
+    free_chunks.pop_back();
+    chunks[idx].used = 0;
+    chunks[idx].file_off = next_off;
+    return idx;
+}
+
+void FrameRecorder::submit(int idx)
+{
+    Chunk &c = chunks[idx];
+    data_end = c.file_off + c.used;
+    // O_DIRECT wants whole blocks; the padding is zeros the index never points at
+    size_t len = round_up(c.used, REC_BLOCK);
+    memset(c.buf + c.used, 0, len - c.used);
+    next_off = c.file_off + len;
+    std::lock_guard<std::mutex> guard(lock);
+    full.push_back(idx);
+    if (full.size() > queue_max.load(std::memory_order_relaxed))
+        queue_max.store(full.size(), std::memory_order_relaxed);
+    cv.notify_all();
+}
+
+void FrameRecorder::drain()
+{
+    std::shared_ptr<const FrameRing> ring;
+    FrameReader reader;
+    uint64_t reader_lost = 0;
+    int cur = acquire_chunk();
+    while (true)
+    {
+        std::shared_ptr<const FrameRing> r = src->frames();
+        if (r && r != ring)
+        {
+            // camera (re)started capture with a new ring
+            if (ring)
+                lost.fetch_add(reader.dropped - reader_lost, std::memory_order_relaxed);
+            ring = r;
+            reader = FrameReader(ring.get());
+            reader_lost = 0;
+        }
+        if (!ring || !reader.pending())
+        {
+            if (!running)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        size_t max_record = sizeof(RecFrameEntry) + round_up(frame_codec_bound(ring->max_frame_size()), REC_ALIGN);
+        if (max_record > chunk_size)
+        {
+            // frame size grew past what this recording was set up for
+            reader.skip();
+            lost.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (chunk_size - chunks[cur].used < max_record)
+        {
+            submit(cur);
+            cur = acquire_chunk();
+        }
+        Chunk &c = chunks[cur];
+        RecFrameEntry *entry = (RecFrameEntry *)(c.buf + c.used);
+        uint8_t *data = c.buf + c.used + sizeof(RecFrameEntry);
+        CodecStats *codec = src->compression();
+        FrameHeader hdr;
+        uint8_t *frame = nullptr; // held ring buffer, compressed straight into the chunk
+        if (codec != nullptr ? reader.next(&hdr, &frame) != FrameRing::READ_OK
+                             : reader.next(&hdr, data, ring->max_frame_size()) != FrameRing::READ_OK)
+            continue;
+        uint32_t raw_size = hdr.size;
+        uint32_t encoding = FRAME_ENC_RAW;
+        if (frame != nullptr)
+        {
+            // the chunk has room for frame_codec_bound(), so this always fits
+            size_t n = frame_codec().encode(hdr, frame, data, max_record - sizeof(RecFrameEntry), codec);
+            if (n > 0)
+            {
+                hdr.size = n;
+                encoding = FRAME_ENC_RICE;
+            }
+            else
+            {
+                memcpy(data, frame, hdr.size);
+            }
+            ring->pool()->release(frame);
+        }
+        if (reader.dropped != reader_lost)
+        {
+            lost.fetch_add(reader.dropped - reader_lost, std::memory_order_relaxed);
+            reader_lost = reader.dropped;
+        }
+        memset(entry, 0, sizeof(RecFrameEntry));
+        entry->offset = c.file_off + c.used + sizeof(RecFrameEntry);
+        entry->frame_id = hdr.frame_id;
+        entry->timestamp = hdr.timestamp;
+        entry->size = hdr.size;
+        entry->width = hdr.width;
+        entry->height = hdr.height;
+        entry->pixel_format = hdr.pixel_format;
+        entry->status = hdr.status;
+        entry->truncated = hdr.truncated;
+        entry->encoding = encoding;
+        entry->raw_size = raw_size;
+        entry->host_ns = hdr.host_ns;
+        entry->exposure_us = hdr.exposure_us;
+        entry->flags = hdr.flags;
+        entry->adio_state = hdr.adio_state;
+        index.push_back(*entry);
+        c.used += sizeof(RecFrameEntry) + round_up(hdr.size, REC_ALIGN);
+        frames.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(hdr.size, std::memory_order_relaxed);
+    }
+    if (chunks[cur].used > 0)
+    {
+        submit(cur);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        free_chunks.push_back(cur);
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    drained = true;
+    cv.notify_all();
+}
+
+void FrameRecorder::write()
+{
+    while (true)
+    {
+        int idx;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [this]
+                    { return !full.empty() || drained; });
+            if (full.empty())
+                break;
+            idx = full.front();
+            full.pop_front();
+        }
+        Chunk &c = chunks[idx];
+        write_at(c.buf, round_up(c.used, REC_BLOCK), c.file_off);
+        std::lock_guard<std::mutex> guard(lock);
+        free_chunks.push_back(idx);
+        cv.notify_all();
+    }
+}
+
+void FrameRecorder::finish()
+{
+    // index, written through the (now idle) chunks
+    uint64_t index_off = next_off;
+    const uint8_t *src_bytes = (const uint8_t *)index.data();
+    size_t total = index.size() * sizeof(RecFrameEntry);
+    size_t done = 0;
+    while (done < total)
+    {
+        size_t n = total - done < chunk_size ? total - done : chunk_size;
+        memcpy(chunks[0].buf, src_bytes + done, n);
+        size_t len = round_up(n, REC_BLOCK);
+        memset(chunks[0].buf + n, 0, len - n);
+        write_at(chunks[0].buf, len, index_off + done);
+        done += n;
+    }
+    header.frames = index.size();
+    header.index_offset = index_off;
+    header.data_end = data_end;
+    memcpy(chunks[0].buf, &header, sizeof(header));
+    write_at(chunks[0].buf, REC_BLOCK, 0);
+    // drop the padding after the index
+    if (ftruncate(fd, index_off + total) != 0)
+        dbprintlf(YELLOW_FG "Could not trim recording %s: %s", path.c_str(), strerror(errno));
+    fdatasync(fd);
+    close(fd);
+    fd = -1;
+}
+
+void FrameRecorder::stop()
+{
+    if (stopped)
+        return;
+    stopped = true;
+    running = false;
+    if (drain_thr.joinable())
+        drain_thr.join();
+    if (write_thr.joinable())
+        write_thr.join();
+    finish();
+}
+
+std::string FrameRecorder::to_string() const
+{
+    uint64_t wbytes = written.load(std::memory_order_relaxed);
+    uint64_t wns = write_ns.load(std::memory_order_relaxed);
+    return string_format("{\"path\": \"%s\", \"direct\": %s, \"frames\": %llu, \"bytes\": %llu, \"lost\": %llu, "
+                         "\"stalls\": %llu, \"write_errors\": %llu, \"queue_max\": %llu, \"write_mbps\": %.1f}",
+                         path.c_str(), direct ? "true" : "false",
+                         (unsigned long long)frames.load(std::memory_order_relaxed),
+                         (unsigned long long)bytes.load(std::memory_order_relaxed),
+                         (unsigned long long)lost.load(std::memory_order_relaxed),
+                         (unsigned long long)stalls.load(std::memory_order_relaxed),
+                         (unsigned long long)write_errors.load(std::memory_order_relaxed),
+                         (unsigned long long)queue_max.load(std::memory_order_relaxed),
+                         wns > 0 ? wbytes * 1e3 / wns : 0.0);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file framerecorder.hpp
+ * @brief Streams one camera's frames to disk in the recording.hpp container.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Two threads per recording. The drain thread reads frames out of the
+ * camera's frame ring, like any other consumer, and packs them back to back
+ * into large page-aligned chunks. The writer thread writes full chunks to the
+ * file with one pwrite each, through O_DIRECT where the file system supports
+ * it. The capture callback is never involved: if the disk falls behind, the
+ * chunks absorb it, and only once every chunk is queued does the drain
+ * thread fall behind the ring and lose frames, which are counted.
+ * If the camera has compression enabled, the drain thread holds each frame's
+ * ring buffer and encodes it from there straight into the chunk (see
+ * framecodec.hpp).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framering.hpp"
+#include "recording.hpp"
+
+class FrameRecorder
+{
+    struct Chunk
+    {
+        uint8_t *buf;
+        size_t used;       // bytes of records
+        uint64_t file_off; // where the chunk goes in the file
+    };
+
+    const FrameSource *src;
+    std::string path;
+    int fd = -1;
+    bool direct = false; // opened with O_DIRECT
+    RecFileHeader header;
+
+    FrameArena arena; // every chunk
+    size_t chunk_size = 0;
+    std::vector<Chunk> chunks;
+    uint64_t next_off = REC_BLOCK; // file offset of the next chunk
+    uint64_t data_end = REC_BLOCK;
+    std::vector<RecFrameEntry> index; // drain thread only
+
+    std::mutex lock; // protects full, free_chunks, drained
+    std::condition_variable cv;
+    std::deque<int> full;         // chunks waiting for the writer, in file order
+    std::vector<int> free_chunks; // chunks the drain thread may fill
+    bool drained = false;         // drain thread is done, writer exits once full is empty
+
+    std::atomic<bool> running;
+    std::thread drain_thr;
+    std::thread write_thr;
+    bool stopped = false;
+
+    int acquire_chunk();
+    void submit(int idx);
+    bool write_at(const uint8_t *buf, size_t len, uint64_t off);
+    void drain();
+    void write();
+    void finish();
+
+public:
+    std::atomic<uint64_t> frames;       // frames written into chunks
+    std::atomic<uint64_t> bytes;        // pixel bytes written into chunks, after compression
+    std::atomic<uint64_t> lost;         // frames the drain thread missed because the ring lapped it
+    std::atomic<uint64_t> stalls;       // times the drain thread waited for the writer
+    std::atomic<uint64_t> written;      // bytes written to the file
+    std::atomic<uint64_t> write_ns;     // time spent in pwrite
+    std::atomic<uint64_t> write_errors;
+    std::atomic<uint64_t> queue_max;    // most chunks ever waiting for the writer
+
+    /**
+     * @brief Create the file and start recording.
+     *
+     * @param src Camera to record; must outlive the recorder.
+     * @param idstr Camera ID string stored in the file header.
+     * @param path File to create. Never overwritten: fails if it exists.
+     * @param nchunks Number of chunks, i.e. how many chunk writes the disk may fall behind.
+     * @throws std::runtime_error if the file cannot be created, std::bad_alloc if chunks cannot be allocated.
+     */
+    FrameRecorder(const FrameSource *src, const std::string &idstr, const std::string &path, int nchunks = 4);
+
+    /**
+     * @brief Stops the recording if still running.
+     *
+     */
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    /**
+     * @brief Record whatever is still in the ring, flush, write the index and close the file.
+     *
+     */
+    void stop();
+
+    const std::string &file() const
+    {
+        return path;
+    }
+
+    /**
+     * @brief Render the recording statistics as a JSON object.
+     *
+     */
+    std::string to_string() const;
+};
@@ -0,0 +1,412 @@
+/**
+ * @file framering.hpp
+ * @brief Lock-free single-producer/multi-consumer ring of pre-allocated frame slots.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The producer (the SDK frame callback) never blocks and never allocates: it
+ * copies the frame into a buffer from the ring's FramePool, publishes that
+ * buffer in the next slot under a per-slot sequence lock and moves on,
+ * dropping the slot's hold on the buffer it replaces. Consumers keep their own
+ * cursor and detect when the producer has lapped them, in which case they skip
+ * ahead instead of holding the producer back. A consumer either copies a frame
+ * out, or holds the slot's buffer and hands it on without a copy (e.g. to ZMQ,
+ * which releases it once sent); the producer never writes to a buffer that is
+ * still held, it takes a free one. If every buffer is held, the frame is kept
+ * as a header with no pixel data (size 0, truncated), and the pool counts it
+ * as exhausted.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+#include "framepool.hpp"
+
+enum FrameFlags : uint32_t
+{
+    FRAME_FLAG_COMPLETE = 1,     // received completely and not truncated
+    FRAME_FLAG_GAP = 2,          // frame IDs are missing before this one
+    FRAME_FLAG_OUT_OF_ORDER = 4, // frame ID not above the previous one (repeat, reorder or camera restart)
+    FRAME_FLAG_ADIO = 8,         // adio_state is valid
+};
+
+/**
+ * @brief Description of one frame stored in the ring: a fixed 64-byte metadata record filled in by the capture callback.
+ *
+ */
+struct FrameHeader
+{
+    uint64_t frame_id;     // frame ID assigned by the camera
+    uint64_t timestamp;    // camera timestamp (ticks)
+    uint32_t width;        // image width in pixels
+    uint32_t height;       // image height in pixels
+    uint32_t pixel_format; // VmbPixelFormat_t
+    int32_t status;        // VmbFrameStatus_t
+    uint32_t size;         // number of valid pixel bytes in the slot
+    uint32_t truncated;    // 1 if the frame did not fit in the slot, or no buffer was free
+    uint64_t host_ns;      // CLOCK_MONOTONIC at callback entry
+    double exposure_us;    // exposure in effect, 0 if unknown
+    uint32_t flags;        // FrameFlags
+    uint32_t adio_state;   // aDIO port 0 as last written, with FRAME_FLAG_ADIO
+};
+
+static_assert(sizeof(FrameHeader) == 64, "FrameHeader layout changed.");
+
+class FrameRing
+{
+public:
+    enum ReadStatus
+    {
+        READ_OK = 0,      // frame copied out or held
+        READ_EMPTY = 1,   // requested frame has not been written yet
+        READ_OVERRUN = 2, // requested frame was overwritten by the producer
+    };
+
+private:
+    struct alignas(64) Slot
+    {
+        // 2n + 1 while frame n is being written, 2n + 2 once it is complete.
+        std::atomic<uint64_t> seq;
+        FrameHeader hdr;
+        uint8_t *data; // buffer from bufs, held by the slot; nullptr if none
+    };
+
+    Slot *slots = nullptr;
+    std::shared_ptr<FramePool> bufs;
+    size_t nslots = 0;
+    size_t slot_size = 0;
+    alignas(64) std::atomic<uint64_t> whead; // number of frames committed
+
+public:
+    /**
+     * @brief Allocate the slots and a pool of nslots + spare buffers of slot_size bytes.
+     *
+     * @param spare Buffers consumers may hold beyond those of the slots before the producer runs out.
+     */
+    FrameRing(size_t nslots, size_t slot_size, uint32_t spare)
+    {
+        if (nslots == 0 || slot_size == 0)
+            throw std::invalid_argument("Frame ring needs at least one non-empty slot.");
+        this->nslots = nslots;
+        bufs = std::shared_ptr<FramePool>(FramePool::create(nslots + spare, slot_size), [](FramePool *p)
+                                          { p->retire(); });
+        this->slot_size = bufs->buffer_size(); // page aligned
+        slots = new Slot[nslots];
+        for (size_t i = 0; i < nslots; i++)
+        {
+            slots[i].seq.store(0, std::memory_order_relaxed);
+            memset(&slots[i].hdr, 0, sizeof(FrameHeader));
+            slots[i].data = nullptr;
+        }
+        whead.store(0, std::memory_order_release);
+    }
+
+    ~FrameRing()
+    {
+        // buffers still held by consumers keep the pool alive
+        for (size_t i = 0; i < nslots; i++)
+        {
+            if (slots[i].data != nullptr)
+                bufs->release(slots[i].data);
+        }
+        delete[] slots;
+    }
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    size_t capacity() const
+    {
+        return nslots;
+    }
+
+    size_t max_frame_size() const
+    {
+        return slot_size;
+    }
+
+    /**
+     * @brief Pool the slots' buffers come from; held buffers go back to it.
+     *
+     */
+    std::shared_ptr<FramePool> pool() const
+    {
+        return bufs;
+    }
+
+    /**
+     * @brief Number of frames committed so far. The most recent frame is head() - 1.
+     *
+     */
+    uint64_t head() const
+    {
+        return whead.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Copy a frame into a free buffer and put it in the next slot. Producer side, lock-free.
+     *
+     * @param hdr Frame description; hdr.size is the number of bytes at data.
+     * @param data Pixel data.
+     * @return true if the whole frame fit, false if it was truncated or no buffer was free.
+     */
+    bool push(const FrameHeader &hdr, const void *data)
+    {
+        uint64_t n = whead.load(std::memory_order_relaxed);
+        Slot &slot = slots[n % nslots];
+        slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        // given back first, so that unless somebody still holds it, it is the buffer taken next
+        if (slot.data != nullptr)
+            bufs->release(slot.data);
+        slot.data = (uint8_t *)bufs->acquire();
+        size_t len = hdr.size;
+        bool fits = len <= slot_size && slot.data != nullptr;
+        if (slot.data == nullptr)
+            len = 0;
+        else if (len > slot_size)
+            len = slot_size;
+        slot.hdr = hdr;
+        slot.hdr.size = len;
+        slot.hdr.truncated = fits ? 0 : 1;
+        if (!fits)
+            slot.hdr.flags &= ~FRAME_FLAG_COMPLETE;
+        if (data != nullptr && len > 0)
+            memcpy(slot.data, data, len);
+        slot.seq.store(2 * n + 2, std::memory_order_release);
+        whead.store(n + 1, std::memory_order_release);
+        return fits;
+    }
+
+    /**
+     * @brief Copy frame number idx out of the ring. Consumer side, never blocks the producer.
+     *
+     * @param idx Frame number (0 is the first frame ever pushed).
+     * @param hdr Receives the frame description.
+     * @param dst Receives up to cap bytes of pixel data; may be nullptr to fetch the header only.
+     * @param cap Size of dst.
+     * @return ReadStatus
+     */
+    ReadStatus read(uint64_t idx, FrameHeader *hdr, void *dst, size_t cap) const
+    {
+        const Slot &slot = slots[idx % nslots];
+        uint64_t s1 = slot.seq.load(std::memory_order_acquire);
+        if (s1 < 2 * idx + 2)
+            return READ_EMPTY;
+        if (s1 != 2 * idx + 2)
+            return READ_OVERRUN;
+        FrameHeader h = slot.hdr;
+        if (dst != nullptr && h.size > 0)
+            memcpy(dst, slot.data, h.size < cap ? h.size : cap);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != s1)
+            return READ_OVERRUN;
+        if (hdr != nullptr)
+            *hdr = h;
+        return READ_OK;
+    }
+
+    /**
+     * @brief Hold the buffer of frame number idx instead of copying it. Consumer side, never blocks the producer.
+     *
+     * @param idx Frame number (0 is the first frame ever pushed).
+     * @param hdr Receives the frame description.
+     * @param buf Receives the held buffer, to be given back with pool()->release(); nullptr if the frame has no pixel data.
+     * @return ReadStatus
+     */
+    ReadStatus hold(uint64_t idx, FrameHeader *hdr, uint8_t **buf) const
+    {
+        const Slot &slot = slots[idx % nslots];
+        uint64_t s1 = slot.seq.load(std::memory_order_acquire);
+        if (s1 < 2 * idx + 2)
+            return READ_EMPTY;
+        if (s1 != 2 * idx + 2)
+            return READ_OVERRUN;
+        FrameHeader h = slot.hdr;
+        uint8_t *data = slot.data;
+        // fails only if the producer has already moved on from this slot
+        if (data != nullptr && !bufs->hold(data))
+            return READ_OVERRUN;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != s1)
+        {
+            if (data != nullptr)
+                bufs->release(data); // the buffer may belong to a newer frame by now
+            return READ_OVERRUN;
+        }
+        if (h.size == 0 && data != nullptr)
+        {
+            bufs->release(data);
+            data = nullptr;
+        }
+        *hdr = h;
+        *buf = data;
+        return READ_OK;
+    }
+};
+
+/**
+ * @brief Per-consumer cursor into a FrameRing.
+ *
+ */
+class FrameReader
+{
+    const FrameRing *ring = nullptr;
+    uint64_t next_idx = 0;
+
+    FrameRing::ReadStatus advance(FrameRing::ReadStatus ret)
+    {
+        if (ret == FrameRing::READ_OK)
+            next_idx++;
+        return ret;
+    }
+
+    void lapped()
+    {
+        // jump to the oldest slot that can still be valid
+        uint64_t head = ring->head();
+        uint64_t oldest = head > ring->capacity() ? head - ring->capacity() + 1 : 0;
+        if (oldest <= next_idx)
+            oldest = next_idx + 1;
+        dropped += oldest - next_idx;
+        next_idx = oldest;
+    }
+
+public:
+    uint64_t dropped = 0; // frames skipped because the producer lapped this reader
+
+    FrameReader()
+    {
+    }
+
+    /**
+     * @brief Attach to a ring, starting with the next frame to be pushed.
+     *
+     */
+    FrameReader(const FrameRing *ring)
+    {
+        this->ring = ring;
+        next_idx = ring->head();
+    }
+
+    /**
+     * @brief Fetch the next unread frame. On overrun, skips to the oldest frame still in the ring.
+     *
+     */
+    FrameRing::ReadStatus next(FrameHeader *hdr, void *dst, size_t cap)
+    {
+        while (true)
+        {
+            FrameRing::ReadStatus ret = ring->read(next_idx, hdr, dst, cap);
+            if (ret != FrameRing::READ_OVERRUN)
+                return advance(ret);
+            lapped();
+        }
+    }
+
+    /**
+     * @brief Hold the next unread frame's buffer (see FrameRing::hold()). On overrun, skips to the oldest frame still in the ring.
+     *
+     */
+    FrameRing::ReadStatus next(FrameHeader *hdr, uint8_t **buf)
+    {
+        while (true)
+        {
+            FrameRing::ReadStatus ret = ring->hold(next_idx, hdr, buf);
+            if (ret != FrameRing::READ_OVERRUN)
+                return advance(ret);
+            lapped();
+        }
+    }
+
+    /**
+     * @brief Whether a frame newer than the last one read is in the ring.
+     *
+     */
+    bool pending() const
+    {
+        return ring->head() > next_idx;
+    }
+
+    /**
+     * @brief Forget every unread frame without copying it.
+     *
+     */
+    void skip()
+    {
+        uint64_t head = ring->head();
+        if (head > next_idx)
+            next_idx = head;
+    }
+
+    /**
+     * @brief Hold the most recent frame's buffer, discarding anything older.
+     *
+     */
+    FrameRing::ReadStatus latest(FrameHeader *hdr, uint8_t **buf)
+    {
+        uint64_t head = ring->head();
+        if (head == 0 || head <= next_idx)
+            return FrameRing::READ_EMPTY;
+        dropped += head - 1 - next_idx;
+        next_idx = head - 1;
+        return next(hdr, buf);
+    }
+};
+
+class CodecStats;
+
+/**
+ * @brief How a source wants its live preview made (see pixel_preview()).
+ *
+ */
+struct PreviewSettings
+{
+    uint32_t factor = 4;   // preview is 1/factor of the frame in each direction: 1, 2, 4 or 8
+    bool decimate = false; // keep every factor-th pixel instead of averaging factor x factor blocks
+    double framerate = 5;  // at most this many previews per second, 0 for none
+};
+
+/**
+ * @brief Anything that owns a FrameRing consumers can attach to.
+ *
+ */
+class FrameSource
+{
+public:
+    virtual ~FrameSource()
+    {
+    }
+
+    /**
+     * @brief Current frame ring, with its buffer pool; may change between captures, nullptr before the first one.
+     *
+     */
+    virtual std::shared_ptr<const FrameRing> frames() const = 0;
+
+    /**
+     * @brief Current preview settings; may be called from any thread.
+     *
+     */
+    virtual PreviewSettings preview() const
+    {
+        return PreviewSettings();
+    }
+
+    /**
+     * @brief Where to count compression if frames leave the server compressed (see framecodec.hpp); nullptr to send and record them raw.
+     *
+     */
+    virtual CodecStats *compression() const
+    {
+        return nullptr;
+    }
+};
@@ -19,17 +19,39 @@
 #include <math.h>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <vector>
-#include <aDIO_library.h>
 #include <map>
+#include <set>
+#include <list>
 #include <exception>
 #include <stdarg.h>
 #include <signal.h>
+#include <sys/stat.h>
 
 #include "meb_print.h"
 #include "stringhasher.hpp"
+#include "cameraregistry.hpp"
 #include "string_format.hpp"
+#include "framering.hpp"
+#include "framepublisher.hpp"
+#include "framecodec.hpp"
+#include "capturestats.hpp"
+#include "commandtable.hpp"
+#include "featurecache.hpp"
+#include "binproto.hpp"
+#include "adioengine.hpp"
+#include "framerecorder.hpp"
+#include "playback.hpp"
+#include "alliedbackend.hpp"
+#include "syntheticbackend.hpp"
+#include "dioport.hpp"
+#include "pixelformat.hpp"
+#include "bandwidth.hpp"
+#include "asynclog.hpp"
+#include "metrics.hpp"
+#include "camerastartup.hpp"
 
 volatile sig_atomic_t done = 0;
 
@@ -45,6 +67,7 @@ public:
     std::string name;
     std::string model;
     std::string serial;
+    std::string link; // cameras on the same link share its bandwidth budget; empty for none
 
     CameraInfo()
     {
@@ -52,6 +75,7 @@ public:
         name = "";
         model = "";
         serial = "";
+        link = "";
     }
 
     CameraInfo(VmbCameraInfo_t info)
@@ -71,349 +95,1609 @@ public:
     }
 };
 
-enum CommandNames
-{
-    image_format = 100,       // string
-    sensor_bit_depth = 101,   // string
-    trigline = 102,           // string
-    trigline_src = 103,       // string
-    exposure_us = 104,        // double
-    acq_framerate = 105,      // double
-    acq_framerate_auto = 106, // bool
-    image_size = 200,         // special, two arguments, ints
-    image_ofst = 201,         // special, two arguments, ints
-    sensor_size = 202,
-    throughput_limit = 300,       // int
-    throughput_limit_range = 301, // special
-    adio_bit = 10,                // special
-};
+class ImageCam : public FrameSource, public LinkMember
+{
+    bool capturing;
+    ADIOEngine *adio = nullptr;
+    CameraInfo info;
+    FrameRing *ring = nullptr;             // used by the callback, only replaced while not capturing
+    std::shared_ptr<FrameRing> ring_owner; // keeps the ring and its buffers alive for consumers
+    FrameGeometry geometry;                // frame layout as of the last reconfigure()
+    bool geometry_dirty = false;           // geometry changed while capturing, buffers resized at next start
 
-#define SET_CASE_STR(NAME)                                   \
-    case CommandNames::NAME:                                 \
-    {                                                        \
-        err = allied_set_##NAME(image_cam.handle, argument); \
-        break;                                               \
+    /**
+     * @brief (Re)allocate the frame ring and its buffers for the current geometry. Not while capturing.
+     *
+     */
+    VmbError_t allocate_buffers()
+    {
+        size_t fsize = geometry.frame_bytes();
+        if (fsize == 0)
+            return VmbErrorInvalidValue;
+        try
+        {
+            // consumers still holding the old ring or its buffers keep them alive until they move on
+            std::shared_ptr<FrameRing> nring = std::make_shared<FrameRing>(frame_ring_slots, fsize, frame_pool_buffers);
+            std::atomic_store(&ring_owner, nring);
+            ring = nring.get();
+        }
+        catch (const std::bad_alloc &e)
+        {
+            dbprintlf(FATAL "Could not allocate frame buffers for %s (%zu bytes per frame).", info.idstr.c_str(), fsize);
+            return VmbErrorResources;
+        }
+        geometry_dirty = false;
+        return VmbErrorSuccess;
     }
 
-#define SET_CASE_INT(NAME)                              \
-    case CommandNames::NAME:                            \
-    {                                                   \
-        long arg = atol(argument);                      \
-        err = allied_set_##NAME(image_cam.handle, arg); \
-        break;                                          \
+public:
+    static const size_t frame_ring_slots = 16;
+    static uint32_t frame_pool_buffers; // buffers consumers may hold beyond the ring's slots
+    static std::string record_dir; // where record_start creates its files
+    std::atomic<int> adio_bit;           // trigger output bit, -1 for none; read by the callback
+    std::atomic<uint32_t> adio_pulse_us; // trigger output pulse width, 0 to toggle; read by the callback
+    std::atomic<uint32_t> preview_factor;  // preview_binning
+    std::atomic<bool> preview_decimate;    // preview_mode
+    std::atomic<double> preview_framerate; // preview_framerate
+    std::atomic<bool> compress;            // compression
+    mutable CodecStats codec_stats;        // every encode of this camera's frames, published or recorded
+    std::atomic<double> exposure_in_effect; // exposure_us as last read from the camera, stamped on every frame
+    double target_framerate = 0;            // acq_framerate as the client last asked for it, before the camera capped it
+    bool throughput_auto = true;            // throughput_auto
+    BandwidthScheduler *bandwidth = nullptr; // shares the link with the other cameras on it; may be nullptr
+    CaptureStats stat;
+    FeatureCache features; // feature values, see load_features()
+    std::unique_ptr<FrameRecorder> recorder; // set between record_start and record_stop
+    std::mutex lock; // serialises commands between this camera's worker and fleet-wide commands
+    std::unique_ptr<CameraBackend> backend; // the camera behind this object; nullptr once closed
+
+    ImageCam()
+    {
+        capturing = false;
+        init_local();
     }
 
-#define SET_CASE_DBL(NAME)                              \
-    case CommandNames::NAME:                            \
-    {                                                   \
-        double arg = atof(argument);                    \
-        err = allied_set_##NAME(image_cam.handle, arg); \
-        break;                                          \
+    /**
+     * @brief Take over an open camera.
+     *
+     * @param backend Camera (hardware, recording or synthetic); owned by this object from here on.
+     */
+    ImageCam(CameraInfo &camera_info, ADIOEngine *adio, CameraBackend *backend)
+    {
+        this->backend.reset(backend); // first: freed with this object's members should anything below throw
+        capturing = false;
+        init_local();
+        this->adio = adio;
+        this->info = camera_info;
+        VmbError_t err = reconfigure();
+        if (err != VmbErrorSuccess)
+            dbprintlf(RED_FG "Could not size frame buffers for %s: %s", camera_info.idstr.c_str(), allied_strerr(err));
+        load_features();
+        FeatureValue fps;
+        if (features.lookup(CommandNames::acq_framerate, fps))
+            target_framerate = fps.d;
     }
 
-#define SET_CASE_BOOL(NAME)                             \
-    case CommandNames::NAME:                            \
-    {                                                   \
-        char *narg = strdup(argument);                  \
-        for (int i = 0; narg[i]; i++)                   \
-        {                                               \
-            narg[i] = tolower(narg[i]);                 \
-        }                                               \
-        bool arg = streq(narg, "true");                 \
-        err = allied_set_##NAME(image_cam.handle, arg); \
-        break;                                          \
+    ~ImageCam()
+    {
+        recorder.reset(); // finishes the file while frames() is still callable
+        close_camera();
     }
 
-#define GET_CASE_STR(NAME)                                              \
-    case CommandNames::NAME:                                            \
-    {                                                                   \
-        char *garg;                                                     \
-        err = allied_get_##NAME(image_cam.handle, (const char **)&garg); \
-        reply = garg;                                                   \
-        break;                                                          \
+    const CameraInfo &camera_info() const
+    {
+        return info;
     }
 
-#define GET_CASE_DBL(NAME)                                \
-    case CommandNames::NAME:                              \
-    {                                                     \
-        double garg;                                      \
-        err = allied_get_##NAME(image_cam.handle, &garg); \
-        reply = string_format("%.6f", garg);              \
-        break;                                            \
+    /**
+     * @brief Read every feature into the feature cache. Called whenever the camera is opened.
+     *
+     */
+    void load_features();
+
+    VmbError_t link_demand(LinkDemand &demand);
+    VmbError_t set_link_limit(int64_t &limit);
+
+    /**
+     * @brief Have the bandwidth scheduler recompute this camera's link. Not with lock held.
+     *
+     */
+    void rebalance_link()
+    {
+        if (bandwidth != nullptr && !info.link.empty())
+            bandwidth->rebalance(info.link);
     }
 
-#define GET_CASE_INT(NAME)                                \
-    case CommandNames::NAME:                              \
-    {                                                     \
-        VmbInt64_t garg;                                  \
-        err = allied_get_##NAME(image_cam.handle, &garg); \
-        reply = std::to_string(garg);                     \
-        break;                                            \
+    // owns the frame ring and is handed to the SDK as callback context; never copy
+    ImageCam(const ImageCam &) = delete;
+    ImageCam &operator=(const ImageCam &) = delete;
+
+    /**
+     * @brief Frame ring filled by the capture callback; nullptr until the first capture.
+     *
+     */
+    std::shared_ptr<const FrameRing> frames() const
+    {
+        return std::atomic_load(&ring_owner);
     }
 
-#define GET_CASE_BOOL(NAME)                               \
-    case CommandNames::NAME:                              \
-    {                                                     \
-        VmbBool_t garg;                                   \
-        err = allied_get_##NAME(image_cam.handle, &garg); \
-        reply = garg == VmbBoolTrue ? "True" : "False";   \
-        break;                                            \
+    /**
+     * @brief Buffers of the current frame ring; nullptr until the first capture.
+     *
+     */
+    std::shared_ptr<FramePool> frame_pool() const
+    {
+        std::shared_ptr<const FrameRing> r = frames();
+        return r ? r->pool() : nullptr;
     }
 
-class CharContainer
-{
-private:
-    char *strdup(const char *str)
+    PreviewSettings preview() const
     {
-        int len = strlen(str);
-        char *out = new char[len + 1];
-        strcpy(out, str);
-        return out;
+        PreviewSettings settings;
+        settings.factor = preview_factor;
+        settings.decimate = preview_decimate;
+        settings.framerate = preview_framerate;
+        return settings;
     }
 
-public:
-    char **arr = nullptr;
-    int narr = 0;
-    int selected;
-    size_t maxlen = 0;
+    /**
+     * @brief Defaults for the state kept on our side of the camera (local features, frame stamping).
+     *
+     */
+    void init_local()
+    {
+        PreviewSettings defaults;
+        preview_factor = defaults.factor;
+        preview_decimate = defaults.decimate;
+        preview_framerate = defaults.framerate;
+        compress = false;
+        exposure_in_effect = 0;
+        adio_bit = -1;
+        adio_pulse_us = 0;
+    }
+
+    CodecStats *compression() const
+    {
+        return compress ? &codec_stats : nullptr;
+    }
 
-    ~CharContainer()
+    /**
+     * @brief Re-read image size, format and bit depth, and resize the frame ring and pool if the frame size changed.
+     *
+     * Called when the camera is opened and after image_size, image_format or sensor_bit_depth is set.
+     */
+    VmbError_t reconfigure()
     {
-        if (arr)
+        if (!backend)
+            return VmbErrorDeviceNotOpen;
+        FrameGeometry geom;
+        VmbError_t err = backend->geometry(geom);
+        if (err != VmbErrorSuccess)
+            return err;
+        if (geom == geometry && ring != nullptr)
+            return VmbErrorSuccess;
+        geometry = geom;
+        if (capturing)
         {
-            for (int i = 0; i < narr; i++)
+            geometry_dirty = true;
+            return VmbErrorSuccess;
+        }
+        return allocate_buffers();
+    }
+
+    static void Callback(const AlliedCameraHandle_t handle, const VmbHandle_t stream, VmbFrame_t *frame, void *user_data)
+    {
+        uint64_t entry_ns = mono_ns();
+        assert(user_data);
+
+        ImageCam *self = (ImageCam *)user_data;
+
+        int adio_bit = self->adio_bit.load(std::memory_order_relaxed);
+        if (self->adio != nullptr && adio_bit >= 0)
+        {
+            // the edge goes out from the aDIO engine thread
+            uint32_t pulse_us = self->adio_pulse_us.load(std::memory_order_relaxed);
+            self->adio->post(adio_bit, pulse_us > 0 ? ADIOEngine::ADIO_PULSE : ADIOEngine::ADIO_TOGGLE, pulse_us, entry_ns);
+        }
+
+        // bits per pixel live in bits 16..23 of the pixel format
+        size_t len = ((size_t)frame->width * frame->height * ((frame->pixelFormat >> 16) & 0xff) + 7) / 8;
+        if (len == 0 || len > frame->bufferSize)
+            len = frame->bufferSize;
+
+        FrameRing *ring = self->ring;
+        if (ring != nullptr)
+        {
+            FrameHeader hdr;
+            hdr.frame_id = frame->frameID;
+            hdr.timestamp = frame->timestamp;
+            hdr.width = frame->width;
+            hdr.height = frame->height;
+            hdr.pixel_format = frame->pixelFormat;
+            hdr.status = frame->receiveStatus;
+            hdr.size = len;
+            hdr.truncated = 0;
+            hdr.host_ns = entry_ns;
+            hdr.exposure_us = self->exposure_in_effect.load(std::memory_order_relaxed);
+            hdr.flags = self->stat.sequence_flags(frame->frameID);
+            if (frame->receiveStatus == VmbFrameStatusComplete)
+                hdr.flags |= FRAME_FLAG_COMPLETE;
+            hdr.adio_state = 0;
+            if (self->adio != nullptr && self->adio->active())
             {
-                delete[] arr[i];
+                hdr.adio_state = self->adio->state.load(std::memory_order_relaxed);
+                hdr.flags |= FRAME_FLAG_ADIO;
             }
-            delete[] arr;
+            // the only copy of the frame: into a pool buffer the recorder, previews and publisher share
+            ring->push(hdr, frame->imageData != nullptr ? (const void *)frame->imageData : frame->buffer);
         }
+
+        self->stat.update(frame->frameID, frame->receiveStatus == VmbFrameStatusComplete, len, entry_ns, mono_ns());
+    }
+
+    void cleanup()
+    {
+        backend.reset(); // stops capture and closes the camera
+        capturing = false;
     }
 
-    CharContainer()
+    void close_camera()
     {
-        arr = nullptr;
-        narr = 0;
-        selected = -1;
+        cleanup();
     }
 
-    CharContainer(const char **arr, int narr)
+    bool running()
     {
-        this->arr = new char *[narr];
-        this->narr = narr;
-        this->selected = -1;
-        for (int i = 0; i < narr; i++)
+        return capturing;
+    }
+
+    /**
+     * @brief Whether there is a camera behind this object to capture from.
+     *
+     */
+    bool available() const
+    {
+        return backend != nullptr;
+    }
+
+    /**
+     * @brief Whether buffers match the camera, i.e. prepare_capture() would only reset statistics.
+     *
+     */
+    bool buffers_ready() const
+    {
+        return ring != nullptr && !geometry_dirty;
+    }
+
+    /**
+     * @brief First half of start_capture(): size buffers and reset statistics. Does not talk to the camera.
+     *
+     */
+    VmbError_t prepare_capture()
+    {
+        // buffers are sized before the SDK starts delivering frames; never reallocated while capturing
+        if (ring == nullptr || geometry_dirty)
+        {
+            VmbError_t err = ring == nullptr ? reconfigure() : allocate_buffers();
+            if (err != VmbErrorSuccess)
+                return err;
+        }
+        stat.reset(); // frame IDs restart with every acquisition
+        return VmbErrorSuccess;
+    }
+
+    /**
+     * @brief Second half of start_capture(): ask the camera to start streaming. Call after prepare_capture().
+     *
+     */
+    VmbError_t begin_capture()
+    {
+        VmbError_t err = backend->start_capture(&Callback, (void *)this); // set the callback here
+        if (err == VmbErrorSuccess)
+            capturing = true;
+        else
+            server_metrics().sdk_error(err);
+        return err;
+    }
+
+    VmbError_t start_capture()
+    {
+        VmbError_t err = VmbErrorSuccess;
+        if (available() && !capturing)
+        {
+            err = prepare_capture();
+            if (err == VmbErrorSuccess)
+                err = begin_capture();
+        }
+        return err;
+    }
+
+    /**
+     * @brief Start streaming this camera's frames to a file. Independent of capture: frames are recorded while capturing.
+     *
+     * @param name File name inside record_dir, without any directory part. An existing file is never overwritten.
+     */
+    VmbError_t start_recording(const char *name)
+    {
+        // clients only ever name a new file in the recording directory
+        if (name == NULL || name[0] == '\0' || strchr(name, '/') != NULL || strstr(name, "..") != NULL || streq(name, "."))
+            return VmbErrorBadParameter;
+        if (recorder)
+            return VmbErrorInvalidCall; // already recording
+        if (!frames())
+            return VmbErrorInvalidCall; // no frame size yet
+        try
+        {
+            recorder.reset(new FrameRecorder(this, info.idstr, record_dir + "/" + name));
+        }
+        catch (const std::exception &e)
         {
-            this->arr[i] = strdup(arr[i]);
-            if (strlen(arr[i]) > maxlen)
+            return VmbErrorIO;
+        }
+        return VmbErrorSuccess;
+    }
+
+    /**
+     * @brief Finish the recording started by start_recording().
+     *
+     * @param reply Final recording statistics, as JSON.
+     */
+    VmbError_t stop_recording(std::string &reply)
+    {
+        if (!recorder)
+            return VmbErrorInvalidCall;
+        recorder->stop();
+        reply = recorder->to_string();
+        recorder.reset();
+        return VmbErrorSuccess;
+    }
+
+    VmbError_t stop_capture()
+    {
+        VmbError_t err = VmbErrorSuccess;
+        if (available() && capturing)
+        {
+            err = backend->stop_capture();
+            if (err == VmbErrorSuccess)
+                capturing = false;
+            else
+                server_metrics().sdk_error(err);
+            int bit = adio_bit.load(std::memory_order_relaxed);
+            if (adio != nullptr && bit >= 0)
+                adio->post(bit, ADIOEngine::ADIO_LOW, 0, mono_ns());
+        }
+        return err;
+    }
+};
+
+uint32_t ImageCam::frame_pool_buffers = 32;
+std::string ImageCam::record_dir = ".";
+
+static VmbError_t get_adio_bit(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Int;
+    val.i[0] = image_cam.adio_bit.load(std::memory_order_relaxed);
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_adio_bit(ImageCam &image_cam, const FeatureValue &val)
+{
+    image_cam.adio_bit.store(val.i[0], std::memory_order_relaxed);
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_adio_pulse_us(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Int;
+    val.i[0] = image_cam.adio_pulse_us.load(std::memory_order_relaxed);
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_adio_pulse_us(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (val.i[0] < 0 || val.i[0] > UINT32_MAX)
+        return VmbErrorInvalidValue;
+    image_cam.adio_pulse_us.store(val.i[0], std::memory_order_relaxed);
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_preview_binning(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Int;
+    val.i[0] = image_cam.preview_factor;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_preview_binning(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (val.i[0] != 1 && val.i[0] != 2 && val.i[0] != 4 && val.i[0] != 8)
+        return VmbErrorInvalidValue;
+    image_cam.preview_factor = val.i[0];
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_preview_mode(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Str;
+    strcpy(val.s, image_cam.preview_decimate ? "decimate" : "bin");
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_preview_mode(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (strcasecmp(val.s, "bin") == 0)
+        image_cam.preview_decimate = false;
+    else if (strcasecmp(val.s, "decimate") == 0)
+        image_cam.preview_decimate = true;
+    else
+        return VmbErrorInvalidValue;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_preview_framerate(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Dbl;
+    val.d = image_cam.preview_framerate;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_preview_framerate(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (!(val.d >= 0 && val.d <= 1000))
+        return VmbErrorInvalidValue;
+    image_cam.preview_framerate = val.d;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_compression(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Str;
+    strcpy(val.s, image_cam.compress ? "rice" : "none");
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_compression(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (strcasecmp(val.s, "none") == 0)
+        image_cam.compress = false;
+    else if (strcasecmp(val.s, "rice") == 0)
+        image_cam.compress = true;
+    else
+        return VmbErrorInvalidValue;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t get_throughput_auto(ImageCam &image_cam, FeatureValue &val)
+{
+    val.type = ValueType::Bool;
+    val.b = image_cam.throughput_auto;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t set_throughput_auto(ImageCam &image_cam, const FeatureValue &val)
+{
+    image_cam.throughput_auto = val.b;
+    return VmbErrorSuccess;
+}
+
+typedef CommandDesc<ImageCam> ImageCommand;
+
+/**
+ * @brief Feature read from the camera, whichever backend it is.
+ *
+ */
+template <long ID>
+static VmbError_t backend_get(ImageCam &image_cam, FeatureValue &val)
+{
+    if (!image_cam.backend)
+        return VmbErrorDeviceNotOpen;
+    VmbError_t err = image_cam.backend->get_feature(ID, val);
+    if (ID == CommandNames::exposure_us && err == VmbErrorSuccess)
+        image_cam.exposure_in_effect.store(val.d, std::memory_order_relaxed);
+    if (err != VmbErrorSuccess)
+        server_metrics().sdk_error(err);
+    return err;
+}
+
+template <long ID>
+static VmbError_t backend_set(ImageCam &image_cam, const FeatureValue &val)
+{
+    if (!image_cam.backend)
+        return VmbErrorDeviceNotOpen;
+    VmbError_t err = image_cam.backend->set_feature(ID, val);
+    if (err != VmbErrorSuccess)
+        server_metrics().sdk_error(err);
+    return err;
+}
+
+#define FEATURE(NAME, TYPE, FLAGS, ...) {CommandNames::NAME, #NAME, ValueType::TYPE, FLAGS, &backend_get<CommandNames::NAME>, &backend_set<CommandNames::NAME>, {__VA_ARGS__}}
+#define FEATURE_RO(NAME, TYPE, FLAGS) {CommandNames::NAME, #NAME, ValueType::TYPE, FLAGS, &backend_get<CommandNames::NAME>, nullptr, {}}
+
+/**
+ * @brief Every get/set feature. Adding a feature is adding a row here, its number to CommandNames and handling it in the backends.
+ *
+ * The last column lists the features whose cached value goes stale when this one is set.
+ */
+static constexpr ImageCommand command_table[] = {
+    FEATURE(image_format, Str, CMD_GEOMETRY, CommandNames::sensor_bit_depth, CommandNames::acq_framerate, CommandNames::throughput_limit),
+    FEATURE(sensor_bit_depth, Str, CMD_GEOMETRY, CommandNames::image_format, CommandNames::acq_framerate, CommandNames::throughput_limit),
+    FEATURE(trigline, Str, 0, CommandNames::trigline_src),
+    FEATURE(trigline_src, Str, 0),
+    FEATURE(exposure_us, Dbl, 0, CommandNames::acq_framerate),
+    FEATURE(acq_framerate, Dbl, 0, CommandNames::exposure_us),
+    FEATURE(acq_framerate_auto, Bool, 0, CommandNames::acq_framerate),
+    FEATURE(image_size, Size, CMD_GEOMETRY, CommandNames::image_ofst, CommandNames::acq_framerate),
+    FEATURE(image_ofst, Size, 0, CommandNames::acq_framerate),
+    FEATURE_RO(sensor_size, Size, CMD_IMMUTABLE),
+    FEATURE(throughput_limit, Int, 0, CommandNames::acq_framerate),
+    FEATURE_RO(throughput_limit_range, Range, CMD_IMMUTABLE),
+    {CommandNames::adio_bit, "adio_bit", ValueType::Int, CMD_NOCACHE, &get_adio_bit, &set_adio_bit, {}},
+    {CommandNames::adio_pulse_us, "adio_pulse_us", ValueType::Int, CMD_NOCACHE, &get_adio_pulse_us, &set_adio_pulse_us, {}},
+    {CommandNames::preview_binning, "preview_binning", ValueType::Int, CMD_NOCACHE, &get_preview_binning, &set_preview_binning, {}},
+    {CommandNames::preview_mode, "preview_mode", ValueType::Str, CMD_NOCACHE, &get_preview_mode, &set_preview_mode, {}},
+    {CommandNames::preview_framerate, "preview_framerate", ValueType::Dbl, CMD_NOCACHE, &get_preview_framerate, &set_preview_framerate, {}},
+    {CommandNames::compression, "compression", ValueType::Str, CMD_NOCACHE, &get_compression, &set_compression, {}},
+    {CommandNames::throughput_auto, "throughput_auto", ValueType::Bool, CMD_NOCACHE, &get_throughput_auto, &set_throughput_auto, {}},
+};
+
+static_assert(command_ids_unique(command_table), "Duplicate command number in command_table.");
+
+/**
+ * @brief The command table as JSON, for the `commands` request.
+ *
+ */
+static std::string command_list()
+{
+    std::string reply = "[";
+    for (const ImageCommand &desc : command_table)
+    {
+        if (reply.size() > 1)
+            reply += ", ";
+        reply += string_format("{\"id\": %ld, \"name\": \"%s\", \"type\": \"%s\", \"arity\": %d, \"get\": %s, \"set\": %s}",
+                               desc.id, desc.name, value_type_name(desc.type),
+                               desc.set != nullptr ? value_type_arity(desc.type) : 0,
+                               desc.get != nullptr ? "true" : "false",
+                               desc.set != nullptr ? "true" : "false");
+    }
+    reply += "]";
+    return reply;
+}
+
+void ImageCam::load_features()
+{
+    features.clear();
+    for (const ImageCommand &desc : command_table)
+    {
+        if (desc.get == nullptr || (desc.flags & CMD_NOCACHE))
+            continue;
+        if (desc.flags & CMD_IMMUTABLE)
+            features.set_immutable(desc.id);
+        FeatureValue value;
+        if (desc.get(*this, value) == VmbErrorSuccess)
+            features.store(desc.id, value);
+    }
+}
+
+/**
+ * @brief Read a feature, from the cache unless refresh is set or the feature is not cached.
+ *
+ * Caller holds image_cam.lock.
+ */
+static VmbError_t feature_get(ImageCam &image_cam, const ImageCommand &desc, bool refresh, FeatureValue &value)
+{
+    if (desc.get == nullptr)
+        return VmbErrorWrongType;
+    bool cacheable = !(desc.flags & CMD_NOCACHE);
+    if (!refresh && cacheable && image_cam.features.lookup(desc.id, value))
+        return VmbErrorSuccess;
+    VmbError_t err = desc.get(image_cam, value);
+    if (err == VmbErrorSuccess && cacheable)
+        image_cam.features.store(desc.id, value);
+    return err;
+}
+
+/**
+ * @brief Write a feature, refresh the cache and resize frame buffers if needed.
+ *
+ * Caller holds image_cam.lock.
+ *
+ * @param value Value to set; receives the value read back after setting, which the camera may have rounded or clamped.
+ */
+static VmbError_t feature_set(ImageCam &image_cam, const ImageCommand &desc, FeatureValue &value)
+{
+    if (desc.set == nullptr)
+        return VmbErrorWrongType;
+    if (value.type != desc.type)
+        return VmbErrorBadParameter;
+    VmbError_t err = desc.set(image_cam, value);
+    if (err != VmbErrorSuccess)
+        return err;
+    if (!(desc.flags & CMD_NOCACHE))
+    {
+        // write through: read the value back once here
+        for (long dep : desc.deps)
+        {
+            if (dep != 0)
+                image_cam.features.invalidate(dep);
+            if (dep == CommandNames::exposure_us)
             {
-                maxlen = strlen(arr[i]);
+                // frames are stamped with the exposure in effect: re-read it now rather than at the next get
+                FeatureValue exposure;
+                if (backend_get<CommandNames::exposure_us>(image_cam, exposure) == VmbErrorSuccess)
+                    image_cam.features.store(dep, exposure);
             }
         }
+        if (desc.get != nullptr && desc.get(image_cam, value) == VmbErrorSuccess)
+            image_cam.features.store(desc.id, value);
+        else
+            image_cam.features.invalidate(desc.id);
+    }
+    // frame buffers follow the frame size; nothing is resized on the capture path
+    if (desc.flags & CMD_GEOMETRY)
+    {
+        VmbError_t rerr = image_cam.reconfigure();
+        if (rerr != VmbErrorSuccess)
+            dbprintlf(RED_FG "Could not resize frame buffers: %s", allied_strerr(rerr));
+    }
+    return VmbErrorSuccess;
+}
+
+VmbError_t ImageCam::link_demand(LinkDemand &demand)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!backend)
+        return VmbErrorDeviceNotOpen;
+    FeatureValue range, limit, fps_auto;
+    VmbError_t err = feature_get(*this, *find_command(command_table, CommandNames::throughput_limit_range), false, range);
+    if (err == VmbErrorSuccess)
+        err = feature_get(*this, *find_command(command_table, CommandNames::throughput_limit), false, limit);
+    if (err != VmbErrorSuccess)
+        return err;
+    bool free_running = feature_get(*this, *find_command(command_table, CommandNames::acq_framerate_auto), false, fps_auto) == VmbErrorSuccess && fps_auto.b;
+    demand.frame_bytes = geometry.frame_bytes();
+    demand.framerate = free_running ? 0 : target_framerate;
+    demand.limit_min = range.i[0];
+    demand.limit_max = range.i[1];
+    demand.limit = limit.i[0];
+    demand.manual = !throughput_auto;
+    return VmbErrorSuccess;
+}
+
+VmbError_t ImageCam::set_link_limit(int64_t &limit)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!backend)
+        return VmbErrorDeviceNotOpen;
+    FeatureValue value;
+    value.type = ValueType::Int;
+    value.i[0] = limit;
+    VmbError_t err = feature_set(*this, *find_command(command_table, CommandNames::throughput_limit), value);
+    if (err != VmbErrorSuccess)
+        return err;
+    limit = value.i[0];
+    // the camera lowers acq_framerate with the limit but does not raise it again: ask for the target once more
+    FeatureValue fps_auto, fps;
+    const ImageCommand &fps_desc = *find_command(command_table, CommandNames::acq_framerate);
+    if (target_framerate > 0 &&
+        feature_get(*this, *find_command(command_table, CommandNames::acq_framerate_auto), false, fps_auto) == VmbErrorSuccess && !fps_auto.b &&
+        feature_get(*this, fps_desc, false, fps) == VmbErrorSuccess && fps.d < target_framerate * 0.999)
+    {
+        fps.d = target_framerate;
+        feature_set(*this, fps_desc, fps); // capped by the camera if the new limit still does not allow it
+    }
+    return VmbErrorSuccess;
+}
+
+/**
+ * @brief Bookkeeping for the bandwidth scheduler after a client set a feature.
+ *
+ * Caller holds image_cam.lock.
+ *
+ * @param requested The value as the client sent it, before the camera rounded or capped it.
+ * @return true if the camera's link needs rebalancing.
+ */
+static bool link_after_set(ImageCam &image_cam, long id, const FeatureValue &requested)
+{
+    switch (id)
+    {
+    case CommandNames::acq_framerate:
+        image_cam.target_framerate = requested.d;
+        return true;
+    case CommandNames::throughput_limit:
+        image_cam.throughput_auto = false; // the client takes over this camera's limit
+        return true;
+    case CommandNames::image_format:
+    case CommandNames::sensor_bit_depth:
+    case CommandNames::image_size:
+    case CommandNames::acq_framerate_auto:
+    case CommandNames::throughput_auto:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief What the camera registry holds for every camera.
+ *
+ */
+struct Camera
+{
+    ImageCam *cam = nullptr;
+    zactor_t *worker = nullptr; // serves this camera's commands
+};
+
+typedef CameraRegistry<Camera> Cameras;
+
+#define MAX_CAMERAS 256
+
+/**
+ * @brief Build a reply in the order clients expect: [command][camera ID][command type][reply][error code][ACK/NAC].
+ *
+ */
+static zmsg_t *make_reply(const char *cmd_type, const char *cam_id, const char *command, VmbError_t err, const std::string &reply)
+{
+    zmsg_t *ack = zmsg_new();
+    zmsg_pushstr(ack, err == VmbErrorSuccess ? "ACK" : "NAC"); // ack or nack
+    zmsg_pushstrf(ack, "%d", err);                             // error code
+    zmsg_pushstr(ack, reply.c_str());                          // None if not set
+    zmsg_pushstr(ack, cmd_type != NULL ? cmd_type : "");       // command type
+    if (cam_id != NULL)
+    {
+        zmsg_pushstr(ack, cam_id);
+        if (command != NULL)
+            zmsg_pushstr(ack, command);
     }
+    return ack;
+}
+
+/**
+ * @brief Whether a command type addresses a single camera, i.e. is served by that camera's worker.
+ *
+ */
+static bool is_camera_command(zframe_t *cmd_type)
+{
+    return cmd_type != NULL && (zframe_streq(cmd_type, "start_capture") || zframe_streq(cmd_type, "stop_capture") || zframe_streq(cmd_type, "stats") || zframe_streq(cmd_type, "get") || zframe_streq(cmd_type, "set") || zframe_streq(cmd_type, "record_start") || zframe_streq(cmd_type, "record_stop"));
+}
+
+/**
+ * @brief Execute one single-camera command and build its reply.
+ *
+ * @param cam Addressed camera, nullptr if it does not exist.
+ * @param message Request without its envelope, starting with the command type. Destroyed.
+ * @param result If not NULL, receives the error code placed in the reply.
+ * @return zmsg_t* Reply.
+ */
+static zmsg_t *camera_command(ImageCam *cam, zmsg_t *message, VmbError_t *result = NULL)
+{
+    uint64_t start_ns = mono_ns();
+    bool get_cmd = false;
+    bool set_cmd = false;
+
+    char *cam_id = NULL;
+    char *command = NULL;
+    char *argument = NULL;
+    std::string reply = "None";
+
+    VmbError_t err = VmbErrorSuccess;
+    bool rebalance = false; // the camera's link needs new throughput limits
 
-    CharContainer(const char **arr, int narr, const char *key)
+    char *cmd_type = zmsg_popstr(message); // get cmd type
+    cam_id = zmsg_popstr(message);         // get camera ID
+    if (streq(cmd_type, "stats"))
     {
-        this->arr = new char *[narr];
-        this->narr = narr;
-        for (int i = 0; i < narr; i++)
+        command = zmsg_popstr(message); // optional "reset"
+    }
+    else if (streq(cmd_type, "get"))
+    {
+        command = zmsg_popstr(message);  // get command
+        argument = zmsg_popstr(message); // optional "refresh"
+        get_cmd = true;
+    }
+    else if (streq(cmd_type, "set"))
+    {
+        command = zmsg_popstr(message);  // get command
+        argument = zmsg_popstr(message); // get argument
+        set_cmd = true;
+    }
+    else if (streq(cmd_type, "record_start"))
+    {
+        command = zmsg_popstr(message); // file name in the recording directory
+    }
+    long cmd_num = command != NULL ? atol(command) : 0;
+
+    if (cam == nullptr)
+    {
+        err = VmbErrorNotFound;
+    }
+    else if ((get_cmd || set_cmd) && command == NULL)
+    {
+        err = VmbErrorBadParameter;
+    }
+    else if (set_cmd && argument == NULL)
+    {
+        err = VmbErrorBadParameter;
+    }
+    else
+    {
+        ImageCam &image_cam = *cam;
+        std::lock_guard<std::mutex> guard(image_cam.lock);
+        if (streq(cmd_type, "start_capture"))
+        {
+            err = image_cam.start_capture();
+        }
+        else if (streq(cmd_type, "stop_capture"))
         {
-            this->arr[i] = strdup(arr[i]);
-            if (strlen(arr[i]) > maxlen)
+            err = image_cam.stop_capture();
+        }
+        else if (streq(cmd_type, "stats"))
+        {
+            std::shared_ptr<FramePool> pool = image_cam.frame_pool();
+            reply = "{\"capture\": " + image_cam.stat.to_string() + ", \"pool\": " + (pool ? pool->to_string() : "null") + ", \"record\": " + (image_cam.recorder ? image_cam.recorder->to_string() : "null") + ", \"compression\": " + image_cam.codec_stats.to_string() + "}";
+            if (command != NULL && streq(command, "reset"))
             {
-                maxlen = strlen(arr[i]);
+                image_cam.stat.reset();
+                image_cam.codec_stats.reset();
             }
         }
-        this->selected = find_idx(key);
+        else if (streq(cmd_type, "record_start"))
+        {
+            if (command == NULL || command[0] == '\0')
+                err = VmbErrorBadParameter;
+            else
+                err = image_cam.start_recording(command);
+        }
+        else if (streq(cmd_type, "record_stop"))
+        {
+            err = image_cam.stop_recording(reply);
+        }
+        else if (set_cmd)
+        {
+            const ImageCommand *desc = find_command(command_table, cmd_num);
+            if (desc == nullptr || desc->set == nullptr)
+            {
+                err = VmbErrorWrongType; // wrong command
+            }
+            else
+            {
+                char *arg2 = NULL;
+                if (value_type_arity(desc->type) > 1)
+                    arg2 = zmsg_popstr(message);
+                const char *args[] = {argument, arg2};
+                FeatureValue value;
+                if (!parse_value(desc->type, args, value))
+                {
+                    err = VmbErrorBadParameter;
+                }
+                else
+                {
+                    FeatureValue requested = value;
+                    err = feature_set(image_cam, *desc, value);
+                    if (err == VmbErrorSuccess)
+                        rebalance = link_after_set(image_cam, desc->id, requested);
+                }
+                zstr_free(&arg2);
+            }
+        }
+        else if (get_cmd)
+        {
+            const ImageCommand *desc = find_command(command_table, cmd_num);
+            if (desc == nullptr || desc->get == nullptr)
+            {
+                err = VmbErrorWrongType; // wrong command
+            }
+            else
+            {
+                // argument "refresh" bypasses the cache
+                bool refresh = argument != NULL && streq(argument, "refresh");
+                FeatureValue value;
+                err = feature_get(image_cam, *desc, refresh, value);
+                if (err == VmbErrorSuccess)
+                {
+                    char buf[128];
+                    size_t len = format_value(value, buf, sizeof(buf));
+                    reply.assign(buf, len);
+                }
+            }
+        }
+        else
+        {
+            err = VmbErrorWrongType; // wrong command
+        }
     }
+    // after the camera lock is released: the scheduler takes the lock of every camera on the link
+    if (rebalance)
+        cam->rebalance_link();
+    uint64_t ns = mono_ns() - start_ns;
+    server_metrics().command(command_type_of(cmd_type), ns, err);
+    if (get_cmd || set_cmd)
+        server_metrics().feature(cmd_num, set_cmd, ns, err);
+    zmsg_t *ack = make_reply(cmd_type, cam_id, command, err, reply);
+    if (result != NULL)
+        *result = err;
+    // cleanup
+    zstr_free(&cmd_type);
+    zstr_free(&cam_id);
+    zstr_free(&command);
+    zstr_free(&argument);
+    zmsg_destroy(&message);
+    return ack;
+}
+
+/**
+ * @brief Execute one binary single-camera command and build its reply.
+ *
+ * @param cam Addressed camera, nullptr if it does not exist.
+ * @param message A single frame holding a BinRequest. Destroyed.
+ * @param result If not NULL, receives the error code placed in the reply.
+ * @return zmsg_t* A single frame holding a BinReply.
+ */
+static zmsg_t *binary_command(ImageCam *cam, zmsg_t *message, VmbError_t *result = NULL)
+{
+    uint64_t start_ns = mono_ns();
+    BinRequest req;
+    zframe_t *frame = zmsg_first(message);
+    memcpy(&req, zframe_data(frame), sizeof(req));
+    zmsg_destroy(&message);
+
+    BinReply rep;
+    memset(&rep, 0, sizeof(rep));
+    rep.magic = BIN_REPLY_MAGIC;
+    rep.camera = req.camera;
+    rep.op = req.op;
+    rep.command = req.command;
+    rep.tag = req.tag;
 
-    int find_idx(const char *str)
+    VmbError_t err = VmbErrorSuccess;
+    bool rebalance = false;
+    FeatureValue value;
+    if (cam == nullptr)
     {
-        int res = -1;
-        for (int i = 0; i < narr; i++)
+        err = VmbErrorNotFound;
+    }
+    else
+    {
+        ImageCam &image_cam = *cam;
+        std::lock_guard<std::mutex> guard(image_cam.lock);
+        const ImageCommand *desc = find_command(command_table, req.command);
+        switch (req.op)
+        {
+        case BIN_START_CAPTURE:
+            err = image_cam.start_capture();
+            break;
+        case BIN_STOP_CAPTURE:
+            err = image_cam.stop_capture();
+            break;
+        case BIN_GET:
+            err = desc != nullptr ? feature_get(image_cam, *desc, req.flags & BIN_REFRESH, value) : VmbErrorWrongType;
+            break;
+        case BIN_SET:
         {
-            if (strcmp(arr[i], str) == 0)
-                res = i;
+            bin_to_value(req.value, value);
+            FeatureValue requested = value;
+            err = desc != nullptr ? feature_set(image_cam, *desc, value) : VmbErrorWrongType;
+            if (err == VmbErrorSuccess)
+                rebalance = link_after_set(image_cam, desc->id, requested);
+            break;
+        }
+        default:
+            err = VmbErrorWrongType; // wrong command
+            break;
         }
-        return res;
     }
-};
+    if (rebalance)
+        cam->rebalance_link();
+    uint64_t ns = mono_ns() - start_ns;
+    switch (req.op)
+    {
+    case BIN_GET:
+    case BIN_SET:
+        server_metrics().command(req.op == BIN_SET ? CMDTYPE_SET : CMDTYPE_GET, ns, err);
+        server_metrics().feature(req.command, req.op == BIN_SET, ns, err);
+        break;
+    case BIN_START_CAPTURE:
+        server_metrics().command(CMDTYPE_START_CAPTURE, ns, err);
+        break;
+    case BIN_STOP_CAPTURE:
+        server_metrics().command(CMDTYPE_STOP_CAPTURE, ns, err);
+        break;
+    default:
+        server_metrics().command(CMDTYPE_OTHER, ns, err);
+        break;
+    }
+    rep.err = err;
+    if (err == VmbErrorSuccess)
+        value_to_bin(value, rep.value);
+    if (result != NULL)
+        *result = err;
+    zmsg_t *ack = zmsg_new();
+    zmsg_addmem(ack, &rep, sizeof(rep));
+    return ack;
+}
 
-class ImageCam
+/**
+ * @brief Per-camera worker. Serves one camera's commands so that a slow SDK call only delays that camera.
+ *
+ * Receives [identity][delimiter][request...] from the main loop and sends back [identity][delimiter][reply...].
+ */
+static void camera_worker(zsock_t *pipe, void *args)
 {
-    bool opened = false;
-    unsigned char state = 0;
-    bool capturing;
-    DeviceHandle adio_hdl = nullptr;
-    CameraInfo info;
-
-public:
-    int adio_bit = -1;
-    AlliedCameraHandle_t handle = nullptr;
+    ImageCam *image_cam = (ImageCam *)args;
+    zsock_signal(pipe, 0); // ready
+    while (true)
+    {
+        zmsg_t *message = zmsg_recv(pipe);
+        if (message == NULL)
+            break; // interrupted
+        zframe_t *identity = zmsg_pop(message);
+        if (identity == NULL || zframe_streq(identity, "$TERM"))
+        {
+            zframe_destroy(&identity);
+            zmsg_destroy(&message);
+            break;
+        }
+        zframe_t *delimiter = zmsg_pop(message);
+        zmsg_t *ack = is_bin_request(zmsg_first(message)) ? binary_command(image_cam, message) : camera_command(image_cam, message);
+        zmsg_prepend(ack, &delimiter);
+        zmsg_prepend(ack, &identity);
+        zmsg_send(&ack, pipe);
+    }
+}
 
-    ImageCam()
+/**
+ * @brief Start or stop every camera together.
+ *
+ * The cameras are first prepared (buffers sized, statistics reset) on a pool
+ * of at most one thread per core, each holding one camera lock at a time.
+ * Then every camera gets a thread of its own that waits, without any lock,
+ * for a common release; only there is the camera lock taken again for the
+ * SDK call, so the calls go out within microseconds of each other instead of
+ * one camera at a time. Up to one waiter per spare core spins for the
+ * release, the rest sleep on a condition variable that is broadcast once.
+ *
+ * @param cameras All cameras.
+ * @param start true to start capture, false to stop it.
+ * @param reply Per-camera results and the measured skew between the SDK calls, as JSON.
+ * @return VmbError_t First error encountered, VmbErrorSuccess if every camera succeeded.
+ */
+static VmbError_t capture_all(const Cameras &cameras, bool start, std::string &reply)
+{
+    struct Result
     {
-        handle = nullptr;
-        capturing = false;
+        uint32_t hash;
+        bool skipped;       // already in the requested state
+        VmbError_t err;
+        uint64_t call_ns;   // when the SDK call was issued
+        uint64_t return_ns; // when it returned
+    };
+    size_t ncams = cameras.size();
+    std::vector<Result> results(ncams);
+    for (size_t idx = 0; idx < ncams; idx++)
+    {
+        Result &res = results[idx];
+        res.hash = cameras.id_at(idx);
+        res.skipped = false;
+        res.err = VmbErrorSuccess;
+        res.call_ns = res.return_ns = 0;
     }
+    size_t ncores = std::thread::hardware_concurrency();
+    if (ncores == 0)
+        ncores = 1;
 
-    ImageCam(CameraInfo &camera_info, DeviceHandle adio_hdl)
+    // prepare, one camera lock at a time per thread
     {
-        handle = nullptr;
-        capturing = false;
-        this->adio_hdl = adio_hdl;
-        this->info = camera_info;
-        if (allied_open_camera(&handle, info.idstr.c_str(), 5) != VmbErrorSuccess)
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+        size_t nprep = ncams < ncores ? ncams : ncores;
+        for (size_t i = 0; i < nprep; i++)
         {
-            dbprintlf(FATAL "Failed to open camera %s.", camera_info.idstr.c_str());
-            throw std::runtime_error("Failed to open camera.");
+            pool.emplace_back([&cameras, &results, &next, ncams, start]()
+            {
+                size_t idx;
+                while ((idx = next.fetch_add(1, std::memory_order_relaxed)) < ncams)
+                {
+                    ImageCam *cam = cameras.at(idx).cam;
+                    Result &res = results[idx];
+                    std::lock_guard<std::mutex> guard(cam->lock);
+                    res.skipped = !cam->available() || cam->running() == start;
+                    if (!res.skipped && start)
+                        res.err = cam->prepare_capture();
+                }
+            });
         }
+        for (auto &thr : pool)
+            thr.join();
     }
 
-    ~ImageCam()
+    // release every camera at once
+    std::vector<std::thread> threads;
+    std::atomic<size_t> arrived(0);
+    std::atomic<bool> release(false);
+    std::mutex release_lock;
+    std::condition_variable release_cv;
+    size_t max_spin = ncores > 1 ? ncores - 1 : 0; // leave a core to the thread doing the release
+    for (size_t idx = 0; idx < ncams; idx++)
     {
-        close_camera();
+        Result *res = &results[idx];
+        if (res->skipped || res->err != VmbErrorSuccess)
+            continue;
+        ImageCam *cam = cameras.at(idx).cam;
+        bool spin = threads.size() < max_spin;
+        threads.emplace_back([cam, res, start, spin, &arrived, &release, &release_lock, &release_cv]()
+        {
+            if (spin)
+            {
+                arrived++;
+                while (!release.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> wait(release_lock);
+                arrived++;
+                release_cv.wait(wait, [&release]()
+                                { return release.load(std::memory_order_acquire); });
+            }
+            std::lock_guard<std::mutex> guard(cam->lock);
+            // the lock was let go since the camera was prepared: another command may have got in
+            if (!cam->available() || cam->running() == start)
+            {
+                res->skipped = true;
+                return;
+            }
+            if (start && !cam->buffers_ready())
+            {
+                res->err = cam->prepare_capture();
+                if (res->err != VmbErrorSuccess)
+                    return;
+            }
+            res->call_ns = mono_ns();
+            res->err = start ? cam->begin_capture() : cam->stop_capture();
+            res->return_ns = mono_ns();
+        });
+    }
+    while (arrived.load() < threads.size())
+        std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> guard(release_lock);
+        release.store(true, std::memory_order_release);
+    }
+    release_cv.notify_all();
+    for (auto &thr : threads)
+    {
+        thr.join();
     }
 
-    static void Callback(const AlliedCameraHandle_t handle, const VmbHandle_t stream, VmbFrame_t *frame, void *user_data)
+    VmbError_t err = VmbErrorSuccess;
+    uint64_t first = UINT64_MAX, last = 0;
+    for (auto &res : results)
     {
-        assert(user_data);
+        if (res.call_ns == 0)
+            continue;
+        first = res.call_ns < first ? res.call_ns : first;
+        last = res.call_ns > last ? res.call_ns : last;
+    }
+    reply = string_format("{\"skew_us\": %.1f, \"cameras\": {", last > first ? (last - first) / 1e3 : 0.0);
+    for (size_t i = 0; i < ncams; i++)
+    {
+        Result &res = results[i];
+        if (err == VmbErrorSuccess)
+            err = res.err;
+        reply += string_format("%s\"%u\": {\"err\": %d, \"skipped\": %s, \"offset_us\": %.1f, \"call_us\": %.1f}",
+                               i > 0 ? ", " : "", res.hash, res.err, res.skipped ? "true" : "false",
+                               res.call_ns > 0 ? (res.call_ns - first) / 1e3 : 0.0,
+                               res.call_ns > 0 ? (res.return_ns - res.call_ns) / 1e3 : 0.0);
+    }
+    reply += "}}";
+    return err;
+}
 
-        ImageCam *self = (ImageCam *)user_data;
+/**
+ * @brief State shared with the fleet worker.
+ *
+ */
+struct FleetContext
+{
+    const Cameras *cameras;
+    BandwidthScheduler *bandwidth;
+};
+
+/**
+ * @brief Report link budgets and throughput limits, or set a link's budget first.
+ *
+ * Request: [bandwidth] for the report, [bandwidth][link][MB/s] to set the
+ * budget of one link ("all" for every link without its own) and rebalance it.
+ *
+ * @param message Arguments after the [bandwidth] frame.
+ * @param reply Link report, as JSON.
+ */
+static VmbError_t bandwidth_command(BandwidthScheduler &bandwidth, zmsg_t *message, std::string &reply)
+{
+    VmbError_t err = VmbErrorSuccess;
+    char *link = zmsg_popstr(message);
+    char *mbps = zmsg_popstr(message);
+    if (link != NULL)
+    {
+        char *end = NULL;
+        double val = mbps != NULL ? strtod(mbps, &end) : -1;
+        if (mbps == NULL || end == mbps || *end != '\0' || !(val >= 0))
+            err = VmbErrorBadParameter;
+        else
+            err = bandwidth.set_budget(link, (int64_t)(val * 1e6));
+    }
+    reply = bandwidth.to_string();
+    zstr_free(&link);
+    zstr_free(&mbps);
+    return err;
+}
+
+/**
+ * @brief Execute a batch of camera commands in order and collect their replies.
+ *
+ * Request: [batch][item][][item][]... where each item is the frames of an
+ * ordinary camera command (e.g. [set][camera ID][104][1000]) and items are
+ * separated by empty frames (the last separator is optional).
+ *
+ * Reply: the usual [batch][number of items][error code][ACK/NAC], where the
+ * error code is the first error of any item, followed by each item's own
+ * reply frames, each item again terminated by an empty frame.
+ *
+ * @param message Request after the [batch] frame. Destroyed.
+ * @param result If not NULL, receives the error code placed in the reply.
+ */
+static zmsg_t *batch_command(const Cameras &cameras, zmsg_t *message, VmbError_t *result = NULL)
+{
+    VmbError_t err = VmbErrorSuccess;
+    int nitems = 0;
+    zmsg_t *items = zmsg_new();
+    while (zmsg_size(message) > 0)
+    {
+        // collect one item
+        zmsg_t *item = zmsg_new();
+        zframe_t *frame;
+        while ((frame = zmsg_pop(message)) != NULL)
+        {
+            if (zframe_size(frame) == 0)
+            {
+                zframe_destroy(&frame);
+                break;
+            }
+            zmsg_append(item, &frame);
+        }
+        if (zmsg_size(item) == 0)
+        {
+            zmsg_destroy(&item);
+            continue;
+        }
+        zmsg_t *ack;
+        VmbError_t item_err = VmbErrorWrongType;
+        if (is_camera_command(zmsg_first(item)))
+        {
+            zframe_t *id_frame = zmsg_next(item);
+            char *cam_id = id_frame != NULL ? zframe_strdup(id_frame) : NULL;
+            const Camera *entry = cameras.find(cam_id);
+            zstr_free(&cam_id);
+            ack = camera_command(entry != nullptr ? entry->cam : nullptr, item, &item_err);
+        }
+        else if (is_bin_request(zmsg_first(item)))
+        {
+            const Camera *entry = cameras.find(bin_request_camera(zmsg_first(item)));
+            ack = binary_command(entry != nullptr ? entry->cam : nullptr, item, &item_err);
+        }
+        else
+        {
+            char *cmd_type = zmsg_popstr(item);
+            ack = make_reply(cmd_type, NULL, NULL, item_err, "None");
+            zstr_free(&cmd_type);
+            zmsg_destroy(&item);
+        }
+        if (err == VmbErrorSuccess)
+            err = item_err;
+        while ((frame = zmsg_pop(ack)) != NULL)
+            zmsg_append(items, &frame);
+        zmsg_destroy(&ack);
+        zmsg_addmem(items, NULL, 0); // item separator
+        nitems++;
+    }
+    zmsg_destroy(&message);
+    if (result != NULL)
+        *result = err;
+    zmsg_t *reply = make_reply("batch", NULL, NULL, err, std::to_string(nitems));
+    zframe_t *frame;
+    while ((frame = zmsg_pop(items)) != NULL)
+        zmsg_append(reply, &frame);
+    zmsg_destroy(&items);
+    return reply;
+}
+
+#define FLEET_REBALANCE_DELAY_MS 100 // cameras joining a link within this time share one rebalance
 
-        if (self->adio_hdl != nullptr && self->adio_bit >= 0)
+/**
+ * @brief Worker for commands that span all cameras, so they do not stall the main loop either.
+ *
+ * Same envelope handling as camera_worker(). The main loop also sends
+ * [$REBALANCE][link] when a camera joins a link; those get no reply and are
+ * gathered for FLEET_REBALANCE_DELAY_MS, so a burst of cameras coming up
+ * costs one rebalance per link rather than one per camera.
+ */
+static void fleet_worker(zsock_t *pipe, void *args)
+{
+    FleetContext *ctx = (FleetContext *)args;
+    zpoller_t *poller = zpoller_new(pipe, NULL);
+    assert(poller);
+    std::set<std::string> dirty; // links waiting for a rebalance
+    uint64_t due_ns = 0;
+    zsock_signal(pipe, 0); // ready
+    while (true)
+    {
+        int timeout = -1;
+        if (!dirty.empty())
+        {
+            uint64_t now = mono_ns();
+            timeout = due_ns > now ? (int)((due_ns - now + 999999) / 1000000) : 0;
+        }
+        if (zpoller_wait(poller, timeout) == NULL)
+        {
+            if (zpoller_terminated(poller))
+                break; // interrupted
+            for (const std::string &link : dirty)
+                ctx->bandwidth->rebalance(link);
+            dirty.clear();
+            continue;
+        }
+        zmsg_t *message = zmsg_recv(pipe);
+        if (message == NULL)
+            break; // interrupted
+        zframe_t *identity = zmsg_pop(message);
+        if (identity == NULL || zframe_streq(identity, "$TERM"))
+        {
+            zframe_destroy(&identity);
+            zmsg_destroy(&message);
+            break;
+        }
+        if (zframe_streq(identity, "$REBALANCE"))
+        {
+            char *link = zmsg_popstr(message);
+            if (link != NULL)
+            {
+                if (dirty.empty())
+                    due_ns = mono_ns() + FLEET_REBALANCE_DELAY_MS * 1000000ULL;
+                dirty.insert(link);
+            }
+            zstr_free(&link);
+            zframe_destroy(&identity);
+            zmsg_destroy(&message);
+            continue;
+        }
+        zframe_t *delimiter = zmsg_pop(message);
+        uint64_t start_ns = mono_ns();
+        std::string reply = "None";
+        VmbError_t err = VmbErrorSuccess;
+        char *cmd_type = zmsg_popstr(message);
+        zmsg_t *ack = NULL;
+        if (streq(cmd_type, "batch"))
         {
-            self->state = ~self->state;
-            WriteBit_aDIO(self->adio_hdl, 0, self->adio_bit, self->state);
+            ack = batch_command(*ctx->cameras, message, &err);
+            message = NULL;
+        }
+        else
+        {
+            if (streq(cmd_type, "start_capture_all"))
+                err = capture_all(*ctx->cameras, true, reply);
+            else if (streq(cmd_type, "stop_capture_all"))
+                err = capture_all(*ctx->cameras, false, reply);
+            else if (streq(cmd_type, "bandwidth"))
+                err = bandwidth_command(*ctx->bandwidth, message, reply);
+            else
+                err = VmbErrorWrongType;
+            ack = make_reply(cmd_type, NULL, NULL, err, reply);
         }
+        server_metrics().command(command_type_of(cmd_type), mono_ns() - start_ns, err);
+        zmsg_prepend(ack, &delimiter);
+        zmsg_prepend(ack, &identity);
+        zmsg_send(&ack, pipe);
+        zstr_free(&cmd_type);
+        zmsg_destroy(&message);
+    }
+    zpoller_destroy(&poller);
+}
 
-        // self->stat.update();
-        // self->img.update(frame);
+/**
+ * @brief The metrics exposition: server counters followed by per-camera frame counters.
+ *
+ * Reads atomics and the registry only, so it may run on any thread.
+ */
+static std::string metrics_text(const Cameras &cameras)
+{
+    static const struct
+    {
+        const char *name;
+        const char *help;
+        std::atomic<uint64_t> CaptureStats::*field;
+    } counters[] = {
+        {"capture_server_camera_frames_total", "Frames delivered by the camera.", &CaptureStats::frames_total},
+        {"capture_server_camera_bytes_total", "Pixel data delivered by the camera.", &CaptureStats::bytes_total},
+        {"capture_server_camera_incomplete_total", "Frames delivered incomplete.", &CaptureStats::incomplete_total},
+        {"capture_server_camera_dropped_total", "Frames missing from the frame ID sequence.", &CaptureStats::dropped_total},
+    };
+    std::string out;
+    server_metrics().append_text(out);
+    uint32_t ncams = cameras.size();
+    for (const auto &c : counters)
+    {
+        out += string_format("# HELP %s %s\n# TYPE %s counter\n", c.name, c.help, c.name);
+        for (uint32_t idx = 0; idx < ncams; idx++)
+            out += string_format("%s{camera=\"%u\"} %llu\n", c.name, cameras.id_at(idx), (unsigned long long)(cameras.at(idx).cam->stat.*c.field).load(std::memory_order_relaxed));
+    }
+    return out;
+}
+
+/**
+ * @brief Frame path under load for one configuration: ncams synthetic cameras through the real capture callback, each drained by a consumer thread.
+ *
+ * @return std::string Results as a JSON object.
+ */
+static std::string frame_bench_run(int ncams, const SyntheticConfig &cfg, double seconds)
+{
+    struct Consumer
+    {
+        std::thread thr;
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t dropped = 0;
+        LatencyHistogram latency; // callback entry to copied out of the ring
+    };
+
+    std::list<ImageCam> cams;
+    for (int i = 0; i < ncams; i++)
+    {
+        CameraInfo caminfo;
+        caminfo.idstr = string_format("synthetic:%d", i);
+        caminfo.name = "Synthetic";
+        cams.emplace_back(caminfo, nullptr, new SyntheticBackend(cfg));
+        if (cams.back().prepare_capture() != VmbErrorSuccess)
+            return "null";
     }
 
-    void open_camera()
+    // consumers attach before the first frame so every frame is accounted for
+    std::atomic<bool> running{true};
+    std::vector<std::unique_ptr<Consumer>> consumers;
+    for (ImageCam &cam : cams)
     {
-        std::string errmsg = "";
-        VmbError_t err = allied_open_camera(&handle, info.idstr.c_str(), 5);
-        if (err != VmbErrorSuccess)
-        {
-            errmsg = "Could not open camera: " + std::string(allied_strerr(err));
-            dbprintlf(FATAL "%s", errmsg.c_str());
-            return;
-        }
-        CharContainer *triglines = nullptr;
-        CharContainer *trigsrcs = nullptr;
-        char *key = nullptr;
-        char **arr = nullptr;
-        VmbUint32_t narr = 0;
-        err = allied_get_trigline(handle, (const char **)&key);
-        if (err == VmbErrorSuccess)
-        {
-            err = allied_get_triglines_list(handle, &arr, NULL, &narr);
-            if (err == VmbErrorSuccess)
-            {
-                triglines = new CharContainer((const char **)arr, narr, (const char *)key);
-                free(arr);
-                narr = 0;
-            }
-            else
-            {
-                dbprintlf("Could not get trigger lines list: %s", allied_strerr(err));
-            }
-        }
-        else
-        {
-            dbprintlf("Could not get selected trigger line: %s", allied_strerr(err));
-        }
-        if (triglines != nullptr)
-        {
-            // set all trigger lines to output
-            for (int i = 0; i < triglines->narr; i++)
-            {
-                char *line = triglines->arr[i];
-                err = allied_set_trigline(handle, line);
-                if (err != VmbErrorSuccess)
-                {
-                    dbprintlf("Could not select line %s: %s", line, allied_strerr(err));
-                }
-                else
-                {
-                    err = allied_set_trigline_mode(handle, "Output");
-                    if (err != VmbErrorSuccess)
-                        dbprintlf("Could not set line %s to output: %s", line, allied_strerr(err));
-                }
-            }
-            err = allied_set_trigline(handle, key);
-            if (err != VmbErrorSuccess)
-                dbprintlf("Could not select line %s: %s", key, allied_strerr(err));
-            // get trigger source
-            err = allied_get_trigline_src(handle, (const char **)&key);
-            if (err == VmbErrorSuccess)
+        consumers.emplace_back(new Consumer);
+        Consumer *c = consumers.back().get();
+        std::shared_ptr<const FrameRing> ring = cam.frames();
+        c->thr = std::thread([c, ring, &running]()
+                             {
+            FrameReader reader(ring.get());
+            std::vector<uint8_t> buf(ring->max_frame_size());
+            FrameHeader hdr;
+            while (running.load(std::memory_order_relaxed) || reader.pending())
             {
-                err = allied_get_trigline_src_list(handle, &arr, NULL, &narr);
-                if (err == VmbErrorSuccess)
-                {
-                    trigsrcs = new CharContainer((const char **)arr, narr, (const char *)key);
-                    free(arr);
-                    narr = 0;
-                }
-                else
+                if (!reader.pending())
                 {
-                    dbprintlf("Could not get trigger sources list: %s", allied_strerr(err));
+                    std::this_thread::yield();
+                    continue;
                 }
+                if (reader.next(&hdr, buf.data(), buf.size()) != FrameRing::READ_OK)
+                    continue;
+                c->latency.record(mono_ns() - hdr.host_ns);
+                c->frames++;
+                c->bytes += hdr.size;
             }
-        }
-        delete triglines;
-        delete trigsrcs;
-        opened = true;
-        // std::cout << "Opened!" << std::endl;
+            c->dropped = reader.dropped; });
     }
 
-    void cleanup()
+    uint64_t t0 = mono_ns();
+    for (ImageCam &cam : cams)
+        cam.begin_capture();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    for (ImageCam &cam : cams)
+        cam.stop_capture();
+    double elapsed = (mono_ns() - t0) / 1e9;
+    running = false;
+    for (std::unique_ptr<Consumer> &c : consumers)
+        c->thr.join();
+
+    FrameGeometry geom;
+    cams.front().backend->geometry(geom);
+    uint64_t delivered = 0, consumed = 0, consumed_bytes = 0;
+    std::string per_camera = "[";
+    size_t idx = 0;
+    for (ImageCam &cam : cams)
     {
-        if (opened)
-        {
-            allied_stop_capture(handle);  // just stop capture...
-            allied_close_camera(&handle); // close the camera
-            opened = false;
-        }
+        Consumer &c = *consumers[idx++];
+        uint64_t n = cam.stat.frames.load();
+        delivered += n;
+        consumed += c.frames;
+        consumed_bytes += c.bytes;
+        if (per_camera.size() > 1)
+            per_camera += ", ";
+        per_camera += string_format("{\"delivered\": %llu, \"consumed\": %llu, \"dropped\": %llu, "
+                                    "\"callback_us\": {\"p50\": %.2f, \"p99\": %.2f, \"p999\": %.2f}, "
+                                    "\"copy_out_us\": {\"p50\": %.2f, \"p99\": %.2f, \"p999\": %.2f}}",
+                                    (unsigned long long)n, (unsigned long long)c.frames, (unsigned long long)c.dropped,
+                                    cam.stat.callback.percentile(0.5) / 1e3, cam.stat.callback.percentile(0.99) / 1e3, cam.stat.callback.percentile(0.999) / 1e3,
+                                    c.latency.percentile(0.5) / 1e3, c.latency.percentile(0.99) / 1e3, c.latency.percentile(0.999) / 1e3);
     }
+    per_camera += "]";
+    return string_format("{\"cameras\": %d, \"width\": %u, \"height\": %u, \"format\": \"%s\", \"frame_bytes\": %zu, \"fps_limit\": %.1f, \"seconds\": %.3f, "
+                         "\"delivered_fps\": %.1f, \"delivered_mbps\": %.1f, \"consumed_fps\": %.1f, \"consumed_mbps\": %.1f, \"per_camera\": %s}",
+                         ncams, geom.width, geom.height, cfg.format.c_str(), geom.frame_bytes(), cfg.fps, elapsed,
+                         delivered / elapsed, delivered * geom.frame_bytes() / elapsed / 1e6,
+                         consumed / elapsed, consumed_bytes / elapsed / 1e6, per_camera.c_str());
+}
 
-    void close_camera()
+/**
+ * @brief Frame-path benchmark (-B), without hardware: every combination of camera count and frame size in spec.
+ *
+ * spec is CAMS:SIZES[:FORMAT[:FPS[:SECONDS]]], e.g. 1,2,4:640x480,1920x1080:Mono8:0:2.
+ * FPS 0 runs each synthetic camera flat out. Results go to stdout as a JSON array.
+ *
+ * @return int Process exit code.
+ */
+static int frame_benchmark(const char *spec)
+{
+    std::vector<std::string> parts;
+    std::string s = spec;
+    size_t pos = 0, colon;
+    while ((colon = s.find(':', pos)) != std::string::npos)
     {
-        cleanup();
-        opened = false;
+        parts.push_back(s.substr(pos, colon - pos));
+        pos = colon + 1;
     }
-
-    bool running()
+    parts.push_back(s.substr(pos));
+    if (parts.size() < 2)
+        return EXIT_FAILURE;
+    std::vector<int> counts;
+    for (const char *p = parts[0].c_str(); *p;)
     {
-        return capturing;
+        char *end;
+        long n = strtol(p, &end, 10);
+        if (end == p || n < 1)
+            return EXIT_FAILURE;
+        counts.push_back(n);
+        p = *end == ',' ? end + 1 : end;
     }
-
-    VmbError_t start_capture()
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    for (const char *p = parts[1].c_str(); *p;)
     {
-        VmbError_t err = VmbErrorSuccess;
-        if (handle != nullptr && !capturing)
-        {
-            err = allied_start_capture(handle, &Callback, (void *)this); // set the callback here
-        }
-        return err;
+        unsigned w, h;
+        int used = 0;
+        if (sscanf(p, "%ux%u%n", &w, &h, &used) != 2 || w < 8 || h < 8)
+            return EXIT_FAILURE;
+        sizes.push_back({w, h});
+        p += used;
+        if (*p == ',')
+            p++;
     }
+    SyntheticConfig cfg;
+    cfg.fps = 0;
+    cfg.latency_us = 0;
+    if (parts.size() > 2)
+        cfg.format = parts[2];
+    if (parts.size() > 3)
+        cfg.fps = atof(parts[3].c_str());
+    double seconds = parts.size() > 4 ? atof(parts[4].c_str()) : 2;
+    if (pixel_format_code(cfg.format.c_str()) == 0 || !(cfg.fps >= 0) || !(seconds > 0))
+        return EXIT_FAILURE;
 
-    VmbError_t stop_capture()
+    printf("[");
+    bool first = true;
+    for (const std::pair<uint32_t, uint32_t> &size : sizes)
     {
-        VmbError_t err = VmbErrorSuccess;
-        if (handle != nullptr && capturing)
+        for (int n : counts)
         {
-            err = allied_stop_capture(handle);
-            if (adio_hdl != nullptr && adio_bit >= 0)
-            {
-                this->state = 0;
-                WriteBit_aDIO(adio_hdl, 0, adio_bit, this->state);
-            }
+            cfg.width = size.first;
+            cfg.height = size.second;
+            printf("%s%s", first ? "\n" : ",\n", frame_bench_run(n, cfg, seconds).c_str());
+            fflush(stdout);
+            first = false;
         }
-        return err;
     }
-};
+    printf("\n]\n");
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
@@ -422,11 +1706,18 @@ int main(int argc, char *argv[])
     // arguments
     int adio_minor_num = 0;
     int port = 5555;
+    int pub_port = -1;
     std::string camera_id = "";
+    std::vector<std::string> playback_files; // recordings served as virtual cameras
+    std::vector<SyntheticConfig> synthetic_cams; // cameras without hardware, one entry per camera
+    bool synthetic_dio = false;
+    const char *frame_bench_spec = nullptr; // run the frame path benchmark instead of serving
+    BandwidthScheduler bandwidth; // sets throughput_limit of the cameras on links with a budget
+    int metrics_port = -1;        // HTTP exposition of the metrics command, off by default
     // Argument parsing
     {
         int c;
-        while ((c = getopt(argc, argv, "c:a:h")) != -1)
+        while ((c = getopt(argc, argv, "c:a:p:P:n:r:f:s:db:l:m:B:h")) != -1)
         {
             switch (c)
             {
@@ -453,333 +1744,491 @@ int main(int argc, char *argv[])
                 }
                 break;
             }
+            case 'P':
+            {
+                printf("Frame publisher port number: %s\n", optarg);
+                pub_port = atoi(optarg);
+                if (pub_port < 5000 || pub_port > 65535)
+                {
+                    dbprintlf(RED_FG "Invalid port number: %d", pub_port);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'n':
+            {
+                printf("Frame buffers per camera: %s\n", optarg);
+                int nbufs = atoi(optarg);
+                if (nbufs < 1)
+                {
+                    dbprintlf(RED_FG "Invalid number of frame buffers: %d", nbufs);
+                    exit(EXIT_FAILURE);
+                }
+                ImageCam::frame_pool_buffers = nbufs;
+                break;
+            }
+            case 'r':
+            {
+                printf("Recording directory: %s\n", optarg);
+                struct stat st;
+                if (stat(optarg, &st) != 0 || !S_ISDIR(st.st_mode))
+                {
+                    dbprintlf(RED_FG "Invalid recording directory: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                ImageCam::record_dir = optarg;
+                break;
+            }
+            case 'f':
+            {
+                printf("Playback camera from recording: %s\n", optarg);
+                playback_files.push_back(optarg);
+                break;
+            }
+            case 's':
+            {
+                printf("Synthetic cameras: %s\n", optarg);
+                SyntheticConfig cfg;
+                int ncams = 0;
+                if (!cfg.parse(optarg, ncams))
+                {
+                    dbprintlf(RED_FG "Invalid synthetic camera spec: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                synthetic_cams.insert(synthetic_cams.end(), ncams, cfg);
+                break;
+            }
+            case 'd':
+            {
+                printf("Synthetic aDIO port\n");
+                synthetic_dio = true;
+                break;
+            }
+            case 'b':
+            {
+                printf("Link bandwidth budget: %s MB/s\n", optarg);
+                if (!bandwidth.parse_budget(optarg))
+                {
+                    dbprintlf(RED_FG "Invalid bandwidth budget: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'l':
+            {
+                printf("Log level: %s\n", optarg);
+                int level;
+                if (!log_level_from_name(optarg, level))
+                {
+                    dbprintlf(RED_FG "Invalid log level: %s", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                log_threshold = level;
+                break;
+            }
+            case 'm':
+            {
+                printf("Metrics HTTP port number: %s\n", optarg);
+                metrics_port = atoi(optarg);
+                if (metrics_port < 1024 || metrics_port > 65535)
+                {
+                    dbprintlf(RED_FG "Invalid port number: %d", metrics_port);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'B':
+            {
+                frame_bench_spec = optarg;
+                break;
+            }
             case 'h':
             default:
             {
-                printf("\nUsage: %s [-c Camera ID] [-a ADIO Minor Device] [-p ZMQ Port] [-h Show this message]\n\n", argv[0]);
+                printf("\nUsage: %s [-c Camera ID] [-a ADIO Minor Device] [-p ZMQ Port] [-P Frame Publisher Port, default ZMQ Port + 1] [-n Frame Buffers per Camera, default 32] [-r Directory record_start creates its files in, default the working directory] [-f Recording to replay as a camera, repeatable] [-s Synthetic cameras N[:WxH[:FPS[:FORMAT[:LATENCY_US]]]], repeatable] [-d Synthetic aDIO port] [-b Bandwidth budget in MB/s per link, [LINK=]MBPS, repeatable] [-l Log level: info, warn, error, fatal or off, default info] [-m Metrics HTTP port on 127.0.0.1, default off] [-B Frame path benchmark CAMS:SIZES[:FORMAT[:FPS[:SECONDS]]], e.g. 1,4:640x480,1920x1080] [-h Show this message]\n\n", argv[0]);
                 exit(EXIT_SUCCESS);
             }
             }
         }
     }
+    if (frame_bench_spec != nullptr)
+    {
+        int ret = frame_benchmark(frame_bench_spec);
+        if (ret != EXIT_SUCCESS)
+            dbprintlf(RED_FG "Invalid frame benchmark spec: %s", frame_bench_spec);
+        return ret;
+    }
+    // every feature gets its own counters; fixed before the first command
+    for (const ImageCommand &desc : command_table)
+        server_metrics().add_feature(desc.id, desc.name);
     // Create the pipe name
     char *pipe_name = zsys_sprintf("tcp://*:%d", port);
     assert(pipe_name);
+    if (pub_port < 0)
+        pub_port = port + 1;
+    char *pub_name = zsys_sprintf("tcp://*:%d", pub_port);
+    assert(pub_name);
     // Set up ADIO
-    DeviceHandle adio_dev = nullptr;
-    if (OpenDIO_aDIO(&adio_dev, adio_minor_num) != 0)
+    DIOPort *dio_port = nullptr;
+    if (synthetic_dio)
     {
-        dbprintlf(RED_FG "Could not initialize ADIO API. Check if /dev/rtd-aDIO* exists. aDIO features will be disabled.");
-        adio_dev = nullptr;
+        dio_port = new SyntheticDIOPort();
     }
     else
     {
-        // set up port A as output and set all bits to low
-        int ret = LoadPort0BitDir_aDIO(adio_dev, 1, 1, 1, 1, 1, 1, 1, 1);
-        if (ret == -1)
+        try
         {
-            dbprintlf(RED_FG "Could not set PORT0 to output.");
+            dio_port = new ADIOPort(adio_minor_num);
         }
-        else
+        catch (const std::runtime_error &e)
         {
-            ret = WritePort_aDIO(adio_dev, 0, 0); // set all to low
-            if (ret < 0)
-            {
-                dbprintlf(RED_FG "Could not set all PORT0 bits to LOW: %s [%d]", strerror(ret), ret);
-            }
+            dbprintlf(RED_FG "aDIO features will be disabled.");
         }
     }
-    // Initialize String Hasher
-    StringHasher hasher = StringHasher();
+    // From here on only the engine thread writes port 0.
+    ADIOEngine *adio = new ADIOEngine(dio_port);
+    // Setup ZMQ.
+    zsock_t *pipe = zsock_new_router(pipe_name);
+    assert(pipe);
+    zstr_free(&pipe_name);
+    // Frames go out on their own socket so bulk data never queues behind replies.
+    FramePublisher *publisher = new FramePublisher(pub_name);
+    zstr_free(&pub_name);
+    zpoller_t *poller = zpoller_new(pipe, NULL);
+    assert(poller);
     // Set up cameras
-    std::vector<uint32_t> camids;
-    std::map<uint32_t, CameraInfo> caminfos;
-    std::map<uint32_t, ImageCam> imagecams;
+    std::list<std::unique_ptr<ImageCam>> imagecams; // storage only, every lookup goes through the registry
+    Cameras cameras(MAX_CAMERAS);
+    // cameras are opened on a pool of threads; the command loop registers each one as it becomes ready
+    std::unique_ptr<CameraStartup<ImageCam>> startup(new CameraStartup<ImageCam>());
+    zpoller_add(poller, startup->socket());
+
+    std::set<std::string> queued; // camera ID strings, each camera once
+    // the open stage may fill in caminfo; both stages run on the same thread
+    auto queue_camera = [&](std::shared_ptr<CameraInfo> caminfo, CameraStartup<ImageCam>::OpenFn open)
+    {
+        if (queued.count(caminfo->idstr) != 0)
+        {
+            dbprintlf(YELLOW_FG "Camera %s given more than once, opening it once.", caminfo->idstr.c_str());
+            return;
+        }
+        if (queued.size() >= MAX_CAMERAS)
+        {
+            // the registry holds MAX_CAMERAS; the rest are left out rather than failing the server
+            dbprintlf(RED_FG "More than %d cameras, not opening %s.", MAX_CAMERAS, caminfo->idstr.c_str());
+            return;
+        }
+        queued.insert(caminfo->idstr);
+        startup->add(caminfo->idstr, std::move(open), [caminfo, adio](CameraBackend *backend)
+                     { return new ImageCam(*caminfo, adio, backend); });
+    };
+    // command loop only: the registry has a single writer
+    auto add_camera = [&](ImageCam *cam) -> uint32_t
+    {
+        imagecams.emplace_back(cam);
+        const CameraInfo &caminfo = cam->camera_info();
+        Camera entry;
+        entry.cam = cam;
+        entry.cam->bandwidth = &bandwidth;
+        // one worker per camera; replies go out in completion order, not arrival order
+        entry.worker = zactor_new(camera_worker, entry.cam);
+        assert(entry.worker);
+        uint32_t hash = cameras.insert(caminfo.idstr, entry);
+        zpoller_add(poller, entry.worker);
+        publisher->add_source(hash, entry.cam);
+        if (!caminfo.link.empty())
+            bandwidth.add(caminfo.link, hash, entry.cam); // the caller has the fleet worker rebalance the link
+        return hash;
+    };
+    // without hardware, synthetic and playback cameras still make a working server
+    bool virtual_only = !playback_files.empty() || !synthetic_cams.empty();
 
     VmbError_t err = allied_init_api(NULL);
     if (err != VmbErrorSuccess)
     {
-        dbprintlf(FATAL "Failed to initialize Allied Vision API: %s", allied_strerr(err));
-        return 1;
+        if (!virtual_only)
+        {
+            dbprintlf(FATAL "Failed to initialize Allied Vision API: %s", allied_strerr(err));
+            return 1;
+        }
+        dbprintlf(YELLOW_FG "Failed to initialize Allied Vision API, continuing without hardware cameras: %s", allied_strerr(err));
     }
 
-    VmbUint32_t count;
-    VmbCameraInfo_t *vmbcaminfos;
-    err = allied_list_cameras(&vmbcaminfos, &count);
-    if (err != VmbErrorSuccess)
+    VmbUint32_t count = 0;
+    VmbCameraInfo_t *vmbcaminfos = nullptr;
+    if (err == VmbErrorSuccess)
     {
-        dbprintlf(FATAL "Failed to list cameras: %s", allied_strerr(err));
-        return 1;
+        err = allied_list_cameras(&vmbcaminfos, &count);
+        if (err != VmbErrorSuccess)
+        {
+            if (!virtual_only)
+            {
+                dbprintlf(FATAL "Failed to list cameras: %s", allied_strerr(err));
+                return 1;
+            }
+            dbprintlf(YELLOW_FG "Failed to list cameras, continuing without hardware cameras: %s", allied_strerr(err));
+            count = 0;
+        }
     }
 
+    std::map<VmbHandle_t, int> interfaces; // cameras behind the same interface share a link
     for (VmbUint32_t idx = 0; idx < count; idx++)
     {
         CameraInfo caminfo = CameraInfo(vmbcaminfos[idx]);
-        uint32_t hash = hasher.get_hash(caminfo.idstr);
+        auto iface = interfaces.emplace(vmbcaminfos[idx].interfaceHandle, (int)interfaces.size());
+        caminfo.link = string_format("if%d", iface.first->second);
         dbprintlf("Camera %d: %s", idx, caminfo.idstr.c_str());
         dbprintlf("Camera %d: %s", idx, caminfo.name.c_str());
         dbprintlf("Camera %d: %s", idx, caminfo.model.c_str());
         dbprintlf("Camera %d: %s", idx, caminfo.serial.c_str());
-        imagecams.insert(std::pair<uint32_t, ImageCam>(hash, ImageCam(caminfo, adio_dev)));
-        caminfos.insert(std::pair<uint32_t, CameraInfo>(hash, caminfo));
-        camids.push_back(hash);
+        dbprintlf("Camera %d: link %s", idx, caminfo.link.c_str());
+        queue_camera(std::make_shared<CameraInfo>(caminfo), [idstr = caminfo.idstr]() -> CameraBackend *
+                     { return new AlliedBackend(idstr); });
     }
 
-    // Setup ZMQ.
-    zsock_t *pipe = zsock_new_rep(pipe_name);
-    assert(pipe);
-    zstr_free(&pipe_name);
-    zpoller_t *poller = zpoller_new(pipe, NULL);
-    assert(poller);
-    // Loop, waiting for ZMQ commands and performing them as necessary.
-    while (!done)
+    for (const std::string &path : playback_files)
     {
-        zsock_t *which = (zsock_t *)zpoller_wait(poller, 1000); // wait a second
-        if (which == NULL)
-        {
-            continue;
-        }
-        zmsg_t *message = zmsg_recv(which);
-
-        bool get_cmd = false;
-        bool set_cmd = false;
+        CameraInfo caminfo;
+        caminfo.idstr = "playback:" + path;
+        caminfo.name = "Playback";
+        caminfo.serial = path;
+        auto info = std::make_shared<CameraInfo>(caminfo);
+        queue_camera(info, [path, info]() -> CameraBackend *
+                     {
+                         PlaybackFile *pb = new PlaybackFile(path);
+                         info->model = pb->header().camera_idstr; // the camera it was recorded from
+                         dbprintlf("Playback camera %s: %zu frames of %s at %.1f fps", path.c_str(), pb->frames(), info->model.c_str(), pb->framerate());
+                         return pb; });
+    }
 
-        char *cam_id = NULL;
-        char *command = NULL;
-        char *argument = NULL;
-        std::string reply = "None";
-        uint32_t chash = 0;
+    for (size_t idx = 0; idx < synthetic_cams.size(); idx++)
+    {
+        const SyntheticConfig &cfg = synthetic_cams[idx];
+        CameraInfo caminfo;
+        caminfo.idstr = string_format("synthetic:%zu", idx);
+        caminfo.name = "Synthetic";
+        caminfo.model = string_format("%ux%u %s", cfg.width, cfg.height, cfg.format.c_str());
+        caminfo.serial = std::to_string(idx);
+        caminfo.link = "synthetic";
+        dbprintlf("Synthetic camera %zu: %s at %.1f fps, %u us feature latency", idx, caminfo.model.c_str(), cfg.fps, cfg.latency_us);
+        queue_camera(std::make_shared<CameraInfo>(caminfo), [cfg]() -> CameraBackend *
+                     { return new SyntheticBackend(cfg); });
+    }
 
-        VmbError_t err = VmbErrorSuccess;
+    // IDs are claimed in ID string order before anything is opened, so hash collisions are settled the same way on every start
+    for (const std::string &idstr : queued)
+        cameras.reserve(idstr); // cannot fail: queue_camera() stops at MAX_CAMERAS distinct cameras
+    startup->start(); // the command loop serves from here on, cameras join as they come up
+    if (startup->finished())
+    {
+        zpoller_remove(poller, startup->socket());
+        dbprintlf(YELLOW_FG "No cameras to open.");
+    }
 
-        char *cmd_type = zmsg_popstr(message); // get cmd type
-        if (streq(cmd_type, "quit"))
+    FleetContext fleet_ctx;
+    fleet_ctx.cameras = &cameras;
+    fleet_ctx.bandwidth = &bandwidth;
+    zactor_t *fleet = zactor_new(fleet_worker, &fleet_ctx);
+    assert(fleet);
+    zpoller_add(poller, fleet);
+    std::unique_ptr<MetricsHttp> metrics_http;
+    if (metrics_port > 0)
+    {
+        try
         {
-            done = 1;
+            metrics_http.reset(new MetricsHttp(metrics_port, [&cameras]()
+                                               { return metrics_text(cameras); }));
         }
-        else if (streq(cmd_type, "list"))
+        catch (const std::runtime_error &e)
         {
-            // list cameras
-            reply = "[";
-            for (auto &hash : camids)
-            {
-                reply += std::to_string(hash) + ", ";
-            }
-            err = VmbErrorSuccess;
+            dbprintlf(YELLOW_FG "Metrics are only available through the metrics command.");
         }
-        else if (streq(cmd_type, "start_capture_all"))
+    }
+    // Loop, waiting for ZMQ commands and dispatching them as necessary.
+    uint64_t woke_ns = mono_ns();
+    while (!done)
+    {
+        uint64_t wait_ns = mono_ns();
+        void *which = zpoller_wait(poller, 1000); // wait a second
+        uint64_t now_ns = mono_ns();
+        server_metrics().loop(now_ns - wait_ns, wait_ns - woke_ns);
+        woke_ns = now_ns;
+        if (which == NULL)
         {
-            err = VmbErrorSuccess;
-            for (auto &image_cam : imagecams)
-            {
-                err = image_cam.second.start_capture();
-                if (err != VmbErrorSuccess)
-                {
-                    break;
-                }
-            }
+            continue;
         }
-        else if (streq(cmd_type, "stop_capture_all"))
+        if (which == startup->socket())
         {
-            err = VmbErrorSuccess;
-            for (auto &image_cam : imagecams)
+            for (auto &ready : startup->take())
             {
-                err = image_cam.second.stop_capture();
-                if (err != VmbErrorSuccess)
+                uint32_t hash = add_camera(ready.second);
+                startup->registered(ready.first);
+                const std::string &link = ready.second->camera_info().link;
+                if (!link.empty())
                 {
-                    break;
+                    // the rebalance takes camera locks and SDK calls: not on this thread
+                    zmsg_t *note = zmsg_new();
+                    zmsg_addstr(note, "$REBALANCE");
+                    zmsg_addstr(note, link.c_str());
+                    zmsg_send(&note, fleet);
                 }
+                double open_s, init_s, ready_s;
+                startup->timing(ready.first, open_s, init_s, ready_s);
+                dbprintlf("Camera %s: ID %u, ready after %.3f s (open %.3f s, init %.3f s)", startup->idstr(ready.first).c_str(), hash, ready_s, open_s, init_s);
             }
-        }
-        else if (streq(cmd_type, "start_capture"))
-        {
-            cam_id = zmsg_popstr(message);   // get camera ID
-            chash = hasher.get_hash(cam_id); // get camera hash
-            try
-            {
-                ImageCam image_cam = imagecams.at(chash);
-                err = image_cam.start_capture(); // do this for specific camera id
-            }
-            catch (const std::out_of_range &oor)
+            if (startup->finished())
             {
-                err = VmbErrorNotFound;
+                zpoller_remove(poller, startup->socket());
+                dbprintlf("Startup finished: %u of %zu cameras ready after %.3f s.", cameras.size(), startup->size(), startup->elapsed());
             }
+            continue;
         }
-        else if (streq(cmd_type, "stop_capture"))
+        if (which != pipe)
+        {
+            // a worker finished a command, route the reply back to its client
+            zmsg_t *ack = zmsg_recv(which);
+            if (ack != NULL)
+                zmsg_send(&ack, pipe);
+            continue;
+        }
+        zmsg_t *message = zmsg_recv(pipe);
+        if (message == NULL)
+        {
+            continue;
+        }
+        if (zmsg_size(message) < 3)
+        {
+            // not [identity][delimiter][command type]
+            zmsg_destroy(&message);
+            continue;
+        }
+        zframe_t *identity = zmsg_pop(message);
+        zframe_t *delimiter = zmsg_pop(message);
+
+        if (is_bin_request(zmsg_first(message)))
         {
-            cam_id = zmsg_popstr(message);   // get camera ID
-            chash = hasher.get_hash(cam_id); // get camera hash
-            try
+            const Camera *entry = cameras.find(bin_request_camera(zmsg_first(message)));
+            if (entry != nullptr)
             {
-                ImageCam image_cam = imagecams.at(chash);
-                err = image_cam.stop_capture(); // do this for specific camera id
+                zmsg_prepend(message, &delimiter);
+                zmsg_prepend(message, &identity);
+                zmsg_send(&message, entry->worker);
+                continue;
             }
-            catch (const std::out_of_range &oor)
+            zmsg_t *ack = binary_command(nullptr, message);
+            zmsg_prepend(ack, &delimiter);
+            zmsg_prepend(ack, &identity);
+            zmsg_send(&ack, pipe);
+            continue;
+        }
+        if (is_camera_command(zmsg_first(message)))
+        {
+            zframe_t *id_frame = zmsg_next(message);
+            char *cam_id = id_frame != NULL ? zframe_strdup(id_frame) : NULL;
+            const Camera *entry = cameras.find(cam_id);
+            zstr_free(&cam_id);
+            if (entry != nullptr)
             {
-                err = VmbErrorNotFound;
+                zmsg_prepend(message, &delimiter);
+                zmsg_prepend(message, &identity);
+                zmsg_send(&message, entry->worker);
+                continue;
             }
+            zmsg_t *ack = camera_command(nullptr, message);
+            zmsg_prepend(ack, &delimiter);
+            zmsg_prepend(ack, &identity);
+            zmsg_send(&ack, pipe);
+            continue;
         }
-        else if (streq(cmd_type, "get"))
+        if (zframe_streq(zmsg_first(message), "start_capture_all") || zframe_streq(zmsg_first(message), "stop_capture_all") || zframe_streq(zmsg_first(message), "batch") || zframe_streq(zmsg_first(message), "bandwidth"))
         {
-            cam_id = zmsg_popstr(message);  // get camera ID
-            command = zmsg_popstr(message); // get command
-            get_cmd = true;
+            zmsg_prepend(message, &delimiter);
+            zmsg_prepend(message, &identity);
+            zmsg_send(&message, fleet);
+            continue;
         }
-        else if (streq(cmd_type, "set"))
+
+        uint64_t start_ns = mono_ns();
+        std::string reply = "None";
+        VmbError_t err = VmbErrorSuccess;
+
+        char *cmd_type = zmsg_popstr(message); // get cmd type
+        if (streq(cmd_type, "quit"))
         {
-            cam_id = zmsg_popstr(message);   // get camera ID
-            command = zmsg_popstr(message);  // get command
-            argument = zmsg_popstr(message); // get argument
-            set_cmd = true;
+            done = 1;
         }
-        else
+        else if (streq(cmd_type, "commands"))
         {
-            err = VmbErrorWrongType; // wrong command
+            reply = command_list();
         }
-        long cmd_num = atol(command);
-        if (set_cmd)
+        else if (streq(cmd_type, "adio"))
         {
-            uint32_t chash = hasher.get_hash(cam_id);
-            try
-            {
-                ImageCam image_cam = imagecams.at(chash);
-                switch (cmd_num)
-                {
-                    SET_CASE_STR(image_format)
-                    SET_CASE_STR(sensor_bit_depth)
-                    SET_CASE_STR(trigline)
-                    SET_CASE_STR(trigline_src)
-                    SET_CASE_DBL(exposure_us)
-                    SET_CASE_DBL(acq_framerate)
-                    SET_CASE_BOOL(acq_framerate_auto)
-                    SET_CASE_INT(throughput_limit)
-                case CommandNames::image_size:
-                {
-                    char *arg2 = zmsg_popstr(message);
-                    long arg1l = atol(argument);
-                    long arg2l = atol(arg2);
-                    err = allied_set_image_size(image_cam.handle, arg1l, arg2l);
-                    zstr_free(&arg2);
-                    break;
-                }
-                case CommandNames::image_ofst:
-                {
-                    char *arg2 = zmsg_popstr(message);
-                    long arg1l = atol(argument);
-                    long arg2l = atol(arg2);
-                    err = allied_set_image_ofst(image_cam.handle, arg1l, arg2l);
-                    zstr_free(&arg2);
-                    break;
-                }
-                case CommandNames::adio_bit:
-                {
-                    long arg1l = atol(argument);
-                    image_cam.adio_bit = arg1l;
-                    break;
-                }
-                default:
-                {
-                    err = VmbErrorWrongType; // wrong command
-                    break;
-                }
-                }
-            }
-            catch (const std::out_of_range &oor)
-            {
-                err = VmbErrorNotFound;
-            }
+            // trigger output statistics; argument "reset" clears them
+            char *argument = zmsg_popstr(message);
+            reply = adio->to_string();
+            if (argument != NULL && streq(argument, "reset"))
+                adio->reset_stats();
+            zstr_free(&argument);
         }
-        else if (get_cmd)
+        else if (streq(cmd_type, "log"))
         {
-            uint32_t chash = hasher.get_hash(cam_id);
-            try
-            {
-                ImageCam image_cam = imagecams.at(chash);
-                switch (cmd_num)
-                {
-                    GET_CASE_STR(image_format)
-                    GET_CASE_STR(sensor_bit_depth)
-                    GET_CASE_STR(trigline)
-                    GET_CASE_STR(trigline_src)
-                    GET_CASE_DBL(exposure_us)
-                    GET_CASE_DBL(acq_framerate)
-                    GET_CASE_BOOL(acq_framerate_auto)
-                    GET_CASE_INT(throughput_limit)
-                case CommandNames::sensor_size:
-                {
-                    VmbInt64_t width = 0, height = 0;
-                    err = allied_get_sensor_size(image_cam.handle, &width, &height);
-                    reply = std::to_string(width) + "x" + std::to_string(height);
-                    break;
-                }
-                case CommandNames::image_size:
-                {
-                    VmbInt64_t width = 0, height = 0;
-                    err = allied_get_image_size(image_cam.handle, &width, &height);
-                    reply = std::to_string(width) + "x" + std::to_string(height);
-                    break;
-                }
-                case CommandNames::image_ofst:
-                {
-                    VmbInt64_t width = 0, height = 0;
-                    err = allied_get_image_ofst(image_cam.handle, &width, &height);
-                    reply = std::to_string(width) + "x" + std::to_string(height);
-                    break;
-                }
-                case CommandNames::adio_bit:
-                {
-                    reply = std::to_string(image_cam.adio_bit);
-                    break;
-                }
-                case CommandNames::throughput_limit_range:
-                {
-                    VmbInt64_t vmin = 0, vmax = 0;
-                    err = allied_get_throughput_limit_range(image_cam.handle, &vmin, &vmax, NULL);
-                    reply = "[" + std::to_string(vmin) + ", " + std::to_string(vmax) + "]";
-                    break;
-                }
-                default:
-                {
-                    err = VmbErrorWrongType; // wrong command
-                    break;
-                }
-                }
-            }
-            catch (const std::out_of_range &oor)
-            {
-                err = VmbErrorNotFound;
-            }
+            // logger counters; an argument sets the level
+            char *argument = zmsg_popstr(message);
+            int level;
+            if (argument != NULL && !log_level_from_name(argument, level))
+                err = VmbErrorBadParameter;
+            else if (argument != NULL)
+                log_threshold = level;
+            reply = log_stats();
+            zstr_free(&argument);
         }
-        char *ack_nac = (char *) "ACK";
-        if (err != VmbErrorSuccess)
+        else if (streq(cmd_type, "metrics"))
         {
-            ack_nac = (char *) "NAC";
+            reply = metrics_text(cameras);
         }
-        zmsg_t *ack = zmsg_new();
-        zmsg_pushstr(ack, ack_nac);       // ack or nack
-        zmsg_pushstrf(ack, "%d", err);    // error code
-        zmsg_pushstr(ack, reply.c_str()); // None if not set
-        zmsg_pushstr(ack, cmd_type);      // command type
-        if (cam_id != NULL)
+        else if (streq(cmd_type, "startup"))
         {
-            zmsg_pushstr(ack, cam_id);
-            if (command != NULL)
-                zmsg_pushstr(ack, command);
+            // per camera bring-up times; cameras still coming up are listed with their current stage
+            reply = startup->to_string();
         }
-        zmsg_send(&ack, which);
+        else if (streq(cmd_type, "list"))
+        {
+            // list cameras
+            reply = "[";
+            for (uint32_t idx = 0; idx < cameras.size(); idx++)
+            {
+                reply += std::to_string(cameras.id_at(idx)) + ", ";
+            }
+            err = VmbErrorSuccess;
+        }
+        else
+        {
+            err = VmbErrorWrongType; // wrong command
+        }
+        server_metrics().command(command_type_of(cmd_type), mono_ns() - start_ns, err);
+        zmsg_t *ack = make_reply(cmd_type, NULL, NULL, err, reply);
+        zmsg_prepend(ack, &delimiter);
+        zmsg_prepend(ack, &identity);
+        zmsg_send(&ack, pipe);
         // cleanup
         zstr_free(&cmd_type);
-        zstr_free(&cam_id);
-        zstr_free(&command);
-        zstr_free(&argument);
         zmsg_destroy(&message);
     }
 
+    zactor_destroy(&fleet);
+    metrics_http.reset();
+    startup.reset(); // waits for cameras still being opened, before the engine goes
+    for (uint32_t idx = 0; idx < cameras.size(); idx++)
+    {
+        zactor_t *worker = cameras.at(idx).worker;
+        zactor_destroy(&worker);
+    }
     zpoller_destroy(&poller);
     zsock_destroy(&pipe);
-
-    if (adio_dev != nullptr)
-        CloseDIO_aDIO(adio_dev);
+    delete publisher;
+    imagecams.clear(); // no callback may post to the engine past this point
+    delete adio;
+    delete dio_port;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -118,6 +118,60 @@
 #endif // MEB_CODES
 #endif // defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 
+#if defined(MEB_ASYNC_LOG) && defined(__cplusplus)
+// Same macros, queued to a background writer instead of printed in place (see asynclog.hpp).
+#include "asynclog.hpp"
+
+#define MEB_LOG(located, to_stdout, level, format, ...)                                                  \
+    (                                                                                                   \
+        {                                                                                               \
+            static LogSite _meb_site(__FILE__, __LINE__, __func__, level, located, to_stdout);          \
+            log_enabled(_meb_site) ? log_write(_meb_site, format, ##__VA_ARGS__) : 0;                   \
+        })
+
+#ifndef dbprintlf
+#define dbprintlf(format, ...)                                                                        \
+    {                                                                                                 \
+        if (MEB_DBGLVL & MEB_DBG_DBPRINT)                                                             \
+            MEB_LOG(true, false, log_level_of(format), format TERMINATOR "\n", ##__VA_ARGS__);        \
+    }
+#endif // dbprintlf
+
+#ifndef dbprintf
+#define dbprintf(format, ...)                                                                         \
+    {                                                                                                 \
+        if (MEB_DBGLVL & MEB_DBG_DBPRINT)                                                             \
+            MEB_LOG(true, false, log_level_of(format), format TERMINATOR, ##__VA_ARGS__);             \
+    }
+#endif // dbprintf
+
+#ifndef bprintf
+#define bprintf(str, ...) \
+    ((MEB_DBGLVL & MEB_DBG_BPRINT) ? MEB_LOG(false, true, log_level_of(str), str TERMINATOR, ##__VA_ARGS__) : 0)
+#endif // bprintf
+
+#ifndef bprintlf
+#define bprintlf(str, ...) \
+    ((MEB_DBGLVL & MEB_DBG_BPRINT) ? MEB_LOG(false, true, log_level_of(str), str TERMINATOR " \n", ##__VA_ARGS__) : 0)
+#endif // bprintlf
+
+#ifndef erprintlf
+#define erprintlf(error)                                                                                                 \
+    {                                                                                                                    \
+        if (MEB_DBGLVL & MEB_DBG_ERPRINT)                                                                                \
+            MEB_LOG(true, false, MEB_LOG_ERROR, RED_FG "ERRNO >>> %d:" RESET_ALL " %s" TERMINATOR "\n", error, strerror(error)); \
+    }
+#endif // erprintlf
+
+#ifndef tprintf
+#define tprintf(str, ...)                                                           \
+    {                                                                               \
+        if (MEB_DBGLVL & MEB_DBG_TPRINT)                                            \
+            MEB_LOG(false, true, log_level_of(str), str TERMINATOR, ##__VA_ARGS__); \
+    }
+#endif // tprintf
+#endif // defined(MEB_ASYNC_LOG) && defined(__cplusplus)
+
 #ifndef dbprintlf
 #define dbprintlf(format, ...)                                                                                    \
     {                                                                                                             \
@@ -0,0 +1,280 @@
+#include "metrics.hpp"
+#include "meb_print.h"
+#include "string_format.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdexcept>
+
+#define METRICS_HTTP_POLL_MS 250 // how often the server thread checks for shutdown
+#define METRICS_HTTP_TIMEOUT_S 2 // per client, for the request and the reply
+#define METRICS_HTTP_REQUEST_MAX 4096
+
+static const char *const command_type_names[CMDTYPE_COUNT] = {
+    "start_capture",
+    "stop_capture",
+    "stats",
+    "get",
+    "set",
+    "record_start",
+    "record_stop",
+    "start_capture_all",
+    "stop_capture_all",
+    "batch",
+    "bandwidth",
+    "list",
+    "commands",
+    "adio",
+    "log",
+    "metrics",
+    "startup",
+    "quit",
+    "other",
+};
+
+const char *command_type_name(CommandType type)
+{
+    return type < CMDTYPE_COUNT ? command_type_names[type] : "other";
+}
+
+CommandType command_type_of(const char *name)
+{
+    if (name == nullptr)
+        return CMDTYPE_OTHER;
+    for (uint32_t i = 0; i < CMDTYPE_OTHER; i++)
+    {
+        if (strcmp(name, command_type_names[i]) == 0)
+            return (CommandType)i;
+    }
+    return CMDTYPE_OTHER;
+}
+
+ServerMetrics::ServerMetrics()
+{
+    for (int i = 0; i < METRICS_MAX_ERROR; i++)
+        sdk_errors[i] = 0;
+    loop_wait_ns = 0;
+    loop_busy_ns = 0;
+    loop_wakeups = 0;
+    start_ns = mono_ns();
+}
+
+ServerMetrics::FeatureSlot *ServerMetrics::find_feature(long id)
+{
+    for (uint32_t i = 0; i < nfeatures; i++)
+    {
+        if (features[i].id == id)
+            return &features[i];
+    }
+    return nullptr;
+}
+
+void ServerMetrics::add_feature(long id, const char *name)
+{
+    if (find_feature(id) != nullptr)
+        return;
+    if (nfeatures >= METRICS_MAX_FEATURES)
+    {
+        dbprintlf(YELLOW_FG "No metrics slot left for feature %s.", name);
+        return;
+    }
+    features[nfeatures].id = id;
+    features[nfeatures].name = name;
+    nfeatures++;
+}
+
+void metrics_append_summary(std::string &out, const char *name, const std::string &labels, const LatencyHistogram &hist, uint64_t sum_ns)
+{
+    const char *sep = labels.empty() ? "" : ",";
+    std::string block = labels.empty() ? "" : "{" + labels + "}";
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (double q : quantiles)
+        out += string_format("%s{%s%squantile=\"%g\"} %.9f\n", name, labels.c_str(), sep, q, hist.percentile(q) / 1e9);
+    out += string_format("%s_sum%s %.9f\n", name, block.c_str(), sum_ns / 1e9);
+    out += string_format("%s_count%s %llu\n", name, block.c_str(), (unsigned long long)hist.count());
+}
+
+void ServerMetrics::append_text(std::string &out) const
+{
+    out += "# HELP capture_server_commands_total Commands executed, by command type.\n"
+           "# TYPE capture_server_commands_total counter\n";
+    for (uint32_t i = 0; i < CMDTYPE_COUNT; i++)
+        out += string_format("capture_server_commands_total{type=\"%s\"} %llu\n", command_type_names[i], (unsigned long long)commands[i].count.load(std::memory_order_relaxed));
+    out += "# HELP capture_server_command_errors_total Commands answered with an error, by command type.\n"
+           "# TYPE capture_server_command_errors_total counter\n";
+    for (uint32_t i = 0; i < CMDTYPE_COUNT; i++)
+        out += string_format("capture_server_command_errors_total{type=\"%s\"} %llu\n", command_type_names[i], (unsigned long long)commands[i].errors.load(std::memory_order_relaxed));
+    out += "# HELP capture_server_command_seconds Time to execute a command, by command type.\n"
+           "# TYPE capture_server_command_seconds summary\n";
+    for (uint32_t i = 0; i < CMDTYPE_COUNT; i++)
+    {
+        if (commands[i].count.load(std::memory_order_relaxed) > 0)
+            metrics_append_summary(out, "capture_server_command_seconds", string_format("type=\"%s\"", command_type_names[i]), commands[i].latency, commands[i].sum_ns.load(std::memory_order_relaxed));
+    }
+
+    out += "# HELP capture_server_feature_ops_total Feature gets and sets, cached or not, by feature.\n"
+           "# TYPE capture_server_feature_ops_total counter\n";
+    for (uint32_t i = 0; i < nfeatures; i++)
+    {
+        out += string_format("capture_server_feature_ops_total{feature=\"%s\",id=\"%ld\",op=\"get\"} %llu\n", features[i].name, features[i].id, (unsigned long long)features[i].get.count.load(std::memory_order_relaxed));
+        out += string_format("capture_server_feature_ops_total{feature=\"%s\",id=\"%ld\",op=\"set\"} %llu\n", features[i].name, features[i].id, (unsigned long long)features[i].set.count.load(std::memory_order_relaxed));
+    }
+    out += "# HELP capture_server_feature_errors_total Feature gets and sets that failed, by feature.\n"
+           "# TYPE capture_server_feature_errors_total counter\n";
+    for (uint32_t i = 0; i < nfeatures; i++)
+    {
+        out += string_format("capture_server_feature_errors_total{feature=\"%s\",id=\"%ld\",op=\"get\"} %llu\n", features[i].name, features[i].id, (unsigned long long)features[i].get.errors.load(std::memory_order_relaxed));
+        out += string_format("capture_server_feature_errors_total{feature=\"%s\",id=\"%ld\",op=\"set\"} %llu\n", features[i].name, features[i].id, (unsigned long long)features[i].set.errors.load(std::memory_order_relaxed));
+    }
+    out += "# HELP capture_server_feature_seconds Time to get or set a feature, by feature.\n"
+           "# TYPE capture_server_feature_seconds summary\n";
+    for (uint32_t i = 0; i < nfeatures; i++)
+    {
+        const OpMetric *ops[2] = {&features[i].get, &features[i].set};
+        for (int k = 0; k < 2; k++)
+        {
+            if (ops[k]->count.load(std::memory_order_relaxed) > 0)
+                metrics_append_summary(out, "capture_server_feature_seconds", string_format("feature=\"%s\",id=\"%ld\",op=\"%s\"", features[i].name, features[i].id, k == 0 ? "get" : "set"),
+                                       ops[k]->latency, ops[k]->sum_ns.load(std::memory_order_relaxed));
+        }
+    }
+
+    out += "# HELP capture_server_sdk_errors_total Failed camera SDK calls, by VmbError_t.\n"
+           "# TYPE capture_server_sdk_errors_total counter\n";
+    for (int i = 0; i < METRICS_MAX_ERROR; i++)
+    {
+        uint64_t n = sdk_errors[i].load(std::memory_order_relaxed);
+        if (n == 0)
+            continue;
+        if (i == 0)
+            out += string_format("capture_server_sdk_errors_total{code=\"other\"} %llu\n", (unsigned long long)n);
+        else
+            out += string_format("capture_server_sdk_errors_total{code=\"%d\"} %llu\n", -i, (unsigned long long)n);
+    }
+
+    uint64_t wait = loop_wait_ns.load(std::memory_order_relaxed);
+    uint64_t busy = loop_busy_ns.load(std::memory_order_relaxed);
+    out += "# HELP capture_server_loop_wait_seconds_total Command loop time blocked in zpoller_wait.\n"
+           "# TYPE capture_server_loop_wait_seconds_total counter\n";
+    out += string_format("capture_server_loop_wait_seconds_total %.9f\n", wait / 1e9);
+    out += "# HELP capture_server_loop_busy_seconds_total Command loop time spent handling messages.\n"
+           "# TYPE capture_server_loop_busy_seconds_total counter\n";
+    out += string_format("capture_server_loop_busy_seconds_total %.9f\n", busy / 1e9);
+    out += "# HELP capture_server_loop_wakeups_total Returns from zpoller_wait.\n"
+           "# TYPE capture_server_loop_wakeups_total counter\n";
+    out += string_format("capture_server_loop_wakeups_total %llu\n", (unsigned long long)loop_wakeups.load(std::memory_order_relaxed));
+    out += "# HELP capture_server_loop_utilisation Busy share of the command loop since startup.\n"
+           "# TYPE capture_server_loop_utilisation gauge\n";
+    out += string_format("capture_server_loop_utilisation %.6f\n", wait + busy > 0 ? (double)busy / (wait + busy) : 0.0);
+    out += "# HELP capture_server_loop_busy_seconds Handling time per command loop wake-up.\n"
+           "# TYPE capture_server_loop_busy_seconds summary\n";
+    metrics_append_summary(out, "capture_server_loop_busy_seconds", "", loop_busy, busy);
+    out += "# HELP capture_server_uptime_seconds Time since the server started.\n"
+           "# TYPE capture_server_uptime_seconds gauge\n";
+    out += string_format("capture_server_uptime_seconds %.3f\n", (mono_ns() - start_ns) / 1e9);
+}
+
+ServerMetrics &server_metrics()
+{
+    static ServerMetrics metrics;
+    return metrics;
+}
+
+MetricsHttp::MetricsHttp(int port, std::function<std::string()> render)
+{
+    this->render = render;
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        dbprintlf(RED_FG "Could not create the metrics socket: %s", strerror(errno));
+        throw std::runtime_error("Could not create the metrics socket.");
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        dbprintlf(RED_FG "Could not listen for metrics on port %d: %s", port, strerror(errno));
+        close(fd);
+        throw std::runtime_error("Could not bind the metrics port.");
+    }
+    running = true;
+    thr = std::thread(&MetricsHttp::run, this);
+}
+
+MetricsHttp::~MetricsHttp()
+{
+    running = false;
+    thr.join();
+    close(fd);
+}
+
+void MetricsHttp::run()
+{
+    while (running.load(std::memory_order_acquire))
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, METRICS_HTTP_POLL_MS) <= 0)
+            continue;
+        int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        serve(client);
+        close(client);
+    }
+}
+
+void MetricsHttp::serve(int client)
+{
+    struct timeval tv;
+    tv.tv_sec = METRICS_HTTP_TIMEOUT_S;
+    tv.tv_usec = 0;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    // only the request line matters; read until the end of the headers
+    char req[METRICS_HTTP_REQUEST_MAX + 1];
+    size_t len = 0;
+    while (len < METRICS_HTTP_REQUEST_MAX)
+    {
+        ssize_t n = recv(client, req + len, METRICS_HTTP_REQUEST_MAX - len, 0);
+        if (n <= 0)
+            break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != nullptr || strstr(req, "\n\n") != nullptr)
+            break;
+    }
+    req[len] = '\0';
+    std::string body;
+    const char *status;
+    if (strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET / ", 6) == 0)
+    {
+        status = "200 OK";
+        body = render();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "Not found; try /metrics.\n";
+    }
+    std::string reply = string_format("HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, body.size()) + body;
+    size_t off = 0;
+    while (off < reply.size())
+    {
+        ssize_t n = send(client, reply.data() + off, reply.size() - off, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+}
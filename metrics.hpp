@@ -0,0 +1,214 @@
+/**
+ * @file metrics.hpp
+ * @brief Server instrumentation: command and feature latencies, SDK errors and command loop utilisation.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Every update is a relaxed atomic add into storage fixed at startup, so the
+ * command path never takes a lock to be measured. The counters are rendered
+ * in the Prometheus text exposition format, both for the `metrics` command
+ * and for the optional HTTP port (MetricsHttp), which serves them from its
+ * own thread on 127.0.0.1.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "camerabackend.hpp"
+#include "capturestats.hpp"
+
+#define METRICS_MAX_FEATURES 64 // command table rows
+#define METRICS_MAX_ERROR 64    // VmbError_t codes 0 down to -63 are counted apart, the rest together
+
+/**
+ * @brief Command types as they appear in the first frame of a request.
+ *
+ */
+enum CommandType : uint32_t
+{
+    CMDTYPE_START_CAPTURE,
+    CMDTYPE_STOP_CAPTURE,
+    CMDTYPE_STATS,
+    CMDTYPE_GET,
+    CMDTYPE_SET,
+    CMDTYPE_RECORD_START,
+    CMDTYPE_RECORD_STOP,
+    CMDTYPE_START_CAPTURE_ALL,
+    CMDTYPE_STOP_CAPTURE_ALL,
+    CMDTYPE_BATCH,
+    CMDTYPE_BANDWIDTH,
+    CMDTYPE_LIST,
+    CMDTYPE_COMMANDS,
+    CMDTYPE_ADIO,
+    CMDTYPE_LOG,
+    CMDTYPE_METRICS,
+    CMDTYPE_STARTUP,
+    CMDTYPE_QUIT,
+    CMDTYPE_OTHER, // unknown command type
+    CMDTYPE_COUNT
+};
+
+const char *command_type_name(CommandType type);
+
+/**
+ * @brief Command type by name, CMDTYPE_OTHER if unknown.
+ *
+ */
+CommandType command_type_of(const char *name);
+
+/**
+ * @brief Count, errors and latency of one kind of operation.
+ *
+ */
+class OpMetric
+{
+public:
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> sum_ns;
+    LatencyHistogram latency;
+
+    OpMetric()
+    {
+        count = 0;
+        errors = 0;
+        sum_ns = 0;
+    }
+
+    void record(uint64_t ns, bool ok)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (!ok)
+            errors.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        latency.record(ns);
+    }
+};
+
+class ServerMetrics
+{
+    struct FeatureSlot
+    {
+        long id = 0;
+        const char *name = nullptr;
+        OpMetric get;
+        OpMetric set;
+    };
+
+    OpMetric commands[CMDTYPE_COUNT];
+    FeatureSlot features[METRICS_MAX_FEATURES];
+    uint32_t nfeatures = 0; // fixed before the first command
+    std::atomic<uint64_t> sdk_errors[METRICS_MAX_ERROR];
+    std::atomic<uint64_t> loop_wait_ns;
+    std::atomic<uint64_t> loop_busy_ns;
+    std::atomic<uint64_t> loop_wakeups;
+    LatencyHistogram loop_busy; // handling time per wake-up
+    uint64_t start_ns;
+
+    FeatureSlot *find_feature(long id);
+
+public:
+    ServerMetrics();
+
+    ServerMetrics(const ServerMetrics &) = delete;
+    ServerMetrics &operator=(const ServerMetrics &) = delete;
+
+    /**
+     * @brief Give a feature its own counters. Only before commands are served.
+     *
+     */
+    void add_feature(long id, const char *name);
+
+    void command(CommandType type, uint64_t ns, VmbError_t err)
+    {
+        commands[type < CMDTYPE_COUNT ? type : CMDTYPE_OTHER].record(ns, err == VmbErrorSuccess);
+    }
+
+    /**
+     * @brief One get or set of a feature, whether or not it reached the camera.
+     *
+     */
+    void feature(long id, bool set, uint64_t ns, VmbError_t err)
+    {
+        FeatureSlot *slot = find_feature(id);
+        if (slot != nullptr)
+            (set ? slot->set : slot->get).record(ns, err == VmbErrorSuccess);
+    }
+
+    /**
+     * @brief A call into the camera SDK (or another backend) that failed.
+     *
+     */
+    void sdk_error(VmbError_t err)
+    {
+        int idx = -(int)err;
+        sdk_errors[idx > 0 && idx < METRICS_MAX_ERROR ? idx : 0].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief One turn of the command loop.
+     *
+     * @param wait_ns Time blocked in zpoller_wait().
+     * @param busy_ns Time spent handling what the previous wait returned.
+     */
+    void loop(uint64_t wait_ns, uint64_t busy_ns)
+    {
+        loop_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+        loop_busy_ns.fetch_add(busy_ns, std::memory_order_relaxed);
+        loop_wakeups.fetch_add(1, std::memory_order_relaxed);
+        loop_busy.record(busy_ns);
+    }
+
+    /**
+     * @brief Append every counter in the Prometheus text format.
+     *
+     */
+    void append_text(std::string &out) const;
+};
+
+/**
+ * @brief The process-wide metrics.
+ *
+ */
+ServerMetrics &server_metrics();
+
+/**
+ * @brief Append one summary (quantiles, sum and count) in the Prometheus text format. labels is empty or "key=\"value\",...".
+ *
+ */
+void metrics_append_summary(std::string &out, const char *name, const std::string &labels, const LatencyHistogram &hist, uint64_t sum_ns);
+
+/**
+ * @brief Minimal HTTP server for the text exposition, on 127.0.0.1 only.
+ *
+ */
+class MetricsHttp
+{
+    int fd = -1;
+    std::atomic<bool> running;
+    std::function<std::string()> render;
+    std::thread thr;
+
+    void run();
+    void serve(int client);
+
+public:
+    /**
+     * @brief Listen on port and answer GET /metrics with render().
+     *
+     * @param render Builds the exposition; called from the server thread, must only read lock-free state.
+     * @throws std::runtime_error if the port cannot be bound.
+     */
+    MetricsHttp(int port, std::function<std::string()> render);
+    ~MetricsHttp();
+
+    MetricsHttp(const MetricsHttp &) = delete;
+    MetricsHttp &operator=(const MetricsHttp &) = delete;
+};
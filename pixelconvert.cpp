@@ -0,0 +1,833 @@
+#include "pixelconvert.hpp"
+#include "pixelformat.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86 1
+#include <immintrin.h>
+#endif
+
+static inline uint8_t avg2(uint8_t a, uint8_t b)
+{
+    return (a + b + 1) >> 1; // rounds like pavgb, so every ISA gives the same bytes
+}
+
+// ---------------------------------------------------------------- scalar
+
+static void unpack10p_scalar(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, s += 5)
+    {
+        d[i] = s[0] | (s[1] & 0x03) << 8;
+        d[i + 1] = s[1] >> 2 | (s[2] & 0x0f) << 6;
+        d[i + 2] = s[2] >> 4 | (s[3] & 0x3f) << 4;
+        d[i + 3] = s[3] >> 6 | s[4] << 2;
+    }
+    for (size_t bit = 0; i < n; i++, bit += 10)
+        d[i] = ((s[bit / 8] | s[bit / 8 + 1] << 8) >> (bit % 8)) & 0x3ff;
+}
+
+static void unpack12p_scalar(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, s += 3)
+    {
+        d[i] = s[0] | (s[1] & 0x0f) << 8;
+        d[i + 1] = s[1] >> 4 | s[2] << 4;
+    }
+    if (i < n)
+        d[i] = s[0] | (s[1] & 0x0f) << 8;
+}
+
+static void unpack12packed_scalar(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, s += 3)
+    {
+        d[i] = s[0] << 4 | (s[1] & 0x0f);
+        d[i + 1] = s[2] << 4 | s[1] >> 4;
+    }
+    if (i < n)
+        d[i] = s[0] << 4 | (s[1] & 0x0f);
+}
+
+static void shift16to8_scalar(const uint16_t *s, uint8_t *d, size_t n, int shift)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint16_t v = s[i] >> shift;
+        d[i] = v > 255 ? 255 : v;
+    }
+}
+
+/**
+ * @brief One demosaiced pixel, with the image mirrored at the edges so neighbours keep their colour.
+ *
+ */
+static inline void bayer_pixel(const uint8_t *src, uint32_t w, uint32_t h, uint32_t x, uint32_t y, int r_x, int r_y, uint8_t *out)
+{
+    uint32_t xl = x > 0 ? x - 1 : 1;
+    uint32_t xr = x + 1 < w ? x + 1 : w - 2;
+    const uint8_t *row = src + (size_t)y * w;
+    const uint8_t *up = src + (size_t)(y > 0 ? y - 1 : 1) * w;
+    const uint8_t *down = src + (size_t)(y + 1 < h ? y + 1 : h - 2) * w;
+    uint8_t c = row[x];
+    uint8_t h2 = avg2(row[xl], row[xr]);
+    uint8_t v2 = avg2(up[x], down[x]);
+    uint8_t cross = avg2(h2, v2);
+    uint8_t diag = avg2(avg2(up[xl], up[xr]), avg2(down[xl], down[xr]));
+    bool red_row = (int)(y & 1) == r_y;
+    bool site = (int)(x & 1) == (red_row ? r_x : 1 - r_x); // the row's own colour, not green
+    uint8_t own = site ? c : h2;
+    uint8_t other = site ? diag : v2;
+    out[0] = red_row ? own : other;
+    out[1] = site ? cross : c;
+    out[2] = red_row ? other : own;
+}
+
+static void bayer8_rgb8_scalar(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h, int r_x, int r_y)
+{
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+            bayer_pixel(src, w, h, x, y, r_x, r_y, dst + ((size_t)y * w + x) * 3);
+    }
+}
+
+static inline uint8_t bayer_mono_pixel(const uint8_t *src, uint32_t w, uint32_t h, uint32_t x, uint32_t y)
+{
+    uint32_t x1 = x + 1 < w ? x + 1 : x - 1;
+    const uint8_t *row = src + (size_t)y * w;
+    const uint8_t *next = src + (size_t)(y + 1 < h ? y + 1 : y - 1) * w;
+    return avg2(avg2(row[x], row[x1]), avg2(next[x], next[x1]));
+}
+
+static void bayer8_mono8_scalar(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+            dst[(size_t)y * w + x] = bayer_mono_pixel(src, w, h, x, y);
+    }
+}
+
+static void bin2_8_scalar(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    uint32_t w2 = w / 2;
+    for (uint32_t y = 0; y < h / 2; y++)
+    {
+        const uint8_t *r0 = src + (size_t)2 * y * w;
+        const uint8_t *r1 = r0 + w;
+        uint8_t *out = dst + (size_t)y * w2;
+        for (uint32_t x = 0; x < w2; x++)
+            out[x] = avg2(avg2(r0[2 * x], r1[2 * x]), avg2(r0[2 * x + 1], r1[2 * x + 1]));
+    }
+}
+
+static const PixelKernels kernels_scalar = {
+    "scalar",
+    unpack10p_scalar,
+    unpack12p_scalar,
+    unpack12packed_scalar,
+    shift16to8_scalar,
+    bayer8_rgb8_scalar,
+    bayer8_mono8_scalar,
+    bin2_8_scalar,
+};
+
+#ifdef PIXEL_X86
+
+// ---------------------------------------------------------------- SSSE3
+
+// word i of a 16-byte load: bytes b_i, b_i + 1 of the packed input
+alignas(16) static const uint8_t shuf_10p[16] = {0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9};
+alignas(16) static const uint16_t mul_10p[8] = {64, 16, 4, 1, 64, 16, 4, 1}; // left by 6 - bit offset, then right by 6
+alignas(16) static const uint8_t shuf_12p[16] = {0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11};
+alignas(16) static const uint16_t mul_12p[8] = {16, 1, 16, 1, 16, 1, 16, 1};
+alignas(16) static const uint8_t shuf_12packed[16] = {1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11};
+alignas(16) static const uint16_t hi_12packed[8] = {0x0ff0, 0xffff, 0x0ff0, 0xffff, 0x0ff0, 0xffff, 0x0ff0, 0xffff};
+alignas(16) static const uint16_t lo_12packed[8] = {0x000f, 0, 0x000f, 0, 0x000f, 0, 0x000f, 0};
+alignas(16) static const uint8_t even_lanes[16] = {0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0};
+
+// RGB interleave: output chunk j takes channel c's byte (16j + i) / 3 where (16j + i) % 3 == c
+struct RGBShuffles
+{
+    alignas(16) uint8_t m[3][3][16];
+
+    RGBShuffles()
+    {
+        for (int j = 0; j < 3; j++)
+            for (int c = 0; c < 3; c++)
+                for (int i = 0; i < 16; i++)
+                    m[j][c][i] = (16 * j + i) % 3 == c ? (16 * j + i) / 3 : 0x80;
+    }
+};
+
+static const RGBShuffles rgb_shuffles;
+
+__attribute__((target("ssse3"))) static inline __m128i unpack_mul(__m128i in, __m128i shuf, __m128i mul, int right)
+{
+    __m128i w = _mm_shuffle_epi8(in, shuf);
+    return _mm_srli_epi16(_mm_mullo_epi16(w, mul), right);
+}
+
+__attribute__((target("ssse3"))) static void unpack10p_ssse3(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 10 + 7) / 8;
+    __m128i shuf = _mm_load_si128((const __m128i *)shuf_10p);
+    __m128i mul = _mm_load_si128((const __m128i *)mul_10p);
+    size_t i = 0;
+    for (; i + 8 <= n && i / 8 * 10 + 16 <= nbytes; i += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(s + i / 8 * 10));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, shuf), mul), 6));
+    }
+    unpack10p_scalar(s + i / 8 * 10, d + i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void unpack12p_ssse3(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 12 + 7) / 8;
+    __m128i shuf = _mm_load_si128((const __m128i *)shuf_12p);
+    __m128i mul = _mm_load_si128((const __m128i *)mul_12p);
+    size_t i = 0;
+    for (; i + 8 <= n && i / 8 * 12 + 16 <= nbytes; i += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(s + i / 8 * 12));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, shuf), mul), 4));
+    }
+    unpack12p_scalar(s + i / 8 * 12, d + i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void unpack12packed_ssse3(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 12 + 7) / 8;
+    __m128i shuf = _mm_load_si128((const __m128i *)shuf_12packed);
+    __m128i hi = _mm_load_si128((const __m128i *)hi_12packed);
+    __m128i lo = _mm_load_si128((const __m128i *)lo_12packed);
+    size_t i = 0;
+    for (; i + 8 <= n && i / 8 * 12 + 16 <= nbytes; i += 8)
+    {
+        __m128i w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + i / 8 * 12)), shuf);
+        __m128i v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(w, 4), hi), _mm_and_si128(w, lo));
+        _mm_storeu_si128((__m128i *)(d + i), v);
+    }
+    unpack12packed_scalar(s + i / 8 * 12, d + i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void shift16to8_ssse3(const uint16_t *s, uint8_t *d, size_t n, int shift)
+{
+    __m128i count = _mm_cvtsi32_si128(shift);
+    __m128i max = _mm_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        // packus saturates signed words; clamp first so 0x8000 and up give 255, not 0
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(s + i)), count);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(s + i + 8)), count);
+        a = _mm_sub_epi16(a, _mm_subs_epu16(a, max));
+        b = _mm_sub_epi16(b, _mm_subs_epu16(b, max));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(a, b));
+    }
+    shift16to8_scalar(s + i, d + i, n - i, shift);
+}
+
+__attribute__((target("ssse3"))) static inline __m128i select128(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+__attribute__((target("ssse3"))) static inline void store_rgb128(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_load_si128((const __m128i *)rgb_shuffles.m[j][0])),
+                                              _mm_shuffle_epi8(g, _mm_load_si128((const __m128i *)rgb_shuffles.m[j][1]))),
+                                 _mm_shuffle_epi8(b, _mm_load_si128((const __m128i *)rgb_shuffles.m[j][2])));
+        _mm_storeu_si128((__m128i *)(dst + 16 * j), v);
+    }
+}
+
+/**
+ * @brief 16 pixels of an interior row, x >= 1 and x + 16 < w.
+ *
+ */
+__attribute__((target("ssse3"))) static inline void bayer_rgb16_ssse3(const uint8_t *up, const uint8_t *row, const uint8_t *down, uint32_t x, __m128i site, bool red_row, uint8_t *out)
+{
+    __m128i c = _mm_loadu_si128((const __m128i *)(row + x));
+    __m128i h2 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(row + x - 1)), _mm_loadu_si128((const __m128i *)(row + x + 1)));
+    __m128i v2 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(up + x)), _mm_loadu_si128((const __m128i *)(down + x)));
+    __m128i cross = _mm_avg_epu8(h2, v2);
+    __m128i diag = _mm_avg_epu8(_mm_avg_epu8(_mm_loadu_si128((const __m128i *)(up + x - 1)), _mm_loadu_si128((const __m128i *)(up + x + 1))),
+                                _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(down + x - 1)), _mm_loadu_si128((const __m128i *)(down + x + 1))));
+    __m128i own = select128(site, c, h2);
+    __m128i other = select128(site, diag, v2);
+    __m128i g = select128(site, cross, c);
+    if (red_row)
+        store_rgb128(out, own, g, other);
+    else
+        store_rgb128(out, other, g, own);
+}
+
+__attribute__((target("ssse3"))) static void bayer8_rgb8_ssse3(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h, int r_x, int r_y)
+{
+    __m128i even = _mm_load_si128((const __m128i *)even_lanes);
+    for (uint32_t y = 0; y < h; y++)
+    {
+        uint8_t *out = dst + (size_t)y * w * 3;
+        uint32_t x = 0;
+        if (y > 0 && y + 1 < h && w >= 18)
+        {
+            const uint8_t *row = src + (size_t)y * w;
+            bool red_row = (int)(y & 1) == r_y;
+            int phase = red_row ? r_x : 1 - r_x;
+            bayer_pixel(src, w, h, 0, y, r_x, r_y, out);
+            // lane i is pixel x + i with x odd: site lanes are the even ones when phase is odd
+            __m128i site = phase == 1 ? even : _mm_xor_si128(even, _mm_set1_epi8(-1));
+            for (x = 1; x + 17 <= w; x += 16)
+                bayer_rgb16_ssse3(row - w, row, row + w, x, site, red_row, out + (size_t)x * 3);
+        }
+        for (; x < w; x++)
+            bayer_pixel(src, w, h, x, y, r_x, r_y, out + (size_t)x * 3);
+    }
+}
+
+__attribute__((target("ssse3"))) static void bayer8_mono8_ssse3(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    for (uint32_t y = 0; y < h; y++)
+    {
+        uint32_t x = 0;
+        if (y + 1 < h)
+        {
+            const uint8_t *row = src + (size_t)y * w;
+            const uint8_t *next = row + w;
+            for (; x + 17 <= w; x += 16)
+            {
+                __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(row + x)), _mm_loadu_si128((const __m128i *)(row + x + 1)));
+                __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(next + x)), _mm_loadu_si128((const __m128i *)(next + x + 1)));
+                _mm_storeu_si128((__m128i *)(dst + (size_t)y * w + x), _mm_avg_epu8(a, b));
+            }
+        }
+        for (; x < w; x++)
+            dst[(size_t)y * w + x] = bayer_mono_pixel(src, w, h, x, y);
+    }
+}
+
+__attribute__((target("ssse3"))) static void bin2_8_ssse3(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    uint32_t w2 = w / 2;
+    __m128i lo = _mm_set1_epi16(0x00ff);
+    for (uint32_t y = 0; y < h / 2; y++)
+    {
+        const uint8_t *r0 = src + (size_t)2 * y * w;
+        const uint8_t *r1 = r0 + w;
+        uint8_t *out = dst + (size_t)y * w2;
+        uint32_t x = 0;
+        for (; x + 16 <= w2; x += 16)
+        {
+            // rows first, then even and odd columns as words, as the scalar kernel does
+            __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(r0 + 2 * x)), _mm_loadu_si128((const __m128i *)(r1 + 2 * x)));
+            __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(r0 + 2 * x + 16)), _mm_loadu_si128((const __m128i *)(r1 + 2 * x + 16)));
+            a = _mm_avg_epu16(_mm_and_si128(a, lo), _mm_srli_epi16(a, 8));
+            b = _mm_avg_epu16(_mm_and_si128(b, lo), _mm_srli_epi16(b, 8));
+            _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(a, b));
+        }
+        for (; x < w2; x++)
+            out[x] = avg2(avg2(r0[2 * x], r1[2 * x]), avg2(r0[2 * x + 1], r1[2 * x + 1]));
+    }
+}
+
+static const PixelKernels kernels_ssse3 = {
+    "ssse3",
+    unpack10p_ssse3,
+    unpack12p_ssse3,
+    unpack12packed_ssse3,
+    shift16to8_ssse3,
+    bayer8_rgb8_ssse3,
+    bayer8_mono8_ssse3,
+    bin2_8_ssse3,
+};
+
+// ---------------------------------------------------------------- AVX2
+
+// two packed groups, one per 128-bit lane (pshufb does not cross lanes)
+__attribute__((target("avx2"))) static inline __m256i load_groups(const uint8_t *s, size_t stride)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)), _mm_loadu_si128((const __m128i *)(s + stride)), 1);
+}
+
+__attribute__((target("avx2"))) static void unpack10p_avx2(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 10 + 7) / 8;
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_10p));
+    __m256i mul = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_10p));
+    size_t i = 0;
+    for (; i + 16 <= n && i / 16 * 20 + 26 <= nbytes; i += 16)
+    {
+        __m256i w = _mm256_shuffle_epi8(load_groups(s + i / 16 * 20, 10), shuf);
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_srli_epi16(_mm256_mullo_epi16(w, mul), 6));
+    }
+    unpack10p_ssse3(s + i / 16 * 20, d + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void unpack12p_avx2(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 12 + 7) / 8;
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_12p));
+    __m256i mul = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_12p));
+    size_t i = 0;
+    for (; i + 16 <= n && i / 16 * 24 + 28 <= nbytes; i += 16)
+    {
+        __m256i w = _mm256_shuffle_epi8(load_groups(s + i / 16 * 24, 12), shuf);
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_srli_epi16(_mm256_mullo_epi16(w, mul), 4));
+    }
+    unpack12p_ssse3(s + i / 16 * 24, d + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void unpack12packed_avx2(const uint8_t *s, uint16_t *d, size_t n)
+{
+    size_t nbytes = (n * 12 + 7) / 8;
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_12packed));
+    __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)hi_12packed));
+    __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)lo_12packed));
+    size_t i = 0;
+    for (; i + 16 <= n && i / 16 * 24 + 28 <= nbytes; i += 16)
+    {
+        __m256i w = _mm256_shuffle_epi8(load_groups(s + i / 16 * 24, 12), shuf);
+        __m256i v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(w, 4), hi), _mm256_and_si256(w, lo));
+        _mm256_storeu_si256((__m256i *)(d + i), v);
+    }
+    unpack12packed_ssse3(s + i / 16 * 24, d + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void shift16to8_avx2(const uint16_t *s, uint8_t *d, size_t n, int shift)
+{
+    __m128i count = _mm_cvtsi32_si128(shift);
+    __m256i max = _mm256_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_min_epu16(_mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(s + i)), count), max);
+        __m256i b = _mm256_min_epu16(_mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(s + i + 16)), count), max);
+        // packus interleaves the lanes: put the quadwords back in order
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    shift16to8_ssse3(s + i, d + i, n - i, shift);
+}
+
+__attribute__((target("avx2"))) static inline __m256i select256(__m256i mask, __m256i a, __m256i b)
+{
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+__attribute__((target("avx2"))) static void bayer8_rgb8_avx2(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h, int r_x, int r_y)
+{
+    __m256i even = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)even_lanes));
+    for (uint32_t y = 0; y < h; y++)
+    {
+        uint8_t *out = dst + (size_t)y * w * 3;
+        uint32_t x = 0;
+        if (y > 0 && y + 1 < h && w >= 34)
+        {
+            const uint8_t *row = src + (size_t)y * w;
+            const uint8_t *up = row - w;
+            const uint8_t *down = row + w;
+            bool red_row = (int)(y & 1) == r_y;
+            int phase = red_row ? r_x : 1 - r_x;
+            bayer_pixel(src, w, h, 0, y, r_x, r_y, out);
+            __m256i site = phase == 1 ? even : _mm256_xor_si256(even, _mm256_set1_epi8(-1));
+            for (x = 1; x + 33 <= w; x += 32)
+            {
+                __m256i c = _mm256_loadu_si256((const __m256i *)(row + x));
+                __m256i h2 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(row + x - 1)), _mm256_loadu_si256((const __m256i *)(row + x + 1)));
+                __m256i v2 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(up + x)), _mm256_loadu_si256((const __m256i *)(down + x)));
+                __m256i cross = _mm256_avg_epu8(h2, v2);
+                __m256i diag = _mm256_avg_epu8(_mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(up + x - 1)), _mm256_loadu_si256((const __m256i *)(up + x + 1))),
+                                               _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(down + x - 1)), _mm256_loadu_si256((const __m256i *)(down + x + 1))));
+                __m256i own = select256(site, c, h2);
+                __m256i other = select256(site, diag, v2);
+                __m256i g = select256(site, cross, c);
+                __m256i r = red_row ? own : other;
+                __m256i b = red_row ? other : own;
+                uint8_t *o = out + (size_t)x * 3;
+                store_rgb128(o, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+                store_rgb128(o + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1));
+            }
+        }
+        for (; x < w; x++)
+            bayer_pixel(src, w, h, x, y, r_x, r_y, out + (size_t)x * 3);
+    }
+}
+
+__attribute__((target("avx2"))) static void bayer8_mono8_avx2(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    for (uint32_t y = 0; y < h; y++)
+    {
+        uint32_t x = 0;
+        if (y + 1 < h)
+        {
+            const uint8_t *row = src + (size_t)y * w;
+            const uint8_t *next = row + w;
+            for (; x + 33 <= w; x += 32)
+            {
+                __m256i a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(row + x)), _mm256_loadu_si256((const __m256i *)(row + x + 1)));
+                __m256i b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(next + x)), _mm256_loadu_si256((const __m256i *)(next + x + 1)));
+                _mm256_storeu_si256((__m256i *)(dst + (size_t)y * w + x), _mm256_avg_epu8(a, b));
+            }
+        }
+        for (; x < w; x++)
+            dst[(size_t)y * w + x] = bayer_mono_pixel(src, w, h, x, y);
+    }
+}
+
+__attribute__((target("avx2"))) static void bin2_8_avx2(const uint8_t *src, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    uint32_t w2 = w / 2;
+    __m256i lo = _mm256_set1_epi16(0x00ff);
+    for (uint32_t y = 0; y < h / 2; y++)
+    {
+        const uint8_t *r0 = src + (size_t)2 * y * w;
+        const uint8_t *r1 = r0 + w;
+        uint8_t *out = dst + (size_t)y * w2;
+        uint32_t x = 0;
+        for (; x + 32 <= w2; x += 32)
+        {
+            __m256i a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(r0 + 2 * x)), _mm256_loadu_si256((const __m256i *)(r1 + 2 * x)));
+            __m256i b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(r0 + 2 * x + 32)), _mm256_loadu_si256((const __m256i *)(r1 + 2 * x + 32)));
+            a = _mm256_avg_epu16(_mm256_and_si256(a, lo), _mm256_srli_epi16(a, 8));
+            b = _mm256_avg_epu16(_mm256_and_si256(b, lo), _mm256_srli_epi16(b, 8));
+            _mm256_storeu_si256((__m256i *)(out + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+        }
+        for (; x < w2; x++)
+            out[x] = avg2(avg2(r0[2 * x], r1[2 * x]), avg2(r0[2 * x + 1], r1[2 * x + 1]));
+    }
+}
+
+static const PixelKernels kernels_avx2 = {
+    "avx2",
+    unpack10p_avx2,
+    unpack12p_avx2,
+    unpack12packed_avx2,
+    shift16to8_avx2,
+    bayer8_rgb8_avx2,
+    bayer8_mono8_avx2,
+    bin2_8_avx2,
+};
+
+#endif // PIXEL_X86
+
+const PixelKernels *pixel_kernels_for(const char *isa)
+{
+    if (strcmp(isa, "scalar") == 0)
+        return &kernels_scalar;
+#ifdef PIXEL_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "ssse3") == 0 && __builtin_cpu_supports("ssse3"))
+        return &kernels_ssse3;
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &kernels_avx2;
+#endif
+    return nullptr;
+}
+
+const PixelKernels &pixel_kernels()
+{
+    static const PixelKernels *best = []()
+    {
+        for (const char *isa : {"avx2", "ssse3"})
+        {
+            const PixelKernels *k = pixel_kernels_for(isa);
+            if (k != nullptr)
+                return k;
+        }
+        return &kernels_scalar;
+    }();
+    return *best;
+}
+
+void lut16to8(const uint16_t *src, uint8_t *dst, size_t n, const uint8_t *lut, uint16_t mask)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = lut[src[i] & mask];
+}
+
+// ---------------------------------------------------------------- conversion
+
+static const char *pixel_output_names[PIXOUT_COUNT] = {"raw", "mono16", "mono8", "mono8_gamma", "rgb8", "preview"};
+
+const char *pixel_output_name(PixelOutput out)
+{
+    return out < PIXOUT_COUNT ? pixel_output_names[out] : "unknown";
+}
+
+bool pixel_output_from_name(const char *name, PixelOutput &out)
+{
+    for (uint32_t i = 0; i < PIXOUT_COUNT; i++)
+    {
+        if (strcmp(name, pixel_output_names[i]) == 0)
+        {
+            out = (PixelOutput)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+enum InputKind
+{
+    IN_MONO8,
+    IN_MONO16, // one word per pixel, `bits` significant
+    IN_MONO10P,
+    IN_MONO12P,
+    IN_MONO12PACKED,
+    IN_BAYER8,
+    IN_BAYER16,
+    IN_OTHER,
+};
+
+struct InputFormat
+{
+    InputKind kind;
+    int bits;     // significant bits per pixel
+    int r_x, r_y; // Bayer: position of red in the 2x2 tile
+};
+
+static InputFormat input_format(uint32_t code)
+{
+    switch (code)
+    {
+    case PIXFMT_MONO8:
+        return {IN_MONO8, 8, 0, 0};
+    case PIXFMT_MONO10:
+        return {IN_MONO16, 10, 0, 0};
+    case PIXFMT_MONO12:
+        return {IN_MONO16, 12, 0, 0};
+    case PIXFMT_MONO14:
+        return {IN_MONO16, 14, 0, 0};
+    case PIXFMT_MONO16:
+        return {IN_MONO16, 16, 0, 0};
+    case PIXFMT_MONO10P:
+        return {IN_MONO10P, 10, 0, 0};
+    case PIXFMT_MONO12P:
+        return {IN_MONO12P, 12, 0, 0};
+    case PIXFMT_MONO12PACKED:
+        return {IN_MONO12PACKED, 12, 0, 0};
+    case PIXFMT_BAYERRG8:
+        return {IN_BAYER8, 8, 0, 0};
+    case PIXFMT_BAYERGR8:
+        return {IN_BAYER8, 8, 1, 0};
+    case PIXFMT_BAYERGB8:
+        return {IN_BAYER8, 8, 0, 1};
+    case PIXFMT_BAYERBG8:
+        return {IN_BAYER8, 8, 1, 1};
+    case PIXFMT_BAYERRG12:
+        return {IN_BAYER16, 12, 0, 0};
+    case PIXFMT_BAYERGR12:
+        return {IN_BAYER16, 12, 1, 0};
+    case PIXFMT_BAYERGB12:
+        return {IN_BAYER16, 12, 0, 1};
+    case PIXFMT_BAYERBG12:
+        return {IN_BAYER16, 12, 1, 1};
+    default:
+        return {IN_OTHER, 0, 0, 0};
+    }
+}
+
+/**
+ * @brief Gamma 1/2.2 table from `bits` significant bits to 8 bits.
+ *
+ */
+static const uint8_t *gamma_lut(int bits)
+{
+    static std::vector<uint8_t> luts[17];
+    static bool ready = []()
+    {
+        for (int b : {8, 10, 12, 14, 16})
+        {
+            uint32_t n = 1u << b;
+            luts[b].resize(n);
+            for (uint32_t i = 0; i < n; i++)
+                luts[b][i] = (uint8_t)lround(255.0 * pow((double)i / (n - 1), 1 / 2.2));
+        }
+        return true;
+    }();
+    (void)ready;
+    return luts[bits].data();
+}
+
+bool pixel_convert(PixelOutput out, FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap)
+{
+    InputFormat in = input_format(hdr.pixel_format);
+    uint32_t w = hdr.width, h = hdr.height;
+    size_t npx = (size_t)w * h;
+    if (in.kind == IN_OTHER || npx == 0 || hdr.truncated)
+        return false;
+    if (hdr.size < (npx * pixel_format_bits(hdr.pixel_format) + 7) / 8)
+        return false; // short frame, nothing to convert safely
+    const PixelKernels &k = pixel_kernels();
+    // intermediate for two-pass conversions, reused per thread
+    thread_local std::vector<uint16_t> words;
+    thread_local std::vector<uint8_t> bytes;
+
+    // first pass: packed mono to one word per pixel
+    const uint16_t *unpacked = (in.kind == IN_MONO16 || in.kind == IN_BAYER16) ? (const uint16_t *)src : nullptr;
+    auto unpack = [&](uint16_t *to)
+    {
+        if (in.kind == IN_MONO10P)
+            k.unpack10p(src, to, npx);
+        else if (in.kind == IN_MONO12P)
+            k.unpack12p(src, to, npx);
+        else
+            k.unpack12packed(src, to, npx);
+    };
+    bool packed = in.kind == IN_MONO10P || in.kind == IN_MONO12P || in.kind == IN_MONO12PACKED;
+
+    switch (out)
+    {
+    case PIXOUT_MONO16:
+        if (!packed || cap < npx * 2)
+            return false;
+        unpack((uint16_t *)dst);
+        hdr.pixel_format = in.bits == 10 ? PIXFMT_MONO10 : PIXFMT_MONO12;
+        hdr.size = npx * 2;
+        return true;
+    case PIXOUT_MONO8:
+    case PIXOUT_MONO8_GAMMA:
+    {
+        if (cap < npx || (in.kind == IN_MONO8 && out == PIXOUT_MONO8))
+            return false;
+        if ((in.kind == IN_BAYER8 || in.kind == IN_BAYER16) && (w < 2 || h < 2))
+            return false; // no 2x2 neighbourhood to average
+        if (packed)
+        {
+            words.resize(npx);
+            unpack(words.data());
+            unpacked = words.data();
+        }
+        if (in.kind == IN_BAYER8 || in.kind == IN_BAYER16)
+        {
+            const uint8_t *bayer = src;
+            if (in.kind == IN_BAYER16)
+            {
+                bytes.resize(npx);
+                k.shift16to8(unpacked, bytes.data(), npx, in.bits - 8);
+                bayer = bytes.data();
+            }
+            k.bayer8_mono8(bayer, dst, w, h);
+            if (out == PIXOUT_MONO8_GAMMA)
+            {
+                const uint8_t *lut = gamma_lut(8);
+                for (size_t i = 0; i < npx; i++)
+                    dst[i] = lut[dst[i]];
+            }
+        }
+        else if (in.kind == IN_MONO8)
+        {
+            const uint8_t *lut = gamma_lut(8);
+            for (size_t i = 0; i < npx; i++)
+                dst[i] = lut[src[i]];
+        }
+        else if (out == PIXOUT_MONO8_GAMMA)
+        {
+            lut16to8(unpacked, dst, npx, gamma_lut(in.bits), (uint16_t)((1u << in.bits) - 1));
+        }
+        else
+        {
+            k.shift16to8(unpacked, dst, npx, in.bits - 8);
+        }
+        hdr.pixel_format = PIXFMT_MONO8;
+        hdr.size = npx;
+        return true;
+    }
+    case PIXOUT_RGB8:
+    {
+        if ((in.kind != IN_BAYER8 && in.kind != IN_BAYER16) || w < 2 || h < 2 || cap < npx * 3)
+            return false;
+        const uint8_t *bayer = src;
+        if (in.kind == IN_BAYER16)
+        {
+            bytes.resize(npx);
+            k.shift16to8(unpacked, bytes.data(), npx, in.bits - 8);
+            bayer = bytes.data();
+        }
+        k.bayer8_rgb8(bayer, dst, w, h, in.r_x, in.r_y);
+        hdr.pixel_format = PIXFMT_RGB8;
+        hdr.size = npx * 3;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool pixel_preview(const PreviewSettings &settings, FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap)
+{
+    uint32_t f = settings.factor;
+    if (f != 1 && f != 2 && f != 4 && f != 8)
+        return false;
+    uint32_t w = hdr.width, h = hdr.height;
+    uint32_t pw = w / f, ph = h / f;
+    if (pw == 0 || ph == 0 || cap < (size_t)pw * ph)
+        return false;
+    // full resolution 8-bit mono first, then reduce
+    thread_local std::vector<uint8_t> mono, half;
+    const uint8_t *m = src;
+    if (hdr.pixel_format != PIXFMT_MONO8)
+    {
+        FrameHeader full = hdr;
+        mono.resize((size_t)w * h);
+        if (!pixel_convert(PIXOUT_MONO8, full, src, mono.data(), mono.size()))
+            return false;
+        m = mono.data();
+    }
+    else if (hdr.truncated || hdr.size < (size_t)w * h)
+    {
+        return false;
+    }
+    if (f == 1)
+    {
+        memcpy(dst, m, (size_t)w * h);
+    }
+    else if (settings.decimate)
+    {
+        for (uint32_t y = 0; y < ph; y++)
+        {
+            const uint8_t *row = m + (size_t)y * f * w;
+            uint8_t *out = dst + (size_t)y * pw;
+            for (uint32_t x = 0; x < pw; x++)
+                out[x] = row[(size_t)x * f];
+        }
+    }
+    else
+    {
+        const PixelKernels &k = pixel_kernels();
+        // crop to whole blocks so every stage halves exactly
+        uint32_t cw = pw * f, ch = ph * f;
+        if (cw != w)
+        {
+            half.resize((size_t)cw * ch);
+            for (uint32_t y = 0; y < ch; y++)
+                memcpy(half.data() + (size_t)y * cw, m + (size_t)y * w, cw);
+            m = half.data();
+        }
+        for (; f > 2; f /= 2, cw /= 2, ch /= 2)
+        {
+            // ping-pong between the two scratch buffers, never resizing the one being read
+            std::vector<uint8_t> &next = m == mono.data() ? half : mono;
+            next.resize((size_t)(cw / 2) * (ch / 2));
+            uint8_t *to = next.data();
+            k.bin2_8(m, to, cw, ch);
+            m = to;
+        }
+        k.bin2_8(m, dst, cw, ch);
+    }
+    hdr.width = pw;
+    hdr.height = ph;
+    hdr.pixel_format = PIXFMT_MONO8;
+    hdr.size = pw * ph;
+    return true;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file pixelconvert.hpp
+ * @brief Server-side pixel conversion: packed mono unpacking, 16-to-8-bit reduction and Bayer demosaicing.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Kernels exist in scalar, SSSE3 and AVX2 versions with identical output;
+ * the fastest one the CPU supports is chosen at first use. A consumer asks
+ * for a PixelOutput and pixel_convert() gets there from whatever format the
+ * camera delivers, in one or two kernel passes. Conversions that do not apply
+ * to a format (e.g. RGB8 from a mono camera) are refused, and the consumer
+ * falls back to the raw frame.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "framering.hpp"
+
+/**
+ * @brief What a consumer wants to receive.
+ *
+ */
+enum PixelOutput : uint32_t
+{
+    PIXOUT_RAW = 0,         // as delivered by the camera
+    PIXOUT_MONO16 = 1,      // packed mono unpacked to one 16-bit word per pixel (Mono10/Mono12)
+    PIXOUT_MONO8 = 2,       // mono or Bayer reduced to 8 bits by shifting out the low bits; Bayer is averaged over 2x2
+    PIXOUT_MONO8_GAMMA = 3, // as PIXOUT_MONO8 through a gamma 1/2.2 table, for display
+    PIXOUT_RGB8 = 4,        // Bayer demosaiced (bilinear) to RGB8
+    PIXOUT_PREVIEW = 5,     // reduced 8-bit mono at a capped rate, see pixel_preview()
+    PIXOUT_COUNT
+};
+
+/**
+ * @brief One implementation of every kernel. Sizes in pixels; src and dst never overlap.
+ *
+ */
+struct PixelKernels
+{
+    const char *isa; // "scalar", "ssse3" or "avx2"
+    void (*unpack10p)(const uint8_t *src, uint16_t *dst, size_t n);      // Mono10p, LSB-first
+    void (*unpack12p)(const uint8_t *src, uint16_t *dst, size_t n);      // Mono12p, LSB-first
+    void (*unpack12packed)(const uint8_t *src, uint16_t *dst, size_t n); // GigE Vision Mono12Packed
+    void (*shift16to8)(const uint16_t *src, uint8_t *dst, size_t n, int shift);
+    // bilinear; (r_x, r_y) is the position of red in the 2x2 Bayer tile
+    void (*bayer8_rgb8)(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height, int r_x, int r_y);
+    // each pixel the mean of its 2x2 neighbourhood, i.e. (R + 2G + B) / 4
+    void (*bayer8_mono8)(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height);
+    // mean of each 2x2 block; dst is width / 2 x height / 2, odd edges dropped
+    void (*bin2_8)(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height);
+};
+
+/**
+ * @brief Kernels for this CPU, chosen once.
+ *
+ */
+const PixelKernels &pixel_kernels();
+
+/**
+ * @brief Kernels for one instruction set, nullptr if unknown or not supported by this CPU.
+ *
+ */
+const PixelKernels *pixel_kernels_for(const char *isa);
+
+/**
+ * @brief 8-bit lookup through a table indexed by a 16-bit value masked to bits significant bits. Scalar on every CPU; gathers do not beat it.
+ *
+ */
+void lut16to8(const uint16_t *src, uint8_t *dst, size_t n, const uint8_t *lut, uint16_t mask);
+
+const char *pixel_output_name(PixelOutput out);
+
+/**
+ * @brief Output by name ("raw", "mono16", "mono8", "mono8_gamma", "rgb8", "preview").
+ *
+ * @return false if unknown.
+ */
+bool pixel_output_from_name(const char *name, PixelOutput &out);
+
+/**
+ * @brief Largest frame a conversion can produce from a width x height image.
+ *
+ */
+static inline size_t pixel_output_max_size(uint32_t width, uint32_t height)
+{
+    return (size_t)width * height * 3; // RGB8
+}
+
+/**
+ * @brief Convert one frame.
+ *
+ * @param out Wanted output; PIXOUT_RAW and PIXOUT_PREVIEW are refused.
+ * @param hdr Frame description; on success pixel_format and size describe dst.
+ * @param src Pixel data as hdr describes it.
+ * @param dst Receives the converted pixels.
+ * @param cap Size of dst.
+ * @return false if the conversion does not apply to this pixel format or dst is too small; hdr is then unchanged.
+ */
+bool pixel_convert(PixelOutput out, FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap);
+
+/**
+ * @brief Make a preview: the frame as 8-bit mono (Bayer averaged over 2x2), reduced by settings.factor.
+ *
+ * Binning repeats the 2x2 kernel, so 4x4 and 8x8 average in stages; decimation keeps the top left pixel of each block.
+ *
+ * @param hdr Frame description; on success width, height, pixel_format (Mono8) and size describe dst.
+ * @return false if the pixel format has no mono rendering, the factor is not 1, 2, 4 or 8, or dst is too small; hdr is then unchanged.
+ */
+bool pixel_preview(const PreviewSettings &settings, FrameHeader &hdr, const uint8_t *src, uint8_t *dst, size_t cap);
@@ -0,0 +1,97 @@
+/**
+ * @file pixelformat.hpp
+ * @brief GenICam pixel format names and their PFNC codes (VmbPixelFormat_t).
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Bits 16..23 of a code are the storage bits per pixel.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "string_format.hpp"
+
+struct PixelFormatName
+{
+    uint32_t code;
+    const char *name;
+};
+
+#define PIXFMT_MONO8 0x01080001
+#define PIXFMT_MONO10 0x01100003
+#define PIXFMT_MONO10P 0x010A0046
+#define PIXFMT_MONO12 0x01100005
+#define PIXFMT_MONO12P 0x010C0047
+#define PIXFMT_MONO12PACKED 0x010C0006
+#define PIXFMT_MONO14 0x01100025
+#define PIXFMT_MONO16 0x01100007
+#define PIXFMT_BAYERGR8 0x01080008
+#define PIXFMT_BAYERRG8 0x01080009
+#define PIXFMT_BAYERGB8 0x0108000A
+#define PIXFMT_BAYERBG8 0x0108000B
+#define PIXFMT_BAYERGR12 0x01100010
+#define PIXFMT_BAYERRG12 0x01100011
+#define PIXFMT_BAYERGB12 0x01100012
+#define PIXFMT_BAYERBG12 0x01100013
+#define PIXFMT_RGB8 0x02180014
+#define PIXFMT_BGR8 0x02180015
+
+static const PixelFormatName pixel_format_names[] = {
+    {PIXFMT_MONO8, "Mono8"},
+    {PIXFMT_MONO10, "Mono10"},
+    {PIXFMT_MONO10P, "Mono10p"},
+    {PIXFMT_MONO12, "Mono12"},
+    {PIXFMT_MONO12P, "Mono12p"},
+    {PIXFMT_MONO12PACKED, "Mono12Packed"},
+    {PIXFMT_MONO14, "Mono14"},
+    {PIXFMT_MONO16, "Mono16"},
+    {PIXFMT_BAYERGR8, "BayerGR8"},
+    {PIXFMT_BAYERRG8, "BayerRG8"},
+    {PIXFMT_BAYERGB8, "BayerGB8"},
+    {PIXFMT_BAYERBG8, "BayerBG8"},
+    {PIXFMT_BAYERGR12, "BayerGR12"},
+    {PIXFMT_BAYERRG12, "BayerRG12"},
+    {PIXFMT_BAYERGB12, "BayerGB12"},
+    {PIXFMT_BAYERBG12, "BayerBG12"},
+    {PIXFMT_RGB8, "RGB8"},
+    {PIXFMT_BGR8, "BGR8"},
+};
+
+/**
+ * @brief Name of a pixel format, or its hexadecimal code if not a common one.
+ *
+ */
+static inline std::string pixel_format_name(uint32_t code)
+{
+    for (const PixelFormatName &n : pixel_format_names)
+    {
+        if (n.code == code)
+            return n.name;
+    }
+    return string_format("0x%08x", code);
+}
+
+/**
+ * @brief Code of a pixel format name, 0 if unknown.
+ *
+ */
+static inline uint32_t pixel_format_code(const char *name)
+{
+    for (const PixelFormatName &n : pixel_format_names)
+    {
+        if (strcmp(n.name, name) == 0)
+            return n.code;
+    }
+    return 0;
+}
+
+static inline uint32_t pixel_format_bits(uint32_t code)
+{
+    return (code >> 16) & 0xff;
+}
@@ -0,0 +1,323 @@
+#include "playback.hpp"
+#include "capturestats.hpp"
+#include "framecodec.hpp"
+#include "meb_print.h"
+#include "pixelformat.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+// replay pace when the recorded timestamps are unusable
+#define PLAYBACK_DEFAULT_FPS 30.0
+// sleep until this close to a frame's due time, then spin
+#define PLAYBACK_SPIN_NS 100000
+
+PlaybackFile::PlaybackFile(const std::string &path)
+{
+    this->path = path;
+    fps = 0;
+    running = false;
+    delivered = 0;
+    loops = 0;
+    corrupt = 0;
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        dbprintlf(RED_FG "Could not open recording %s: %s", path.c_str(), strerror(errno));
+        throw std::runtime_error("Could not open recording.");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RecFileHeader))
+    {
+        close(fd);
+        dbprintlf(RED_FG "%s is not a recording.", path.c_str());
+        throw std::runtime_error("Not a recording.");
+    }
+    len = st.st_size;
+    map = (uint8_t *)mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        dbprintlf(RED_FG "Could not map recording %s: %s", path.c_str(), strerror(errno));
+        throw std::runtime_error("Could not map recording.");
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+    memcpy(&hdr, map, sizeof(hdr));
+    if (memcmp(hdr.magic, REC_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version < REC_MIN_VERSION || hdr.version > REC_VERSION)
+    {
+        munmap(map, len);
+        close(fd);
+        dbprintlf(RED_FG "%s is not a version %d to %d recording.", path.c_str(), REC_MIN_VERSION, REC_VERSION);
+        throw std::runtime_error("Not a recording.");
+    }
+    hdr.camera_idstr[sizeof(hdr.camera_idstr) - 1] = '\0';
+    load_index();
+    if (index.empty())
+    {
+        munmap(map, len);
+        close(fd);
+        dbprintlf(RED_FG "Recording %s holds no frames.", path.c_str());
+        throw std::runtime_error("Empty recording.");
+    }
+    // recorded pace from the camera timestamps
+    uint64_t t0 = index.front().timestamp;
+    uint64_t t1 = index.back().timestamp;
+    if (index.size() > 1 && t1 > t0)
+        recorded_fps = (index.size() - 1) * 1e9 / (t1 - t0);
+}
+
+PlaybackFile::~PlaybackFile()
+{
+    stop_capture();
+    munmap(map, len);
+    close(fd);
+}
+
+bool PlaybackFile::entry_ok(const RecFrameEntry &e) const
+{
+    // written so that no sum can wrap, whatever the file holds
+    if (e.offset < hdr.header_size || e.offset > len || e.size > len - e.offset)
+        return false;
+    if (e.encoding == FRAME_ENC_RICE && (e.raw_size == 0 || e.raw_size > (uint64_t)e.size * CODEC_MAX_RATIO))
+        return false;
+    return true;
+}
+
+void PlaybackFile::load_index()
+{
+    // entries before version 3 are shorter; the fields they lack stay zero
+    size_t entry_size = hdr.version < 3 ? REC_V2_ENTRY_SIZE : sizeof(RecFrameEntry);
+    if (hdr.index_offset >= hdr.header_size && hdr.index_offset != 0 && hdr.index_offset <= len &&
+        hdr.frames <= (len - hdr.index_offset) / entry_size)
+    {
+        index.resize(hdr.frames);
+        memset(index.data(), 0, hdr.frames * sizeof(RecFrameEntry));
+        for (uint64_t i = 0; i < hdr.frames; i++)
+        {
+            memcpy(&index[i], map + hdr.index_offset + i * entry_size, entry_size);
+            if (!entry_ok(index[i]))
+            {
+                dbprintlf(RED_FG "Recording %s: index entry %llu is damaged, playing the %llu frames before it.",
+                          path.c_str(), (unsigned long long)i, (unsigned long long)i);
+                index.resize(i);
+                break;
+            }
+        }
+    }
+    else
+    {
+        // never closed: walk the records
+        dbprintlf(YELLOW_FG "Recording %s has no index, rebuilding it from the records.", path.c_str());
+        uint64_t off = hdr.header_size;
+        while (off <= len && entry_size <= len - off)
+        {
+            RecFrameEntry e = {};
+            memcpy(&e, map + off, entry_size);
+            if (e.offset == 0 && e.size == 0)
+            {
+                // padding up to the next block
+                off = (off / REC_BLOCK + 1) * REC_BLOCK;
+                continue;
+            }
+            if (e.offset != off + entry_size || !entry_ok(e))
+                break; // torn record at the end
+            index.push_back(e);
+            off = e.offset + ((e.size + REC_ALIGN - 1) & ~((uint64_t)REC_ALIGN - 1));
+        }
+    }
+}
+
+size_t PlaybackFile::max_frame_size() const
+{
+    size_t m = 0;
+    for (const RecFrameEntry &e : index)
+    {
+        size_t n = e.encoding == FRAME_ENC_RAW ? e.size : e.raw_size;
+        if (n > m)
+            m = n;
+    }
+    return m;
+}
+
+double PlaybackFile::framerate() const
+{
+    double f = fps.load(std::memory_order_relaxed);
+    if (f > 0)
+        return f;
+    return recorded_fps > 0 ? recorded_fps : PLAYBACK_DEFAULT_FPS;
+}
+
+VmbError_t PlaybackFile::set_framerate(double fps)
+{
+    if (!(fps >= 0)) // also rejects NaN
+        return VmbErrorInvalidValue;
+    this->fps.store(fps, std::memory_order_relaxed);
+    return VmbErrorSuccess;
+}
+
+VmbError_t PlaybackFile::start_capture(AlliedCaptureCallback callback, void *user_data)
+{
+    if (running)
+        return VmbErrorInvalidCall;
+    this->callback = callback;
+    this->user_data = user_data;
+    decoded.resize(max_frame_size());
+    running = true;
+    thr = std::thread(&PlaybackFile::run, this);
+    return VmbErrorSuccess;
+}
+
+VmbError_t PlaybackFile::stop_capture()
+{
+    running = false;
+    if (thr.joinable())
+        thr.join();
+    return VmbErrorSuccess;
+}
+
+void PlaybackFile::run()
+{
+    bool use_timestamps = recorded_fps > 0;
+    uint64_t start = mono_ns();
+    uint64_t due = start;
+    size_t i = 0;
+    while (running)
+    {
+        const RecFrameEntry &e = index[i];
+        // let the kernel read the next frame in while this one is delivered
+        size_t ahead = i + 1 < index.size() ? i + 1 : 0;
+        uintptr_t page = (uintptr_t)(map + index[ahead].offset) & ~((uintptr_t)4095);
+        madvise((void *)page, (uintptr_t)(map + index[ahead].offset + index[ahead].size) - page, MADV_WILLNEED);
+
+        uint64_t now = mono_ns();
+        while (due > now && running)
+        {
+            if (due - now > PLAYBACK_SPIN_NS)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - PLAYBACK_SPIN_NS));
+            now = mono_ns();
+        }
+        if (!running)
+            break;
+
+        VmbFrame_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.buffer = map + e.offset;
+        frame.bufferSize = e.size;
+        if (e.encoding == FRAME_ENC_RICE)
+        {
+            if (FrameCodec::decoded_size(map + e.offset, e.size) == e.raw_size &&
+                frame_codec().decode(map + e.offset, e.size, decoded.data(), e.raw_size))
+            {
+                frame.buffer = decoded.data();
+                frame.bufferSize = e.raw_size;
+            }
+            else
+            {
+                if (corrupt.fetch_add(1, std::memory_order_relaxed) == 0)
+                    dbprintlf(RED_FG "Recording %s: frame %llu does not decode.", path.c_str(), (unsigned long long)e.frame_id);
+                frame.bufferSize = 0;
+            }
+        }
+        else if (e.encoding != FRAME_ENC_RAW)
+        {
+            frame.bufferSize = 0; // written by a newer server
+        }
+        frame.imageData = (uint8_t *)frame.buffer;
+        frame.receiveStatus = frame.bufferSize > 0 ? e.status : VmbFrameStatusInvalid;
+        frame.frameID = e.frame_id;
+        frame.timestamp = e.timestamp;
+        frame.pixelFormat = e.pixel_format;
+        frame.width = e.width;
+        frame.height = e.height;
+        callback(nullptr, nullptr, &frame, user_data);
+        delivered.fetch_add(1, std::memory_order_relaxed);
+
+        size_t next = i + 1;
+        if (next >= index.size())
+        {
+            next = 0;
+            loops.fetch_add(1, std::memory_order_relaxed);
+        }
+        double f = fps.load(std::memory_order_relaxed);
+        if (f > 0 || !use_timestamps || next == 0 || index[next].timestamp <= e.timestamp)
+        {
+            // fixed rate, or no usable gap in the recording (including the wrap)
+            due += (uint64_t)(1e9 / (f > 0 ? f : framerate()));
+        }
+        else
+        {
+            due += index[next].timestamp - e.timestamp;
+        }
+        // never try to catch up on a backlog after a stall
+        now = mono_ns();
+        if (due + 1000000000ULL < now)
+            due = now;
+        i = next;
+    }
+}
+
+VmbError_t PlaybackFile::get_feature(long id, FeatureValue &val)
+{
+    switch (id)
+    {
+    case CommandNames::image_size:
+    case CommandNames::sensor_size:
+        val.type = ValueType::Size;
+        val.i[0] = width();
+        val.i[1] = height();
+        return VmbErrorSuccess;
+    case CommandNames::image_ofst:
+        val.type = ValueType::Size;
+        val.i[0] = val.i[1] = 0;
+        return VmbErrorSuccess;
+    case CommandNames::image_format:
+        val.type = ValueType::Str;
+        strncpy(val.s, pixel_format_name(pixel_format()).c_str(), sizeof(val.s) - 1);
+        val.s[sizeof(val.s) - 1] = '\0';
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate:
+        val.type = ValueType::Dbl;
+        val.d = framerate();
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate_auto:
+        // "auto" replays at the recorded pace
+        val.type = ValueType::Bool;
+        val.b = recorded_pace();
+        return VmbErrorSuccess;
+    default:
+        return VmbErrorNotSupported;
+    }
+}
+
+VmbError_t PlaybackFile::set_feature(long id, const FeatureValue &val)
+{
+    switch (id)
+    {
+    case CommandNames::acq_framerate:
+        return val.d > 0 ? set_framerate(val.d) : VmbErrorInvalidValue;
+    case CommandNames::acq_framerate_auto:
+        return set_framerate(val.b ? 0 : framerate());
+    default:
+        return VmbErrorNotSupported;
+    }
+}
+
+VmbError_t PlaybackFile::geometry(FrameGeometry &geom)
+{
+    geom.width = width();
+    geom.height = height();
+    geom.bits_per_pixel = pixel_format_bits(pixel_format());
+    size_t pixels = (size_t)geom.width * geom.height;
+    if (pixels > 0 && geom.frame_bytes() < max_frame_size())
+    {
+        // whatever the pixel format says, every recorded frame must fit
+        geom.bits_per_pixel = (max_frame_size() * 8 + pixels - 1) / pixels;
+    }
+    return VmbErrorSuccess;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file playback.hpp
+ * @brief Replays a recording (see recording.hpp) as if a camera were delivering it.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The file is memory-mapped read-only; frames are handed to the capture
+ * callback straight out of the mapping, so replay costs page-cache reads and
+ * no per-frame file I/O. A playback thread calls the same callback signature
+ * the SDK uses, either at the recorded pace (camera timestamps, taken to be
+ * nanoseconds) or at a fixed frame rate, and loops at the end of the file.
+ *
+ * As a camera backend it has the geometry and pixel format of the recording;
+ * acq_framerate sets a fixed replay rate and acq_framerate_auto returns to the
+ * recorded pace.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <alliedcam.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camerabackend.hpp"
+#include "recording.hpp"
+
+class PlaybackFile : public CameraBackend
+{
+    std::string path;
+    int fd = -1;
+    uint8_t *map = nullptr;
+    size_t len = 0;
+    RecFileHeader hdr;
+    std::vector<RecFrameEntry> index;
+    double recorded_fps = 0;
+
+    std::atomic<double> fps; // 0 replays at the recorded pace
+    std::atomic<bool> running;
+    std::thread thr;
+    AlliedCaptureCallback callback = nullptr;
+    void *user_data = nullptr;
+    std::vector<uint8_t> decoded; // playback thread: the current frame, if it was recorded compressed
+
+    bool entry_ok(const RecFrameEntry &e) const;
+    void load_index();
+    void run();
+
+public:
+    std::atomic<uint64_t> delivered; // frames handed to the callback
+    std::atomic<uint64_t> loops;     // times playback wrapped to the first frame
+    std::atomic<uint64_t> corrupt;   // compressed frames that did not decode, delivered empty
+
+    /**
+     * @brief Map a recording.
+     *
+     * @throws std::runtime_error if the file cannot be opened or is not a recording with at least one frame.
+     */
+    PlaybackFile(const std::string &path);
+    ~PlaybackFile();
+
+    PlaybackFile(const PlaybackFile &) = delete;
+    PlaybackFile &operator=(const PlaybackFile &) = delete;
+
+    const RecFileHeader &header() const
+    {
+        return hdr;
+    }
+
+    size_t frames() const
+    {
+        return index.size();
+    }
+
+    /**
+     * @brief Geometry of the first frame; a recording does not change geometry.
+     *
+     */
+    uint32_t width() const
+    {
+        return index[0].width;
+    }
+
+    uint32_t height() const
+    {
+        return index[0].height;
+    }
+
+    uint32_t pixel_format() const
+    {
+        return index[0].pixel_format;
+    }
+
+    /**
+     * @brief Largest frame in the recording, in bytes once decoded.
+     *
+     */
+    size_t max_frame_size() const;
+
+    /**
+     * @brief Replay frame rate; the recorded rate while replaying at the recorded pace.
+     *
+     */
+    double framerate() const;
+
+    /**
+     * @brief Replay at a fixed frame rate, or at the recorded pace if fps is 0.
+     *
+     */
+    VmbError_t set_framerate(double fps);
+
+    bool recorded_pace() const
+    {
+        return fps.load(std::memory_order_relaxed) == 0;
+    }
+
+    const char *kind() const
+    {
+        return "playback";
+    }
+
+    VmbError_t get_feature(long id, FeatureValue &value);
+    VmbError_t set_feature(long id, const FeatureValue &value);
+    VmbError_t geometry(FrameGeometry &geom);
+    VmbError_t start_capture(AlliedCaptureCallback callback, void *user_data);
+    VmbError_t stop_capture();
+};
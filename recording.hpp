@@ -0,0 +1,73 @@
+/**
+ * @file recording.hpp
+ * @brief On-disk layout of frame recordings written by FrameRecorder.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A recording is:
+ *
+ *   [RecFileHeader, padded to REC_BLOCK bytes]
+ *   [RecFrameEntry][pixel data, padded to REC_ALIGN] ... one record per frame
+ *   [RecFrameEntry x index_entries]                     the index
+ *
+ * Each record repeats its own index entry, so a recording whose index was
+ * never written (e.g. the server died) can still be recovered by walking the
+ * records from REC_BLOCK. Zero bytes between records (entry.size == 0 and
+ * entry.offset == 0) are padding up to the next REC_BLOCK boundary.
+ *
+ * Version 2 added RecFrameEntry::encoding and raw_size; they are zero in
+ * version 1 files, which are read as raw frames. Version 3 grew the entry to
+ * 128 bytes for the per-frame metadata (host_ns onwards); older files have
+ * REC_V2_ENTRY_SIZE byte entries, and the fields past them read as zero.
+ *
+ * All fields are little-endian.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define REC_MAGIC "ALCAMREC" // 8 bytes, no terminator
+#define REC_VERSION 3
+#define REC_MIN_VERSION 1 // oldest version playback reads
+#define REC_BLOCK 4096 // O_DIRECT alignment of file offsets and write sizes
+#define REC_ALIGN 64   // alignment of every record
+#define REC_V2_ENTRY_SIZE 64 // RecFrameEntry in versions 1 and 2
+
+struct RecFileHeader
+{
+    char magic[8];          // REC_MAGIC
+    uint32_t version;       // REC_VERSION
+    uint32_t header_size;   // REC_BLOCK; the first record starts here
+    char camera_idstr[128]; // camera ID string, NUL-terminated
+    uint64_t start_ns;      // CLOCK_REALTIME at record_start
+    uint64_t frames;        // number of records, 0 until the recording is closed
+    uint64_t index_offset;  // file offset of the index, 0 until the recording is closed
+    uint64_t data_end;      // file offset just past the last record
+    uint8_t reserved[3920]; // zero
+};
+
+struct RecFrameEntry
+{
+    uint64_t offset;       // file offset of the pixel data
+    uint64_t frame_id;     // camera frame ID
+    uint64_t timestamp;    // camera timestamp (ticks)
+    uint32_t size;         // bytes of pixel data as stored
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixel_format; // VmbPixelFormat_t
+    int32_t status;        // VmbFrameStatus_t
+    uint32_t truncated;    // 1 if the frame did not fit the capture buffer
+    uint32_t encoding;     // FrameEncoding of the stored data
+    uint32_t raw_size;     // bytes of pixel data once decoded
+    uint64_t host_ns;      // CLOCK_MONOTONIC at callback entry
+    double exposure_us;    // exposure in effect, 0 if unknown
+    uint32_t flags;        // FrameFlags
+    uint32_t adio_state;   // aDIO port 0, with FRAME_FLAG_ADIO
+    uint8_t reserved[48];  // zero
+};
+
+static_assert(sizeof(RecFileHeader) == REC_BLOCK, "RecFileHeader must fill one block.");
+static_assert(sizeof(RecFrameEntry) == 2 * REC_ALIGN, "RecFrameEntry layout changed.");
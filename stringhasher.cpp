@@ -2,17 +2,29 @@
 
 StringHasher::StringHasher()
 {
+    // fixed xorshift32 sequence: hashes handed to clients must not change across restarts or hosts
+    uint32_t x = 0x1F351F35;
     for (ssize_t i = 0; i < 0x100; i++)
-        state[i] = rand() % 0x100;
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state[i] = x >> 24;
+    }
 }
 
-uint32_t StringHasher::get_hash(std::string str)
+uint32_t StringHasher::get_hash(const char *str) const
 {
     uint32_t h = 0x1F351F35;
-    for (auto &ch : str)
+    for (; *str; str++)
     {
-        h = ((h >> 11) | (h << (32 - 11))) + state[(uint8_t)(ch ^ h)];
+        h = ((h >> 11) | (h << (32 - 11))) + state[(uint8_t)(*str ^ h)];
     }
     h ^= h >> 16;
     return h ^ (h >> 8);
 }
+
+uint32_t StringHasher::get_hash(const std::string &str) const
+{
+    return get_hash(str.c_str());
+}
@@ -11,5 +11,7 @@ private:
 public:
     StringHasher();
 
-    uint32_t get_hash(std::string str);
-};
\ No newline at end of file
+    uint32_t get_hash(const char *str) const;
+
+    uint32_t get_hash(const std::string &str) const;
+};
@@ -0,0 +1,338 @@
+#include "syntheticbackend.hpp"
+#include "capturestats.hpp"
+#include "meb_print.h"
+#include "pixelformat.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <stdexcept>
+
+// sleep until this close to a frame's due time, then spin
+#define SYNTHETIC_SPIN_NS 50000
+// image sizes and offsets move in steps of this many pixels, like most sensors
+#define SYNTHETIC_STEP 8
+
+bool SyntheticConfig::parse(const char *spec, int &count)
+{
+    char *end = nullptr;
+    long n = strtol(spec, &end, 10);
+    if (end == spec || n < 1)
+        return false;
+    count = n;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+    unsigned w = 0, h = 0;
+    int used = 0;
+    if (sscanf(end + 1, "%ux%u%n", &w, &h, &used) != 2 || w < SYNTHETIC_STEP || h < SYNTHETIC_STEP)
+        return false;
+    width = w;
+    height = h;
+    end += 1 + used;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+    fps = strtod(end + 1, &end);
+    if (!(fps >= 0))
+        return false;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+    const char *fmt = end + 1;
+    const char *colon = strchr(fmt, ':');
+    format = colon ? std::string(fmt, colon - fmt) : std::string(fmt);
+    if (pixel_format_code(format.c_str()) == 0)
+        return false;
+    if (colon == nullptr)
+        return true;
+    long lat = strtol(colon + 1, &end, 10);
+    if (end == colon + 1 || *end != '\0' || lat < 0)
+        return false;
+    latency_us = lat;
+    return true;
+}
+
+SyntheticBackend::SyntheticBackend(const SyntheticConfig &cfg)
+{
+    pixel_format = pixel_format_code(cfg.format.c_str());
+    if (pixel_format == 0)
+    {
+        dbprintlf(RED_FG "Unknown pixel format %s.", cfg.format.c_str());
+        throw std::runtime_error("Unknown pixel format.");
+    }
+    sensor_w = width = cfg.width;
+    sensor_h = height = cfg.height;
+    bit_depth = pixel_format_bits(pixel_format) > 8 ? "Bpp12" : "Bpp8";
+    fps_requested = cfg.fps;
+    if (cfg.fps > 0 && 1e6 / cfg.fps < exposure_us)
+        exposure_us = 1e6 / cfg.fps; // the configured rate is reachable
+    throughput = throughput_max;
+    latency_us = cfg.latency_us;
+    running = false;
+    delivered = 0;
+}
+
+SyntheticBackend::~SyntheticBackend()
+{
+    stop_capture();
+}
+
+void SyntheticBackend::simulate_latency() const
+{
+    if (latency_us > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+}
+
+double SyntheticBackend::max_framerate() const
+{
+    double fmax = 1e6 / exposure_us;
+    size_t fbytes = ((size_t)width * height * pixel_format_bits(pixel_format) + 7) / 8;
+    if (fbytes > 0 && (double)throughput / fbytes < fmax)
+        fmax = (double)throughput / fbytes;
+    return fmax;
+}
+
+double SyntheticBackend::framerate() const
+{
+    if (fps_auto)
+        return max_framerate();
+    if (fps_requested == 0)
+        return 0; // free-running
+    double fmax = max_framerate();
+    return fps_requested < fmax ? fps_requested : fmax;
+}
+
+static void set_string(FeatureValue &val, const std::string &str)
+{
+    val.type = ValueType::Str;
+    strncpy(val.s, str.c_str(), sizeof(val.s) - 1);
+    val.s[sizeof(val.s) - 1] = '\0';
+}
+
+static uint32_t clamp_step(int64_t v, uint32_t lo, uint32_t hi)
+{
+    if (v < lo)
+        v = lo;
+    if (v > hi)
+        v = hi;
+    return v - v % SYNTHETIC_STEP;
+}
+
+VmbError_t SyntheticBackend::get_feature(long id, FeatureValue &val)
+{
+    simulate_latency();
+    std::lock_guard<std::mutex> guard(lock);
+    switch (id)
+    {
+    case CommandNames::image_format:
+        set_string(val, pixel_format_name(pixel_format));
+        return VmbErrorSuccess;
+    case CommandNames::sensor_bit_depth:
+        set_string(val, bit_depth);
+        return VmbErrorSuccess;
+    case CommandNames::trigline:
+        set_string(val, trigline);
+        return VmbErrorSuccess;
+    case CommandNames::trigline_src:
+        set_string(val, trigline_src);
+        return VmbErrorSuccess;
+    case CommandNames::exposure_us:
+        val.type = ValueType::Dbl;
+        val.d = exposure_us;
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate:
+        val.type = ValueType::Dbl;
+        val.d = framerate();
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate_auto:
+        val.type = ValueType::Bool;
+        val.b = fps_auto;
+        return VmbErrorSuccess;
+    case CommandNames::image_size:
+        val.type = ValueType::Size;
+        val.i[0] = width;
+        val.i[1] = height;
+        return VmbErrorSuccess;
+    case CommandNames::image_ofst:
+        val.type = ValueType::Size;
+        val.i[0] = ofst_x;
+        val.i[1] = ofst_y;
+        return VmbErrorSuccess;
+    case CommandNames::sensor_size:
+        val.type = ValueType::Size;
+        val.i[0] = sensor_w;
+        val.i[1] = sensor_h;
+        return VmbErrorSuccess;
+    case CommandNames::throughput_limit:
+        val.type = ValueType::Int;
+        val.i[0] = throughput;
+        return VmbErrorSuccess;
+    case CommandNames::throughput_limit_range:
+        val.type = ValueType::Range;
+        val.i[0] = throughput_min;
+        val.i[1] = throughput_max;
+        return VmbErrorSuccess;
+    default:
+        return VmbErrorNotSupported;
+    }
+}
+
+VmbError_t SyntheticBackend::set_feature(long id, const FeatureValue &val)
+{
+    simulate_latency();
+    std::lock_guard<std::mutex> guard(lock);
+    switch (id)
+    {
+    case CommandNames::image_format:
+    {
+        uint32_t code = pixel_format_code(val.s);
+        if (code == 0)
+            return VmbErrorInvalidValue;
+        pixel_format = code;
+        bit_depth = pixel_format_bits(code) > 8 ? "Bpp12" : "Bpp8";
+        return VmbErrorSuccess;
+    }
+    case CommandNames::sensor_bit_depth:
+        if (strcmp(val.s, "Bpp8") != 0 && strcmp(val.s, "Bpp10") != 0 && strcmp(val.s, "Bpp12") != 0)
+            return VmbErrorInvalidValue;
+        bit_depth = val.s;
+        return VmbErrorSuccess;
+    case CommandNames::trigline:
+        trigline = val.s;
+        return VmbErrorSuccess;
+    case CommandNames::trigline_src:
+        trigline_src = val.s;
+        return VmbErrorSuccess;
+    case CommandNames::exposure_us:
+        if (!(val.d >= 10 && val.d <= 10e6))
+            return VmbErrorInvalidValue;
+        exposure_us = val.d;
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate:
+        if (!(val.d > 0))
+            return VmbErrorInvalidValue;
+        fps_requested = val.d;
+        fps_auto = false;
+        return VmbErrorSuccess;
+    case CommandNames::acq_framerate_auto:
+        fps_auto = val.b;
+        return VmbErrorSuccess;
+    case CommandNames::image_size:
+        width = clamp_step(val.i[0], SYNTHETIC_STEP, sensor_w - ofst_x);
+        height = clamp_step(val.i[1], SYNTHETIC_STEP, sensor_h - ofst_y);
+        return VmbErrorSuccess;
+    case CommandNames::image_ofst:
+        ofst_x = clamp_step(val.i[0], 0, sensor_w - width);
+        ofst_y = clamp_step(val.i[1], 0, sensor_h - height);
+        return VmbErrorSuccess;
+    case CommandNames::throughput_limit:
+        if (val.i[0] < throughput_min || val.i[0] > throughput_max)
+            return VmbErrorInvalidValue;
+        throughput = val.i[0];
+        return VmbErrorSuccess;
+    default:
+        return VmbErrorNotSupported;
+    }
+}
+
+VmbError_t SyntheticBackend::geometry(FrameGeometry &geom)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    geom.width = width;
+    geom.height = height;
+    geom.bits_per_pixel = pixel_format_bits(pixel_format);
+    return VmbErrorSuccess;
+}
+
+VmbError_t SyntheticBackend::start_capture(AlliedCaptureCallback callback, void *user_data)
+{
+    if (running)
+        return VmbErrorInvalidCall;
+    this->callback = callback;
+    this->user_data = user_data;
+    running = true;
+    thr = std::thread(&SyntheticBackend::run, this);
+    return VmbErrorSuccess;
+}
+
+VmbError_t SyntheticBackend::stop_capture()
+{
+    running = false;
+    if (thr.joinable())
+        thr.join();
+    return VmbErrorSuccess;
+}
+
+void SyntheticBackend::run()
+{
+    std::vector<uint8_t> buf;
+    uint32_t w = 0, h = 0, fmt = 0;
+    uint64_t frame_id = 0;
+    uint64_t due = mono_ns();
+    while (running)
+    {
+        uint32_t nw, nh, nfmt;
+        double fps;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            nw = width;
+            nh = height;
+            nfmt = pixel_format;
+            fps = framerate();
+        }
+        if (nw != w || nh != h || nfmt != fmt)
+        {
+            // settings changed: draw the pattern once, every frame reuses it
+            w = nw;
+            h = nh;
+            fmt = nfmt;
+            size_t row = ((size_t)w * pixel_format_bits(fmt) + 7) / 8;
+            buf.resize(row * h);
+            for (size_t y = 0; y < h; y++)
+            {
+                for (size_t x = 0; x < row; x++)
+                    buf[y * row + x] = (uint8_t)(x + y);
+            }
+        }
+
+        uint64_t now = mono_ns();
+        while (fps > 0 && due > now && running)
+        {
+            if (due - now > SYNTHETIC_SPIN_NS)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - SYNTHETIC_SPIN_NS));
+            now = mono_ns();
+        }
+        if (!running)
+            break;
+
+        frame_id++;
+        if (buf.size() >= sizeof(frame_id))
+            memcpy(buf.data(), &frame_id, sizeof(frame_id));
+        VmbFrame_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.buffer = buf.data();
+        frame.imageData = buf.data();
+        frame.bufferSize = buf.size();
+        frame.receiveStatus = VmbFrameStatusComplete;
+        frame.frameID = frame_id;
+        frame.timestamp = now;
+        frame.pixelFormat = fmt;
+        frame.width = w;
+        frame.height = h;
+        callback(nullptr, nullptr, &frame, user_data);
+        delivered.fetch_add(1, std::memory_order_relaxed);
+
+        if (fps > 0)
+        {
+            due += (uint64_t)(1e9 / fps);
+            // never try to catch up on a backlog after a stall
+            now = mono_ns();
+            if (due + 1000000000ULL < now)
+                due = now;
+        }
+    }
+}
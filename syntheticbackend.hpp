@@ -0,0 +1,100 @@
+/**
+ * @file syntheticbackend.hpp
+ * @brief A camera that exists only in software, for running and benchmarking the server without hardware.
+ * @version See Git tags for version information.
+ * @date 2026.10.16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Frames are a fixed test pattern with the frame ID stamped into the first
+ * eight bytes, delivered from the backend's own thread through the SDK
+ * callback signature at the configured rate (as fast as possible at rate 0).
+ * The camera timestamp is mono_ns() at the moment the callback is invoked,
+ * so consumers can measure how long a frame took to reach them.
+ * Every feature in the command table is modelled, with limits a real camera
+ * would apply: the image is clamped to the sensor, and acq_framerate is
+ * capped by the exposure time and by throughput_limit over the frame size.
+ * Each get and set takes latency_us, standing in for the GenICam round trip.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <alliedcam.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camerabackend.hpp"
+
+struct SyntheticConfig
+{
+    uint32_t width = 1920;  // sensor and initial image size
+    uint32_t height = 1080;
+    std::string format = "Mono8";
+    double fps = 30;          // 0 delivers as fast as the consumers keep up
+    uint32_t latency_us = 100; // simulated feature access time
+
+    /**
+     * @brief Parse "N[:WxH[:FPS[:FORMAT[:LATENCY_US]]]]", as given to -s.
+     *
+     * @param count Number of cameras, N.
+     * @return false if the spec is malformed.
+     */
+    bool parse(const char *spec, int &count);
+};
+
+class SyntheticBackend : public CameraBackend
+{
+    std::mutex lock; // protects the feature values below
+    uint32_t sensor_w, sensor_h;
+    uint32_t width, height, ofst_x = 0, ofst_y = 0;
+    uint32_t pixel_format;
+    std::string bit_depth;
+    std::string trigline = "Line0";
+    std::string trigline_src = "ExposureActive";
+    double exposure_us = 1000;
+    double fps_requested;
+    bool fps_auto = false;
+    int64_t throughput = 450000000; // bytes/s
+    uint32_t latency_us;
+
+    std::atomic<bool> running;
+    std::thread thr;
+    AlliedCaptureCallback callback = nullptr;
+    void *user_data = nullptr;
+
+    double max_framerate() const;
+    double framerate() const;
+    void simulate_latency() const;
+    void run();
+
+public:
+    static const int64_t throughput_min = 4000000;
+    static const int64_t throughput_max = 450000000;
+
+    std::atomic<uint64_t> delivered; // frames handed to the callback
+
+    /**
+     * @throws std::runtime_error if the format is not a known pixel format.
+     */
+    SyntheticBackend(const SyntheticConfig &cfg);
+    ~SyntheticBackend();
+
+    SyntheticBackend(const SyntheticBackend &) = delete;
+    SyntheticBackend &operator=(const SyntheticBackend &) = delete;
+
+    const char *kind() const
+    {
+        return "synthetic";
+    }
+
+    VmbError_t get_feature(long id, FeatureValue &value);
+    VmbError_t set_feature(long id, const FeatureValue &value);
+    VmbError_t geometry(FrameGeometry &geom);
+    VmbError_t start_capture(AlliedCaptureCallback callback, void *user_data);
+    VmbError_t stop_capture();
+};